@@ -0,0 +1,415 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <cstddef>
+#include <nlohmann/json.hpp>
+#include "../src/transaction_data.h"
+#include "../src/subset_generator.h"
+#include "../src/subset_sum_table.h"
+#include "../src/partition_analyzer.h"
+#include "../src/workload_generator.h"
+
+// Global allocation counter, incremented by every form of the replaced operator new below
+static std::atomic<size_t> allocation_count(0);
+
+// Counts and performs one allocation; every replaced operator delete releases it with std::free
+static void* counted_allocate(size_t size, size_t alignment) noexcept {
+   allocation_count.fetch_add(1, std::memory_order_relaxed);
+   if (size == 0) {
+       size = 1;
+   }
+   if (alignment <= alignof(std::max_align_t)) {
+       return std::malloc(size);
+   }
+   // aligned_alloc requires the size to be a multiple of the alignment
+   return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void* counted_allocate_or_throw(size_t size, size_t alignment) {
+   if (void* ptr = counted_allocate(size, alignment)) {
+       return ptr;
+   }
+   throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return counted_allocate_or_throw(size, 0); }
+void* operator new[](size_t size) { return counted_allocate_or_throw(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) {
+   return counted_allocate_or_throw(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+   return counted_allocate_or_throw(size, static_cast<size_t>(alignment));
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_allocate(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+   return counted_allocate(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+   return counted_allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }
+
+/**
+* Options controlling which parameter combinations are benchmarked.
+*/
+struct BenchOptions {
+   std::vector<size_t> n_values = {3, 5, 6};   // Number of inputs
+   std::vector<size_t> m_values = {3, 5, 6};   // Number of outputs
+   double min_time = 0.05;                     // Minimum measured seconds per benchmark
+   WorkloadShape shape = WorkloadShape::PAYMENT_WITH_CHANGE;
+   uint64_t seed = 42;
+   std::string output_filename;                // Empty means stdout
+};
+
+/**
+* Result of a single benchmark run.
+*/
+struct BenchResult {
+   std::string name;
+   size_t n;
+   size_t m;
+   size_t k;
+   size_t iterations;
+   double ns_per_op;
+   double items_per_sec;
+   double allocs_per_op;
+};
+
+/**
+* Times an operation until at least min_time seconds have been measured.
+* The iteration count doubles after each round so timer overhead stays negligible.
+*
+* @param name Name of the benchmark
+* @param n Number of inputs
+* @param m Number of outputs
+* @param k Number of groups (0 if not applicable)
+* @param items_per_op Number of items one call of op processes
+* @param min_time Minimum measured time in seconds
+* @param op The operation to benchmark
+* @return The benchmark result
+*/
+template <typename Op>
+BenchResult run_benchmark(const std::string& name, size_t n, size_t m, size_t k,
+                          double items_per_op, double min_time, Op&& op) {
+   // Warm up caches and lazily allocated state
+   op();
+
+   size_t iterations = 1;
+   while (true) {
+       size_t allocations_before = allocation_count.load(std::memory_order_relaxed);
+       auto start = std::chrono::steady_clock::now();
+
+       for (size_t i = 0; i < iterations; ++i) {
+           op();
+       }
+
+       auto end = std::chrono::steady_clock::now();
+       size_t allocations = allocation_count.load(std::memory_order_relaxed) - allocations_before;
+       double elapsed = std::chrono::duration<double>(end - start).count();
+
+       if (elapsed >= min_time || iterations >= (1ULL << 40)) {
+           double ns_per_op = elapsed * 1e9 / iterations;
+           return {
+               name, n, m, k, iterations, ns_per_op,
+               items_per_op * iterations / elapsed,
+               static_cast<double>(allocations) / iterations
+           };
+       }
+
+       iterations *= 2;
+   }
+}
+
+/**
+* Generates all partitions of {0..size-1} grouped by their number of groups.
+*
+* @param size Number of elements
+* @return Vector indexed by group count containing all partitions with that many groups
+*/
+std::vector<std::vector<IndexPartition>> partitions_by_group_count(size_t size) {
+   std::vector<ElementIndex> indices(size);
+   for (ElementIndex i = 0; i < size; ++i) {
+       indices[i] = i;
+   }
+
+   std::vector<std::vector<IndexPartition>> result(size + 1);
+   PartitionGenerator generator(indices);
+   while (generator.has_more()) {
+       for (auto& partition : generator.next_chunk(500)) {
+           result[partition.size()].push_back(std::move(partition));
+       }
+   }
+
+   return result;
+}
+
+/**
+* Benchmarks all enumeration and evaluation kernels for one (n, m) combination.
+*
+* @param n Number of inputs
+* @param m Number of outputs
+* @param options Benchmark options
+* @param results Vector the results are appended to
+*/
+void bench_transaction_shape(size_t n, size_t m, const BenchOptions& options, std::vector<BenchResult>& results) {
+   TransactionData tx_data = generate_workload_transaction(options.shape, n, m, options.seed + n * 1000 + m);
+   ElementMapper input_mapper(tx_data.get_input_ids());
+   ElementMapper output_mapper(tx_data.get_output_ids());
+   TransactionValues values(tx_data);
+
+   // Optimization barrier for results that are otherwise unused
+   volatile size_t sink = 0;
+
+   results.push_back(run_benchmark("generate_subsets", n, m, 0, static_cast<double>((1ULL << n) - 1), options.min_time, [&]() {
+       sink = sink + generate_subsets(tx_data, SubsetType::INPUTS).size();
+   }));
+
+   results.push_back(run_benchmark("calculate_mask_value", n, m, 0, static_cast<double>((1ULL << n) - 1), options.min_time, [&]() {
+       double total = 0.0;
+       for (uint64_t mask = 1; mask < (1ULL << n); ++mask) {
+           total += calculate_mask_value(values, mask, SubsetType::INPUTS);
+       }
+       sink = sink + static_cast<size_t>(total);
+   }));
+
+   results.push_back(run_benchmark("build_subset_sum_table", n, m, 0, static_cast<double>(1ULL << n), options.min_time, [&]() {
+       sink = sink + build_subset_sum_table(values.inputs()).size();
+   }));
+
+   std::vector<ElementIndex> input_indices(n);
+   for (ElementIndex i = 0; i < n; ++i) {
+       input_indices[i] = i;
+   }
+
+   PartitionGenerator generator_for_count(input_indices);
+   results.push_back(run_benchmark("PartitionGenerator::next_chunk", n, m, 0,
+                                   static_cast<double>(generator_for_count.total_partitions()), options.min_time, [&]() {
+       PartitionGenerator generator(input_indices);
+       while (generator.has_more()) {
+           sink = sink + generator.next_chunk(500).size();
+       }
+   }));
+
+   // Chunks with block sums and signatures, in both generator orders
+   PartitionChunk value_chunk;
+   for (PartitionOrder order : {PartitionOrder::LEXICOGRAPHIC, PartitionOrder::GRAY_CODE}) {
+       std::string name = order == PartitionOrder::GRAY_CODE ? "PartitionGenerator::next_chunk_gray"
+                                                             : "PartitionGenerator::next_chunk_values";
+       results.push_back(run_benchmark(name, n, m, 0, static_cast<double>(generator_for_count.total_partitions()),
+                                       options.min_time, [&]() {
+           PartitionGenerator generator(input_indices, values.inputs(), order);
+           while (generator.has_more()) {
+               generator.next_chunk(500, value_chunk);
+               sink = sink + value_chunk.size();
+           }
+       }));
+   }
+
+   auto input_partitions = partitions_by_group_count(n);
+   auto output_partitions = partitions_by_group_count(m);
+
+   // All partitions with their signatures, for the dominance kernels
+   std::vector<ElementIndex> output_indices(m);
+   for (ElementIndex i = 0; i < m; ++i) {
+       output_indices[i] = i;
+   }
+   PartitionChunk input_chunk;
+   PartitionChunk output_chunk;
+   PartitionGenerator(input_indices, values.inputs()).next_chunk(SIZE_MAX, input_chunk);
+   PartitionGenerator(output_indices, values.outputs()).next_chunk(SIZE_MAX, output_chunk);
+   std::vector<uint64_t> mask;
+
+   std::ofstream null_file("/dev/null");
+   StreamMappingSink null_sink(null_file);
+   std::mutex file_mutex;
+   std::atomic<size_t> valid_count(0);
+   PhaseCounters counters;
+
+   for (size_t k = 1; k <= std::min(n, m); ++k) {
+       // Cycle through a bounded sample of pairs with k groups so that pruned and
+       // surviving pairs are mixed like in a real run
+       std::vector<std::pair<const IndexPartition*, const IndexPartition*>> pairs;
+       for (const auto& input_partition : input_partitions[k]) {
+           for (const auto& output_partition : output_partitions[k]) {
+               if (pairs.size() >= 256) break;
+               pairs.emplace_back(&input_partition, &output_partition);
+           }
+       }
+
+       size_t next_pair = 0;
+       auto pair = [&]() -> const std::pair<const IndexPartition*, const IndexPartition*>& {
+           const auto& current = pairs[next_pair];
+           next_pair = (next_pair + 1) % pairs.size();
+           return current;
+       };
+
+       size_t permutations = saturate_to_size(factorial(k));
+
+       std::vector<size_t> indices(k);
+       for (size_t i = 0; i < k; ++i) {
+           indices[i] = i;
+       }
+
+       results.push_back(run_benchmark("could_have_valid_mapping", n, m, k, 1.0, options.min_time, [&]() {
+           const auto& [input_partition, output_partition] = pair();
+           sink = sink + could_have_valid_mapping(values, *input_partition, *output_partition);
+       }));
+
+       results.push_back(run_benchmark("is_valid_mapping", n, m, k, 1.0, options.min_time, [&]() {
+           const auto& [input_partition, output_partition] = pair();
+           sink = sink + is_valid_mapping(values, *input_partition, *output_partition);
+       }));
+
+       results.push_back(run_benchmark("check_all_permutations", n, m, k, static_cast<double>(permutations), options.min_time, [&]() {
+           const auto& [input_partition, output_partition] = pair();
+           check_all_permutations(values, *input_partition, *output_partition, input_mapper, output_mapper,
+                                  valid_count, file_mutex, null_sink, counters);
+       }));
+
+       // One input signature against all output signatures with k groups, per kernel
+       SignatureTable table;
+       table.build(output_chunk, k);
+       mask.resize(dominance_mask_words(table));
+       std::vector<size_t> input_positions;
+       for (size_t p = 0; p < input_chunk.size(); ++p) {
+           if (input_chunk.group_count(p) == k) input_positions.push_back(p);
+       }
+       for (const std::string kernel_name : {"scalar", "avx2", "avx512"}) {
+           DominanceKernel kernel = dominance_kernel_by_name(kernel_name);
+           if (!kernel) continue;  // Not supported by this CPU
+           size_t next_input = 0;
+           results.push_back(run_benchmark("dominance_mask_" + kernel_name, n, m, k, static_cast<double>(table.size()),
+                                           options.min_time, [&]() {
+               kernel(input_chunk[input_positions[next_input]].signature().begin(), table, 0, mask.size(), mask.data());
+               next_input = (next_input + 1) % input_positions.size();
+               sink = sink + mask[0];
+           }));
+       }
+
+       // All input partitions with k groups against the dominance index of the output partitions
+       std::vector<SignatureTable> output_tables(k + 1);
+       output_tables[k].build(output_chunk, k);
+       std::vector<PartitionPair> partition_pairs;
+       results.push_back(run_benchmark("prune_partition_pairs", n, m, k,
+                                       static_cast<double>(input_positions.size() * table.size()),
+                                       options.min_time, [&]() {
+           partition_pairs.clear();
+           sink = sink + prune_partition_pairs(input_chunk, output_tables, partition_pairs, mask);
+       }));
+
+       results.push_back(run_benchmark("format_mapping_for_csv", n, m, k, 1.0, options.min_time, [&]() {
+           const auto& [input_partition, output_partition] = pair();
+           sink = sink + format_mapping_for_csv(tx_data, *input_partition, *output_partition, indices,
+                                                input_mapper, output_mapper, 1).size();
+       }));
+   }
+}
+
+/**
+* Parses a comma separated list of sizes, e.g. "3,4,5".
+*/
+std::vector<size_t> parse_size_list(const std::string& list) {
+   std::vector<size_t> values;
+   std::stringstream ss(list);
+   std::string item;
+   while (std::getline(ss, item, ',')) {
+       if (!item.empty()) {
+           values.push_back(std::stoul(item));
+       }
+   }
+   return values;
+}
+
+void print_usage(const char* program) {
+   std::cerr << "Usage: " << program << " [--n 3,5,6] [--m 3,5,6] [--min-time SECONDS] [--shape NAME] [--seed SEED] [--output FILE]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+   BenchOptions options;
+
+   for (int i = 1; i < argc; ++i) {
+       std::string arg = argv[i];
+       if (i + 1 >= argc) {
+           print_usage(argv[0]);
+           return EXIT_FAILURE;
+       }
+
+       std::string value = argv[++i];
+       if (arg == "--n") {
+           options.n_values = parse_size_list(value);
+       } else if (arg == "--m") {
+           options.m_values = parse_size_list(value);
+       } else if (arg == "--min-time") {
+           options.min_time = std::stod(value);
+       } else if (arg == "--shape") {
+           if (!parse_workload_shape(value, options.shape)) {
+               std::cerr << "Error: Unknown shape " << value << std::endl;
+               return EXIT_FAILURE;
+           }
+       } else if (arg == "--seed") {
+           options.seed = std::stoull(value);
+       } else if (arg == "--output") {
+           options.output_filename = value;
+       } else {
+           print_usage(argv[0]);
+           return EXIT_FAILURE;
+       }
+   }
+
+   std::vector<BenchResult> results;
+   for (size_t n : options.n_values) {
+       for (size_t m : options.m_values) {
+           std::cerr << "Benchmarking n=" << n << ", m=" << m << "..." << std::endl;
+           bench_transaction_shape(n, m, options, results);
+       }
+   }
+
+   nlohmann::ordered_json report;
+   report["shape"] = workload_shape_name(options.shape);
+   report["seed"] = options.seed;
+   report["min_time"] = options.min_time;
+   report["results"] = nlohmann::ordered_json::array();
+   for (const auto& result : results) {
+       report["results"].push_back({
+           {"name", result.name},
+           {"n", result.n},
+           {"m", result.m},
+           {"k", result.k},
+           {"iterations", result.iterations},
+           {"ns_per_op", result.ns_per_op},
+           {"items_per_sec", result.items_per_sec},
+           {"allocs_per_op", result.allocs_per_op}
+       });
+   }
+
+   if (options.output_filename.empty()) {
+       std::cout << report.dump(2) << std::endl;
+   } else {
+       std::ofstream output_file(options.output_filename);
+       if (!output_file.is_open()) {
+           std::cerr << "Error: Could not open output file " << options.output_filename << std::endl;
+           return EXIT_FAILURE;
+       }
+       output_file << report.dump(2) << std::endl;
+       std::cerr << "Results have been written to: " << options.output_filename << std::endl;
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#ifndef ANALYSIS_CONTEXT_H
+#define ANALYSIS_CONTEXT_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include "transaction_data.h"
+#include "run_metrics.h"
+#include "mapping_sink.h"
+#include "worker_pool.h"
+#include "partition_analyzer.h"
+#include "subset_analyzer.h"
+#include "analysis_planner.h"
+
+/**
+* What one call of AnalysisContext::analyze computes.
+*/
+struct AnalysisOptions {
+   AnalysisEngine engine = AnalysisEngine::PARTITION_ENUMERATE;
+   size_t memory_budget = 0;        // Bytes, 0 for default_memory_budget()
+   size_t samples_per_k = 20000;    // Random partition pairs per group count (SAMPLED_ESTIMATE)
+   AnalysisControl control;         // Priority among concurrent analyses and the chunk boundary callback
+   bool parallel = true;            // false checks the pairs on the calling thread, e.g. for many analyses side by side
+   bool use_catalogs = true;        // false generates the partitions even where catalogs fit, e.g. to test that path
+};
+
+/**
+* Result of one analysis. Valid mappings themselves go to the sink.
+*/
+struct AnalysisSummary {
+   bool ok = false;
+   AnalysisEngine engine = AnalysisEngine::PARTITION_ENUMERATE;
+   size_t valid_count = 0;
+   double estimated_valid = 0.0;    // Only for SAMPLED_ESTIMATE
+   uint64_t pairs_processed = 0;
+   uint64_t pruned_count = 0;
+   double seconds = 0.0;
+   bool cancelled = false;          // Stopped early through AnalysisControl::cancel; counts are partial
+};
+
+/**
+* State shared by many analyses in one process: the worker pool, and the chunks,
+* signature tables and pair lists of the partition analysis. A tool that analyzes
+* many transactions, or a long-running service, creates one context and calls
+* analyze() for each of them, so threads are started once and buffers keep their
+* capacity between transactions.
+*
+* Partition catalogs are shared process-wide through PartitionCatalogStore, and
+* the Bell and Stirling tables are compile-time constants, so both are warm after
+* the first analysis of a shape as well.
+*
+* analyze() may be called from several threads at once. Every running analysis
+* takes its own workspace, and the pair checks of all of them share the workers.
+*/
+class AnalysisContext {
+private:
+   WorkerPool pool;
+   WorkerPool calling_thread{0};    // For analyses that do not use the workers
+   std::mutex workspaces_mutex;
+   std::vector<std::unique_ptr<PartitionWorkspace>> idle_workspaces;
+
+   std::unique_ptr<PartitionWorkspace> acquire_workspace() {
+       std::lock_guard<std::mutex> lock(workspaces_mutex);
+       if (idle_workspaces.empty()) {
+           return std::make_unique<PartitionWorkspace>();
+       }
+       std::unique_ptr<PartitionWorkspace> workspace = std::move(idle_workspaces.back());
+       idle_workspaces.pop_back();
+       return workspace;
+   }
+
+   void release_workspace(std::unique_ptr<PartitionWorkspace> workspace) {
+       std::lock_guard<std::mutex> lock(workspaces_mutex);
+       idle_workspaces.push_back(std::move(workspace));
+   }
+
+public:
+   /**
+   * @param threads Number of worker threads, 0 for default_thread_count(); with a
+   *                single thread the pairs are checked on the calling thread
+   */
+   explicit AnalysisContext(unsigned int threads = 0)
+       : pool(thread_count_for(threads) > 1 ? thread_count_for(threads) : 0) {}
+
+   AnalysisContext(const AnalysisContext&) = delete;
+   AnalysisContext& operator=(const AnalysisContext&) = delete;
+
+   static unsigned int thread_count_for(unsigned int threads) {
+       return threads ? std::min<unsigned int>(threads, MAX_WORKER_THREADS) : default_thread_count();
+   }
+
+   unsigned int threads() const {
+       return std::max(1u, pool.size());
+   }
+
+   WorkerPool& workers() {
+       return pool;
+   }
+
+   /**
+   * Loads the partition catalogs for a transaction shape ahead of the first analysis,
+   * if the catalog covers both sides; otherwise the analysis generates the partitions.
+   *
+   * @param num_inputs Number of inputs
+   * @param num_outputs Number of outputs
+   */
+   void prepare(size_t num_inputs, size_t num_outputs) {
+       if (num_inputs > PartitionCatalog::MAX_ELEMENTS || num_outputs > PartitionCatalog::MAX_ELEMENTS) {
+           return;
+       }
+       PartitionCatalogStore::instance().get(num_inputs);
+       PartitionCatalogStore::instance().get(num_outputs);
+   }
+
+   /**
+   * Analyzes one transaction with the given engine.
+   *
+   * @param tx_data The transaction data
+   * @param options The engine and its limits
+   * @param sink Destination of the CSV rows; PARTITION_COUNT and SAMPLED_ESTIMATE write none
+   * @param metrics Run metrics of this analysis
+   * @return The summary; ok is false if the engine failed
+   */
+   AnalysisSummary analyze(const TransactionData& tx_data, const AnalysisOptions& options, MappingSink& sink,
+                           RunMetrics& metrics) {
+       AnalysisSummary summary;
+       summary.engine = options.engine;
+       auto start_time = std::chrono::steady_clock::now();
+
+       const auto& input_ids = tx_data.get_input_ids();
+       const auto& output_ids = tx_data.get_output_ids();
+       if (input_ids.empty() || output_ids.empty()) {
+           std::cerr << "Error: Transaction has no inputs or no outputs" << std::endl;
+           return summary;
+       }
+
+       switch (options.engine) {
+           case AnalysisEngine::SUBSET_ENUMERATE: {
+               if (input_ids.size() > SubsetSumTable::MAX_VALUES || output_ids.size() > SubsetSumTable::MAX_VALUES) {
+                   std::cerr << "Error: Subset analysis supports at most " << SubsetSumTable::MAX_VALUES
+                             << " inputs and outputs" << std::endl;
+                   return summary;
+               }
+               summary.valid_count = find_valid_combinations(tx_data, sink, metrics, options.control,
+                                                             options.parallel ? &pool : nullptr);
+               break;
+           }
+           case AnalysisEngine::PARTITION_ENUMERATE:
+           case AnalysisEngine::PARTITION_COUNT: {
+               ElementMapper input_mapper(input_ids);
+               ElementMapper output_mapper(output_ids);
+               MemoryGovernor governor = partition_memory_governor(options.memory_budget, input_ids.size(),
+                                                                   output_ids.size());
+               CountingMappingSink counting_sink;
+               MappingSink& target = options.engine == AnalysisEngine::PARTITION_COUNT ? counting_sink : sink;
+
+               std::unique_ptr<PartitionWorkspace> workspace = acquire_workspace();
+               summary.valid_count = process_partition_chunks(tx_data, input_mapper, output_mapper, governor, target,
+                                                              *workspace, options.parallel ? pool : calling_thread,
+                                                              metrics, options.control, options.use_catalogs);
+               release_workspace(std::move(workspace));
+               break;
+           }
+           case AnalysisEngine::SAMPLED_ESTIMATE: {
+               summary.estimated_valid = run_sampled_estimate(tx_data, options.samples_per_k);
+               break;
+           }
+       }
+
+       summary.ok = true;
+       summary.cancelled = options.control.cancelled();
+       summary.pairs_processed = metrics.pairs_processed;
+       summary.pruned_count = metrics.pruned_count;
+       summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+       return summary;
+   }
+
+   /**
+   * Analyzes one transaction, collecting its metrics in a fresh RunMetrics.
+   */
+   AnalysisSummary analyze(const TransactionData& tx_data, const AnalysisOptions& options, MappingSink& sink) {
+       RunMetrics metrics;
+       return analyze(tx_data, options, sink, metrics);
+   }
+};
+
+#endif // ANALYSIS_CONTEXT_H
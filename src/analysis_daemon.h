@@ -0,0 +1,548 @@
+#ifndef ANALYSIS_DAEMON_H
+#define ANALYSIS_DAEMON_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <nlohmann/json.hpp>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+#include "transaction_data.h"
+#include "memory_budget.h"
+#include "mapping_sink.h"
+#include "analysis_context.h"
+#include "bitcoin_rpc.h"
+#include "job_scheduler.h"
+
+/**
+* One client connection of the daemon. Frames are single lines of JSON in both
+* directions; a line is only sent complete, so frames of concurrent writers never
+* interleave.
+*/
+class FrameConnection {
+private:
+   int fd;
+   std::string pending;        // Received bytes after the last complete frame
+   std::mutex write_mutex;
+   bool broken = false;
+
+public:
+   // Longest request frame accepted, which bounds the memory of a connection
+   static constexpr size_t MAX_FRAME_BYTES = size_t{16} << 20;
+
+   explicit FrameConnection(int socket_fd) : fd(socket_fd) {}
+
+   FrameConnection(const FrameConnection&) = delete;
+   FrameConnection& operator=(const FrameConnection&) = delete;
+
+   ~FrameConnection() {
+       close(fd);
+   }
+
+   /**
+   * Sends one frame.
+   *
+   * @param frame The JSON object to send
+   * @return false if the client has gone away
+   */
+   bool send(const nlohmann::json& frame) {
+       std::string line = frame.dump() + "\n";
+       std::lock_guard<std::mutex> lock(write_mutex);
+       size_t sent = 0;
+       while (!broken && sent < line.size()) {
+           ssize_t written = ::send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+           if (written < 0 && errno == EINTR) continue;
+           if (written <= 0) {
+               broken = true;
+               break;
+           }
+           sent += static_cast<size_t>(written);
+       }
+       return !broken;
+   }
+
+   /**
+   * Waits for the next frame.
+   *
+   * @param line Receives the frame without the newline
+   * @param stopping Checked while waiting; reading stops once it is set
+   * @return false if the client closed the connection, sent an oversized frame, or the daemon is stopping
+   */
+   bool receive(std::string& line, const std::atomic<bool>& stopping) {
+       char buffer[4096];
+       while (true) {
+           size_t newline = pending.find('\n');
+           if (newline != std::string::npos) {
+               line = pending.substr(0, newline);
+               pending.erase(0, newline + 1);
+               return true;
+           }
+           if (pending.size() > MAX_FRAME_BYTES) {
+               send({{"type", "error"}, {"message", "Frame too large"}});
+               return false;
+           }
+
+           struct pollfd poll_fd = {fd, POLLIN, 0};
+           int ready = poll(&poll_fd, 1, 250);
+           if (stopping) return false;
+           if (ready < 0 && errno == EINTR) continue;
+           if (ready < 0) return false;
+           if (ready == 0) continue;
+
+           ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+           if (received < 0 && errno == EINTR) continue;
+           if (received <= 0) return false;
+           pending.append(buffer, static_cast<size_t>(received));
+       }
+   }
+};
+
+/**
+* Streams the CSV rows of one job to its client as "rows" frames. Rows are
+* collected up to FRAME_ROW_BYTES and sent at the latest when the analysis
+* flushes. Once max_bytes have been sent further rows are dropped and the job is
+* reported as truncated; the analysis still counts every mapping.
+*/
+class FrameMappingSink : public MappingSink {
+private:
+   FrameConnection& connection;
+   nlohmann::json id;
+   std::string rows_buffer;
+   size_t max_bytes;
+
+public:
+   static constexpr size_t FRAME_ROW_BYTES = size_t{64} << 10;
+
+   size_t sent_bytes = 0;
+   bool truncated = false;
+   bool disconnected = false;
+
+   /**
+   * @param client The connection of the client
+   * @param request_id Echoed in every frame
+   * @param result_bytes Most CSV bytes sent for this job, 0 for no limit
+   */
+   FrameMappingSink(FrameConnection& client, const nlohmann::json& request_id, size_t result_bytes)
+       : connection(client), id(request_id), max_bytes(result_bytes) {}
+
+   bool wants_mappings() const override { return true; }
+
+   void write(const std::string& rows) override {
+       if (truncated || disconnected) {
+           return;
+       }
+       if (max_bytes > 0 && sent_bytes + rows_buffer.size() + rows.size() > max_bytes) {
+           truncated = true;
+           return;
+       }
+       rows_buffer += rows;
+       if (rows_buffer.size() >= FRAME_ROW_BYTES) {
+           flush();
+       }
+   }
+
+   void flush() override {
+       if (rows_buffer.empty() || disconnected) {
+           return;
+       }
+       if (connection.send({{"id", id}, {"type", "rows"}, {"csv", rows_buffer}})) {
+           sent_bytes += rows_buffer.size();
+       } else {
+           disconnected = true;
+       }
+       rows_buffer.clear();
+   }
+};
+
+/**
+* One analysis job as sent by a client:
+*
+*     {"id": 1, "txid": "...", "engine": "partition_enumerate", "memory_budget": "512M"}
+*     {"id": 2, "inputs": [0.5, 0.25], "outputs": [0.6, 0.1], "engine": "partition_count"}
+*
+* engine is one of the names of analysis_engine_name (default partition_enumerate).
+* Optional: "stream" (default true) sends the rows, "max_result_bytes" limits them,
+* "memory_budget" (bytes or a size like "512M") and "samples_per_k" are passed on.
+* A job gets the daemon's per-job share of its memory budget and may ask for less,
+* but not for more.
+*/
+struct DaemonJob {
+   nlohmann::json id;
+   std::string txid;
+   TransactionData tx_data;
+   AnalysisOptions options;
+   bool stream = true;
+   size_t max_result_bytes = 0;
+};
+
+/**
+* Reads a job from a request frame.
+*
+* @param request The parsed frame
+* @param job Receives the job; for a txid the transaction is not fetched yet
+* @param error Receives the reason if the request is malformed
+* @param max_memory_budget Largest memory budget a job may have, also used if it names none
+* @return true if the request is a valid job
+*/
+bool parse_daemon_job(const nlohmann::json& request, DaemonJob& job, std::string& error,
+                      size_t max_memory_budget) {
+   try {
+       job.id = request.value("id", nlohmann::json());
+
+       std::string engine = request.value("engine", analysis_engine_name(AnalysisEngine::PARTITION_ENUMERATE));
+       if (!parse_analysis_engine(engine, job.options.engine)) {
+           error = "Unknown engine " + engine;
+           return false;
+       }
+
+       if (request.contains("memory_budget")) {
+           const auto& budget = request["memory_budget"];
+           if (budget.is_number_unsigned()) {
+               job.options.memory_budget = budget.get<size_t>();
+           } else if (!budget.is_string() || !parse_byte_size(budget.get<std::string>(), job.options.memory_budget)) {
+               error = "Invalid memory_budget";
+               return false;
+           }
+           if (job.options.memory_budget > max_memory_budget) {
+               error = "memory_budget exceeds the per-job limit of " + format_bytes(max_memory_budget);
+               return false;
+           }
+       }
+       if (job.options.memory_budget == 0) {
+           job.options.memory_budget = max_memory_budget;
+       }
+       job.options.samples_per_k = request.value("samples_per_k", job.options.samples_per_k);
+       job.stream = request.value("stream", true);
+       job.max_result_bytes = request.value("max_result_bytes", size_t{0});
+
+       if (request.contains("txid")) {
+           job.txid = request["txid"].get<std::string>();
+       } else if (request.contains("inputs") && request.contains("outputs")) {
+           const auto& inputs = request["inputs"];
+           for (size_t i = 0; i < inputs.size(); ++i) {
+               job.tx_data.add_input("input_" + std::to_string(i), inputs[i].get<double>());
+           }
+           const auto& outputs = request["outputs"];
+           for (size_t i = 0; i < outputs.size(); ++i) {
+               job.tx_data.add_output("output_" + std::to_string(i), outputs[i].get<double>());
+           }
+       } else {
+           error = "Request needs a txid or inputs and outputs";
+           return false;
+       }
+   } catch (const std::exception& e) {
+       error = std::string("Malformed request: ") + e.what();
+       return false;
+   }
+   return true;
+}
+
+/**
+* Serves analysis jobs on a Unix domain socket.
+*
+* Every connection is handled by its own thread and may send any number of jobs,
+* which run one after another; jobs of different connections run concurrently.
+* All jobs share one AnalysisContext, the partition catalogs and the RPC client
+* with its cache of previous output values, so they stay warm between jobs.
+* A JobScheduler admits the jobs by their estimated cost, so that small
+* transactions are answered quickly while expensive ones run, and splits the
+* memory budget between the jobs that can run at the same time.
+*
+* For each job the daemon answers with an "accepted" frame, "rows" frames with the
+* CSV rows if the job streams them, and a final "summary" frame, or with a single
+* "error" frame. {"type": "stats"} returns counters of the daemon itself.
+*
+* The engines' progress output is discarded while the daemon serves. On SIGINT or
+* SIGTERM running jobs are cancelled at their next chunk boundary and answered
+* with an error frame.
+*/
+class AnalysisDaemon {
+private:
+   std::string socket_path;
+   AnalysisContext& context;
+   JobScheduler scheduler;
+   int listen_fd = -1;
+
+   // Connection threads; finished ones are joined while accepting new ones
+   struct ConnectionThread {
+       std::thread thread;
+       std::shared_ptr<std::atomic<bool>> finished;
+   };
+   std::vector<ConnectionThread> connections;
+
+   std::atomic<uint64_t> jobs_started{0};
+   std::atomic<uint64_t> jobs_completed{0};
+   std::atomic<uint64_t> jobs_failed{0};
+
+   static std::atomic<bool>& stop_flag() {
+       static std::atomic<bool> stopping{false};
+       return stopping;
+   }
+
+   static void handle_signal(int) {
+       stop_flag() = true;
+   }
+
+   /**
+   * Runs one job and sends its frames.
+   */
+   void run_job(FrameConnection& connection, DaemonJob& job) {
+       jobs_started++;
+
+       if (!job.txid.empty()) {
+           nlohmann::json response = get_transaction(job.txid);
+           if (!response.contains("result") || response["result"].is_null()) {
+               std::string message = "Could not fetch transaction " + job.txid;
+               if (response.contains("error") && !response["error"].is_null()) {
+                   message += ": " + response["error"].dump();
+               }
+               connection.send({{"id", job.id}, {"type", "error"}, {"message", message}});
+               jobs_failed++;
+               return;
+           }
+           job.tx_data = parse_transaction_data(response);
+       }
+
+       const auto& tx_data = job.tx_data;
+       double estimated_pairs = estimate_job_pairs(tx_data, job.options.engine, job.options.samples_per_k);
+       JobClass job_class = scheduler.classify(estimated_pairs);
+       connection.send({{"id", job.id}, {"type", "accepted"},
+                        {"engine", analysis_engine_name(job.options.engine)},
+                        {"inputs", tx_data.get_input_ids().size()}, {"outputs", tx_data.get_output_ids().size()},
+                        {"valid_transaction", tx_data.is_valid()},
+                        {"class", job_class_name(job_class)}, {"estimated_pairs", estimated_pairs}});
+
+       FrameMappingSink frame_sink(connection, job.id, job.max_result_bytes);
+       CountingMappingSink counting_sink;
+       MappingSink& sink = job.stream ? static_cast<MappingSink&>(frame_sink) : counting_sink;
+
+       // Wait for a slot of the job's class; expensive jobs may be paused at chunk boundaries
+       auto admit_start = std::chrono::steady_clock::now();
+       std::unique_ptr<JobScheduler::Slot> slot = scheduler.admit(job_class);
+       double wait_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - admit_start).count();
+       job.options.control.priority = slot->priority();
+       job.options.control.cancel = &stop_flag();
+       job.options.control.at_chunk_boundary = [&slot](const std::function<void()>& release_memory) {
+           slot->checkpoint(release_memory);
+       };
+
+       AnalysisSummary summary = context.analyze(tx_data, job.options, sink);
+       sink.flush();
+       slot.reset();
+       if (!summary.ok || summary.cancelled) {
+           std::string message = summary.cancelled ? "Daemon stopping, job cancelled" : "Analysis failed";
+           connection.send({{"id", job.id}, {"type", "error"}, {"message", message}});
+           jobs_failed++;
+           return;
+       }
+
+       nlohmann::json frame = {
+           {"id", job.id}, {"type", "summary"},
+           {"engine", analysis_engine_name(summary.engine)},
+           {"valid_count", summary.valid_count},
+           {"pairs_processed", summary.pairs_processed},
+           {"pruned_count", summary.pruned_count},
+           {"seconds", summary.seconds},
+           {"class", job_class_name(job_class)},
+           {"wait_seconds", wait_seconds},
+           {"result_bytes", frame_sink.sent_bytes},
+           {"truncated", frame_sink.truncated}
+       };
+       if (summary.engine == AnalysisEngine::SAMPLED_ESTIMATE) {
+           frame["estimated_valid"] = summary.estimated_valid;
+       }
+       connection.send(frame);
+       jobs_completed++;
+   }
+
+   nlohmann::json stats_frame() {
+       BitcoinRpcClient& rpc = BitcoinRpcClient::instance();
+       nlohmann::json classes = nlohmann::json::object();
+       for (JobClass job_class : {JobClass::SMALL, JobClass::MEDIUM, JobClass::LARGE}) {
+           JobScheduler::ClassStats stats = scheduler.stats(job_class);
+           classes[job_class_name(job_class)] = {
+               {"running", stats.running}, {"waiting", stats.waiting}, {"completed", stats.completed},
+               {"yields", stats.yields}, {"pauses", stats.pauses},
+               {"p50_seconds", stats.p50_seconds}, {"p99_seconds", stats.p99_seconds}
+           };
+       }
+       return {
+           {"classes", classes},
+           {"type", "stats"},
+           {"threads", context.threads()},
+           {"job_memory_budget", scheduler.job_memory_budget()},
+           {"jobs_started", jobs_started.load()},
+           {"jobs_completed", jobs_completed.load()},
+           {"jobs_failed", jobs_failed.load()},
+           {"cached_prevouts", rpc.cached_prevouts()},
+           {"prevout_cache_hits", rpc.prevout_cache_hits()},
+           {"prevout_cache_misses", rpc.prevout_cache_misses()}
+       };
+   }
+
+   void serve_connection(int client_fd) {
+       FrameConnection connection(client_fd);
+       std::string line;
+       while (connection.receive(line, stop_flag())) {
+           if (line.empty()) continue;
+
+           nlohmann::json request;
+           try {
+               request = nlohmann::json::parse(line);
+           } catch (const nlohmann::json::exception& e) {
+               connection.send({{"type", "error"}, {"message", std::string("Malformed frame: ") + e.what()}});
+               continue;
+           }
+
+           if (!request.is_object()) {
+               connection.send({{"type", "error"}, {"message", "Malformed frame: expected a JSON object"}});
+               continue;
+           }
+           nlohmann::json id = request.value("id", nlohmann::json());
+
+           // A bad request fails with an error frame, never the connection thread or the daemon
+           try {
+               if (request.contains("type") && !request["type"].is_string()) {
+                   connection.send({{"id", id}, {"type", "error"}, {"message", "Malformed frame: type must be a string"}});
+                   continue;
+               }
+               if (request.value("type", "analyze") == "stats") {
+                   nlohmann::json frame = stats_frame();
+                   frame["id"] = id;
+                   connection.send(frame);
+                   continue;
+               }
+
+               DaemonJob job;
+               std::string error;
+               if (!parse_daemon_job(request, job, error, scheduler.job_memory_budget())) {
+                   connection.send({{"id", job.id}, {"type", "error"}, {"message", error}});
+                   continue;
+               }
+               run_job(connection, job);
+           } catch (const std::exception& e) {
+               connection.send({{"id", id}, {"type", "error"}, {"message", std::string("Request failed: ") + e.what()}});
+           }
+       }
+   }
+
+public:
+   /**
+   * @param path Path of the Unix domain socket; a stale socket file is replaced, a live one is not
+   * @param analysis_context Context shared by all jobs
+   * @param limits Cost classes, their concurrency limits, the time slice of expensive jobs and the memory budget
+   */
+   AnalysisDaemon(const std::string& path, AnalysisContext& analysis_context,
+                  const SchedulerLimits& limits = SchedulerLimits())
+       : socket_path(path), context(analysis_context), scheduler(limits) {}
+
+   AnalysisDaemon(const AnalysisDaemon&) = delete;
+   AnalysisDaemon& operator=(const AnalysisDaemon&) = delete;
+
+   /**
+   * Listens on the socket and serves connections until SIGINT or SIGTERM.
+   *
+   * @return true if the daemon stopped normally, false if the socket could not be opened or
+   *         another daemon listens on it
+   */
+   bool run() {
+       struct sockaddr_un address;
+       std::memset(&address, 0, sizeof(address));
+       address.sun_family = AF_UNIX;
+       if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+           std::cerr << "Error: Invalid socket path " << socket_path << std::endl;
+           return false;
+       }
+       std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+       // Replace a socket file left by a daemon that is gone, but never a live socket or another file
+       struct stat existing;
+       if (lstat(socket_path.c_str(), &existing) == 0) {
+           if (!S_ISSOCK(existing.st_mode)) {
+               std::cerr << "Error: " << socket_path << " exists and is not a socket" << std::endl;
+               return false;
+           }
+           int probe_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+           bool live = probe_fd >= 0 &&
+                       connect(probe_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0;
+           if (probe_fd >= 0) {
+               close(probe_fd);
+           }
+           if (live) {
+               std::cerr << "Error: Another daemon is listening on " << socket_path << std::endl;
+               return false;
+           }
+           unlink(socket_path.c_str());
+       }
+
+       listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+       if (listen_fd < 0) {
+           std::cerr << "Error: Could not create socket: " << std::strerror(errno) << std::endl;
+           return false;
+       }
+       if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 ||
+           listen(listen_fd, 64) != 0) {
+           std::cerr << "Error: Could not listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+           close(listen_fd);
+           return false;
+       }
+
+       stop_flag() = false;
+       std::signal(SIGINT, handle_signal);
+       std::signal(SIGTERM, handle_signal);
+       std::cout << "Analysis daemon listening on " << socket_path << " with "
+                 << context.threads() << " threads" << std::endl;
+
+       // std::cout is shared by all threads, so it is silenced for the whole time jobs may run
+       SilencedOutput silenced;
+       std::ostream daemon_output(silenced.original_buffer());
+
+       while (!stop_flag()) {
+           struct pollfd poll_fd = {listen_fd, POLLIN, 0};
+           int ready = poll(&poll_fd, 1, 250);
+           if (ready <= 0) continue;
+
+           int client_fd = accept(listen_fd, nullptr, nullptr);
+           if (client_fd < 0) continue;
+
+           auto finished = std::make_shared<std::atomic<bool>>(false);
+           connections.push_back({std::thread([this, client_fd, finished]() {
+               serve_connection(client_fd);
+               *finished = true;
+           }), finished});
+
+           for (auto it = connections.begin(); it != connections.end();) {
+               if (*it->finished) {
+                   it->thread.join();
+                   it = connections.erase(it);
+               } else {
+                   ++it;
+               }
+           }
+       }
+
+       daemon_output << "Analysis daemon stopping" << std::endl;
+       close(listen_fd);
+       unlink(socket_path.c_str());
+
+       // Running jobs see the stop flag at their next chunk boundary, waiting ones are woken
+       scheduler.stop();
+       for (auto& connection : connections) {
+           connection.thread.join();
+       }
+       connections.clear();
+       return true;
+   }
+};
+
+#endif // ANALYSIS_DAEMON_H
@@ -0,0 +1,635 @@
+#ifndef ANALYSIS_PLANNER_H
+#define ANALYSIS_PLANNER_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <iomanip>
+#include <algorithm>
+#include <bitset>
+#include <memory>
+#include "transaction_data.h"
+#include "subset_generator.h"
+#include "bell_number.h"
+#include "partition_analyzer.h"
+
+/**
+* The question an analysis has to answer.
+*/
+enum class AnalysisQuestion {
+   COUNT,       // Exact number of valid mappings
+   SAMPLE,      // Approximate number of valid mappings
+   ENUMERATE    // Every valid mapping written to CSV
+};
+
+/**
+* Engines that can run an analysis.
+*/
+enum class AnalysisEngine {
+   SUBSET_ENUMERATE,       // find_valid_combinations
+   PARTITION_ENUMERATE,    // find_valid_partitions writing every mapping
+   PARTITION_COUNT,        // find_valid_partitions counting only
+   SAMPLED_ESTIMATE        // Monte Carlo estimate from random partition pairs
+};
+
+std::string analysis_question_name(AnalysisQuestion question) {
+   switch (question) {
+       case AnalysisQuestion::COUNT:     return "count";
+       case AnalysisQuestion::SAMPLE:    return "sample";
+       case AnalysisQuestion::ENUMERATE: return "enumerate";
+   }
+   return "unknown";
+}
+
+bool parse_analysis_question(const std::string& name, AnalysisQuestion& question) {
+   for (AnalysisQuestion candidate : {AnalysisQuestion::COUNT, AnalysisQuestion::SAMPLE, AnalysisQuestion::ENUMERATE}) {
+       if (analysis_question_name(candidate) == name) {
+           question = candidate;
+           return true;
+       }
+   }
+   return false;
+}
+
+std::string analysis_engine_name(AnalysisEngine engine) {
+   switch (engine) {
+       case AnalysisEngine::SUBSET_ENUMERATE:    return "subset_enumerate";
+       case AnalysisEngine::PARTITION_ENUMERATE: return "partition_enumerate";
+       case AnalysisEngine::PARTITION_COUNT:     return "partition_count";
+       case AnalysisEngine::SAMPLED_ESTIMATE:    return "sampled_estimate";
+   }
+   return "unknown";
+}
+
+bool parse_analysis_engine(const std::string& name, AnalysisEngine& engine) {
+   for (AnalysisEngine candidate : {AnalysisEngine::SUBSET_ENUMERATE, AnalysisEngine::PARTITION_ENUMERATE,
+                                    AnalysisEngine::PARTITION_COUNT, AnalysisEngine::SAMPLED_ESTIMATE}) {
+       if (analysis_engine_name(candidate) == name) {
+           engine = candidate;
+           return true;
+       }
+   }
+   return false;
+}
+
+/**
+* Whether an engine can answer a question.
+*/
+bool engine_answers(AnalysisEngine engine, AnalysisQuestion question) {
+   switch (engine) {
+       case AnalysisEngine::SUBSET_ENUMERATE:
+       case AnalysisEngine::PARTITION_ENUMERATE:
+           return true;
+       case AnalysisEngine::PARTITION_COUNT:
+           return question != AnalysisQuestion::ENUMERATE;
+       case AnalysisEngine::SAMPLED_ESTIMATE:
+           return question == AnalysisQuestion::SAMPLE;
+   }
+   return false;
+}
+
+/**
+* Sampled statistics for all partition pairs with k groups.
+*/
+struct StratumEstimate {
+   size_t k = 0;
+   double input_partitions = 0.0;          // S(n,k)
+   double output_partitions = 0.0;         // S(m,k)
+   double pairs = 0.0;                     // S(n,k) * S(m,k)
+   size_t samples = 0;                     // Sampled pairs
+   double prune_pass_rate = 0.0;           // Fraction of pairs surviving pruning
+   double expected_valid = 0.0;            // Estimated valid mappings in this stratum
+   double valid_standard_error = 0.0;      // Standard error of expected_valid
+   double bytes_per_mapping = 0.0;         // CSV bytes of one mapping with k groups
+};
+
+/**
+* Predicted cost of running one engine.
+*/
+struct EngineEstimate {
+   AnalysisEngine engine;
+   bool answers_question = false;
+   double pairs_to_check = 0.0;
+   double permutations = 0.0;
+   double output_bytes = 0.0;
+   double runtime_seconds = 0.0;
+};
+
+/**
+* Cost prediction for an analysis and the engine selected to run it.
+*/
+struct AnalysisPlan {
+   AnalysisQuestion question = AnalysisQuestion::ENUMERATE;
+   size_t num_inputs = 0;
+   size_t num_outputs = 0;
+   unsigned int threads = 1;
+
+   std::vector<StratumEstimate> strata;
+   double total_pairs = 0.0;
+   double pairs_to_check = 0.0;            // Pairs surviving pruning
+   double expected_valid = 0.0;
+   double valid_standard_error = 0.0;
+   double output_bytes = 0.0;
+
+   // Measured costs in seconds per operation
+   double prune_cost = 0.0;
+   double permutation_cost = 0.0;
+   double format_cost = 0.0;
+   double generation_cost = 0.0;
+
+   std::vector<EngineEstimate> engines;
+   AnalysisEngine selected = AnalysisEngine::PARTITION_ENUMERATE;
+   double planning_seconds = 0.0;
+
+   const EngineEstimate& selected_estimate() const {
+       for (const auto& estimate : engines) {
+           if (estimate.engine == selected) return estimate;
+       }
+       return engines.front();
+   }
+};
+
+/**
+* Draws a partition of {0..n-1} with exactly k groups uniformly at random.
+* Walks the recurrence S(i,j) = j*S(i-1,j) + S(i-1,j-1) backwards to decide for
+* every element whether it opens a new group or joins one of the existing ones.
+*
+* @param n Number of elements
+* @param k Number of groups (1 <= k <= n)
+* @param stirling Table from stirling_table_double with at least n+1 rows
+* @param rng The random number generator
+* @return The random partition
+*/
+IndexPartition random_partition_with_k_groups(size_t n, size_t k,
+                                              const std::vector<std::vector<double>>& stirling,
+                                              std::mt19937_64& rng) {
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+   // opens_group[e] is true if element e starts a new group
+   std::vector<bool> opens_group(n, false);
+   size_t groups = k;
+   for (size_t i = n; i > 0; --i) {
+       double join_weight = groups * stirling[i-1][groups];
+       double total_weight = stirling[i][groups];
+       if (uniform(rng) * total_weight >= join_weight) {
+           opens_group[i-1] = true;
+           groups--;
+       }
+   }
+
+   IndexPartition partition;
+   partition.reserve(k);
+   for (size_t e = 0; e < n; ++e) {
+       if (opens_group[e] || partition.empty()) {
+           partition.push_back({static_cast<ElementIndex>(e)});
+       } else {
+           std::uniform_int_distribution<size_t> group_dist(0, partition.size() - 1);
+           partition[group_dist(rng)].push_back(static_cast<ElementIndex>(e));
+       }
+   }
+
+   return partition;
+}
+
+/**
+* Prints a large count compactly, e.g. 1234 or 5.68e+12.
+*/
+std::string format_estimate(double value) {
+   std::stringstream ss;
+   if (value < 1e6) {
+       ss << std::fixed << std::setprecision(value < 10 && value != std::floor(value) ? 2 : 0) << value;
+   } else {
+       ss << std::scientific << std::setprecision(2) << value;
+   }
+   return ss.str();
+}
+
+/**
+* Prints a duration in seconds as s, m, h or d.
+*/
+std::string format_duration(double seconds) {
+   std::stringstream ss;
+   ss << std::fixed << std::setprecision(1);
+   if (seconds < 60) {
+       ss << seconds << "s";
+   } else if (seconds < 3600) {
+       ss << seconds / 60 << "m";
+   } else if (seconds < 86400) {
+       ss << seconds / 3600 << "h";
+   } else {
+       ss << seconds / 86400 << "d";
+   }
+   return ss.str();
+}
+
+/**
+* Picks the engine with the lowest predicted runtime among those answering the question.
+*/
+void select_engine(AnalysisPlan& plan) {
+   double best_runtime = std::numeric_limits<double>::infinity();
+   for (auto& estimate : plan.engines) {
+       estimate.answers_question = engine_answers(estimate.engine, plan.question);
+       if (estimate.answers_question && estimate.runtime_seconds < best_runtime) {
+           best_runtime = estimate.runtime_seconds;
+           plan.selected = estimate.engine;
+       }
+   }
+}
+
+/**
+* Estimates the cost of the partition analysis of a transaction.
+* Pair counts come from Stirling numbers; pruning pass rate, valid mappings per
+* pair, CSV size and per-operation costs are measured on uniformly sampled
+* partition pairs of the actual transaction values.
+*
+* @param tx_data The transaction data
+* @param question The question the analysis has to answer
+* @param samples_per_k Number of random partition pairs sampled for each group count
+* @param seed Seed for the random number generator
+* @param memory_budget Memory budget of the analysis in bytes, 0 for the default
+* @return The analysis plan
+*/
+AnalysisPlan plan_partition_analysis(const TransactionData& tx_data, AnalysisQuestion question,
+                                     size_t samples_per_k = 200, uint64_t seed = 1, size_t memory_budget = 0) {
+   auto planning_start = std::chrono::steady_clock::now();
+
+   AnalysisPlan plan;
+   plan.question = question;
+   plan.num_inputs = tx_data.get_input_ids().size();
+   plan.num_outputs = tx_data.get_output_ids().size();
+   plan.threads = default_thread_count();
+
+   size_t n = plan.num_inputs;
+   size_t m = plan.num_outputs;
+   if (n == 0 || m == 0) {
+       plan.engines = {{AnalysisEngine::PARTITION_ENUMERATE}, {AnalysisEngine::PARTITION_COUNT}, {AnalysisEngine::SAMPLED_ESTIMATE}};
+       select_engine(plan);
+       return plan;
+   }
+
+   ElementMapper input_mapper(tx_data.get_input_ids());
+   ElementMapper output_mapper(tx_data.get_output_ids());
+   TransactionValues values(tx_data);
+   auto stirling = stirling_table_double(std::max(n, m));
+   std::mt19937_64 rng(seed);
+
+   uint64_t prune_ns = 0, prune_calls = 0;
+   uint64_t permutation_ns = 0, permutation_calls = 0;
+   uint64_t format_ns = 0, format_calls = 0;
+
+   double permutations_to_test = 0.0;
+
+   for (size_t k = 1; k <= std::min(n, m); ++k) {
+       StratumEstimate stratum;
+       stratum.k = k;
+       stratum.input_partitions = count_to_double(stirling_number(n, k));
+       stratum.output_partitions = count_to_double(stirling_number(m, k));
+       stratum.pairs = stratum.input_partitions * stratum.output_partitions;
+       stratum.samples = samples_per_k;
+
+       double k_factorial = count_to_double(factorial(k));
+       // Check every permutation of small groups, a random subset otherwise
+       bool exhaustive = k <= 6;
+       size_t permutation_samples = exhaustive ? static_cast<size_t>(k_factorial) : 256;
+
+       std::vector<size_t> indices(k);
+       size_t survivors = 0;
+       double valid_sum = 0.0;
+       double valid_square_sum = 0.0;
+
+       for (size_t sample = 0; sample < samples_per_k; ++sample) {
+           IndexPartition input_partition = random_partition_with_k_groups(n, k, stirling, rng);
+           IndexPartition output_partition = random_partition_with_k_groups(m, k, stirling, rng);
+
+           auto prune_start = std::chrono::steady_clock::now();
+           bool survives = could_have_valid_mapping(values, input_partition, output_partition);
+           prune_ns += elapsed_ns(prune_start);
+           prune_calls++;
+
+           // Measure the CSV size once per stratum, valid or not
+           if (sample == 0) {
+               std::iota(indices.begin(), indices.end(), 0);
+               auto format_start = std::chrono::steady_clock::now();
+               stratum.bytes_per_mapping = static_cast<double>(format_mapping_for_csv(
+                   tx_data, input_partition, output_partition, indices, input_mapper, output_mapper, 1).size());
+               format_ns += elapsed_ns(format_start);
+               format_calls++;
+           }
+
+           if (!survives) {
+               continue;
+           }
+           survivors++;
+
+           // Count valid orderings of the output groups
+           std::iota(indices.begin(), indices.end(), 0);
+           IndexPartition permuted_output(k);
+           size_t valid_orderings = 0;
+           auto permutation_start = std::chrono::steady_clock::now();
+           for (size_t p = 0; p < permutation_samples; ++p) {
+               if (exhaustive) {
+                   if (p > 0) std::next_permutation(indices.begin(), indices.end());
+               } else {
+                   std::shuffle(indices.begin(), indices.end(), rng);
+               }
+               for (size_t i = 0; i < k; ++i) {
+                   permuted_output[i] = output_partition[indices[i]];
+               }
+               if (is_valid_mapping(values, input_partition, permuted_output)) {
+                   valid_orderings++;
+               }
+           }
+           permutation_ns += elapsed_ns(permutation_start);
+           permutation_calls += permutation_samples;
+
+           double valid_for_pair = exhaustive
+               ? static_cast<double>(valid_orderings)
+               : k_factorial * valid_orderings / permutation_samples;
+           valid_sum += valid_for_pair;
+           valid_square_sum += valid_for_pair * valid_for_pair;
+       }
+
+       double mean = valid_sum / samples_per_k;
+       double variance = samples_per_k > 1
+           ? std::max(0.0, (valid_square_sum - samples_per_k * mean * mean) / (samples_per_k - 1))
+           : 0.0;
+
+       stratum.prune_pass_rate = static_cast<double>(survivors) / samples_per_k;
+       stratum.expected_valid = stratum.pairs * mean;
+       stratum.valid_standard_error = stratum.pairs * std::sqrt(variance / samples_per_k);
+
+       plan.total_pairs += stratum.pairs;
+       plan.pairs_to_check += stratum.pairs * stratum.prune_pass_rate;
+       plan.expected_valid += stratum.expected_valid;
+       plan.valid_standard_error += stratum.valid_standard_error * stratum.valid_standard_error;
+       plan.output_bytes += stratum.expected_valid * stratum.bytes_per_mapping;
+       permutations_to_test += stratum.pairs * stratum.prune_pass_rate * k_factorial;
+
+       plan.strata.push_back(stratum);
+   }
+   plan.valid_standard_error = std::sqrt(plan.valid_standard_error);
+
+   plan.prune_cost = prune_calls ? prune_ns / 1e9 / prune_calls : 0.0;
+   plan.permutation_cost = permutation_calls ? permutation_ns / 1e9 / permutation_calls : plan.prune_cost;
+   plan.format_cost = format_calls ? format_ns / 1e9 / format_calls : 0.0;
+
+   // Shapes whose catalogs fit in the budget are decoded from them instead of generated
+   MemoryGovernor governor = partition_memory_governor(memory_budget, n, m);
+   bool from_catalog = reserve_partition_catalogs(governor, n, m);
+
+   // Measure generation (or catalog decoding) cost per partition on the smaller side
+   {
+       size_t sample_elements = std::min<size_t>(std::min(n, m), 6);
+       auto generation_start = std::chrono::steady_clock::now();
+       size_t generated = 0;
+       if (from_catalog) {
+           // A catalog this small is built in microseconds; only the decoding is timed
+           std::unique_ptr<PartitionCatalog> catalog = PartitionCatalog::build(sample_elements);
+           std::vector<double> sample_values(sample_elements, 1.0);
+           PartitionChunk chunk;
+           generation_start = std::chrono::steady_clock::now();
+           for (size_t k = 1; k <= sample_elements; ++k) {
+               catalog->decode(k, 0, catalog->stratum_size(k), sample_values, chunk);
+               generated += chunk.size();
+           }
+       } else {
+           std::vector<ElementIndex> indices(sample_elements);
+           std::iota(indices.begin(), indices.end(), 0);
+           PartitionGenerator generator(indices);
+           generated = generator.next_chunk(500).size();
+       }
+       plan.generation_cost = generated ? elapsed_ns(generation_start) / 1e9 / generated : 0.0;
+   }
+
+   double input_chunk = static_cast<double>(governor.input_chunk_size());
+   double generated_partitions = 0.0;
+   if (from_catalog) {
+       // Only strata with k <= min(n, m) are decoded; an output stratum is decoded once if it
+       // fits in one output chunk, otherwise again for every input chunk of that stratum
+       double output_chunk = static_cast<double>(governor.output_chunk_size(governor.input_chunk_size()));
+       for (const StratumEstimate& stratum : plan.strata) {
+           double output_passes = stratum.output_partitions <= output_chunk
+                                      ? 1.0 : std::ceil(stratum.input_partitions / input_chunk);
+           generated_partitions += stratum.input_partitions + output_passes * stratum.output_partitions;
+       }
+   } else {
+       // The output partitions are regenerated for every input chunk sized from the memory budget
+       double input_partitions = count_to_double(bell_number(n));
+       double output_partitions = count_to_double(bell_number(m));
+       generated_partitions = input_partitions + std::ceil(input_partitions / input_chunk) * output_partitions;
+   }
+   double generation_seconds = generated_partitions * plan.generation_cost;
+
+   double threads = static_cast<double>(plan.threads);
+   double check_seconds = (plan.total_pairs * plan.prune_cost + permutations_to_test * plan.permutation_cost) / threads;
+
+   EngineEstimate enumerate_estimate{AnalysisEngine::PARTITION_ENUMERATE};
+   enumerate_estimate.pairs_to_check = plan.pairs_to_check;
+   enumerate_estimate.permutations = permutations_to_test;
+   enumerate_estimate.output_bytes = plan.output_bytes;
+   enumerate_estimate.runtime_seconds = generation_seconds + check_seconds + plan.expected_valid * plan.format_cost;
+
+   EngineEstimate count_estimate{AnalysisEngine::PARTITION_COUNT};
+   count_estimate.pairs_to_check = plan.pairs_to_check;
+   count_estimate.permutations = permutations_to_test;
+   count_estimate.runtime_seconds = generation_seconds + check_seconds;
+
+   // The sampled engine repeats the measurement above with 100 times more samples
+   EngineEstimate sampled_estimate{AnalysisEngine::SAMPLED_ESTIMATE};
+   sampled_estimate.pairs_to_check = 100.0 * samples_per_k * plan.strata.size();
+   sampled_estimate.runtime_seconds = 100.0 * elapsed_ns(planning_start) / 1e9;
+
+   plan.engines = {enumerate_estimate, count_estimate, sampled_estimate};
+   select_engine(plan);
+
+   plan.planning_seconds = elapsed_ns(planning_start) / 1e9;
+   return plan;
+}
+
+/**
+* Estimates the cost of the simple subset analysis of a transaction.
+*
+* @param tx_data The transaction data
+* @param question The question the analysis has to answer
+* @param samples Number of random subset pairs to sample
+* @param seed Seed for the random number generator
+* @return The analysis plan
+*/
+AnalysisPlan plan_subset_analysis(const TransactionData& tx_data, AnalysisQuestion question,
+                                  size_t samples = 2000, uint64_t seed = 1) {
+   auto planning_start = std::chrono::steady_clock::now();
+
+   AnalysisPlan plan;
+   plan.question = question;
+   plan.num_inputs = tx_data.get_input_ids().size();
+   plan.num_outputs = tx_data.get_output_ids().size();
+   plan.threads = 1;
+
+   const auto& input_ids = tx_data.get_input_ids();
+   const auto& output_ids = tx_data.get_output_ids();
+   size_t n = input_ids.size();
+   size_t m = output_ids.size();
+
+   double input_subsets = std::pow(2.0, static_cast<double>(n)) - 1.0;
+   double output_subsets = std::pow(2.0, static_cast<double>(m)) - 1.0;
+   plan.total_pairs = input_subsets * output_subsets;
+   plan.pairs_to_check = plan.total_pairs;
+
+   // Draw a random non-empty subset of n elements as a bit mask
+   std::mt19937_64 rng(seed);
+   std::bernoulli_distribution coin(0.5);
+   auto random_subset = [&](size_t count) {
+       uint64_t mask = 0;
+       while (mask == 0) {
+           for (size_t j = 0; j < count; ++j) {
+               if (coin(rng)) mask |= 1ULL << j;
+           }
+       }
+       return mask;
+   };
+   TransactionValues values(tx_data);
+
+   size_t valid = 0;
+   double bytes_sum = 0.0;
+   uint64_t check_ns = 0;
+   if (n > 0 && m > 0 && n < 64 && m < 64) {
+       for (size_t sample = 0; sample < samples; ++sample) {
+           uint64_t input_subset = random_subset(n);
+           uint64_t output_subset = random_subset(m);
+
+           auto check_start = std::chrono::steady_clock::now();
+           double input_value = calculate_mask_value(values, input_subset, SubsetType::INPUTS);
+           double output_value = calculate_mask_value(values, output_subset, SubsetType::OUTPUTS);
+           check_ns += elapsed_ns(check_start);
+
+           if (output_value <= input_value) {
+               valid++;
+               // Roughly the CSV row: id, quoted subsets, three values
+               bytes_sum += 40.0 + std::bitset<64>(input_subset).count() * (input_ids[0].size() + 1)
+                                 + std::bitset<64>(output_subset).count() * (output_ids[0].size() + 1);
+           }
+       }
+   }
+
+   double valid_fraction = samples ? static_cast<double>(valid) / samples : 0.0;
+   plan.expected_valid = plan.total_pairs * valid_fraction;
+   plan.valid_standard_error = plan.total_pairs * std::sqrt(valid_fraction * (1.0 - valid_fraction) / std::max<size_t>(samples, 1));
+   plan.output_bytes = valid ? plan.expected_valid * bytes_sum / valid : 0.0;
+   plan.permutation_cost = samples ? check_ns / 1e9 / samples : 0.0;
+
+   // Formatting one row costs roughly as much as building its strings
+   plan.format_cost = 4.0 * plan.permutation_cost;
+
+   // Only the enumeration formats and writes the rows; the count just compares the values
+   bool write_rows = question == AnalysisQuestion::ENUMERATE;
+   EngineEstimate subset_estimate{AnalysisEngine::SUBSET_ENUMERATE};
+   subset_estimate.pairs_to_check = plan.total_pairs;
+   subset_estimate.permutations = plan.total_pairs;
+   subset_estimate.output_bytes = write_rows ? plan.output_bytes : 0.0;
+   subset_estimate.runtime_seconds = plan.total_pairs * plan.permutation_cost +
+                                     (write_rows ? plan.expected_valid * plan.format_cost : 0.0);
+
+   // The sampled engine repeats the sampling above with 100 times more samples
+   EngineEstimate sampled_estimate{AnalysisEngine::SAMPLED_ESTIMATE};
+   sampled_estimate.pairs_to_check = 100.0 * samples;
+   sampled_estimate.runtime_seconds = 100.0 * elapsed_ns(planning_start) / 1e9;
+
+   plan.engines = {subset_estimate, sampled_estimate};
+   select_engine(plan);
+
+   plan.planning_seconds = elapsed_ns(planning_start) / 1e9;
+   return plan;
+}
+
+/**
+* Prints an analysis plan: per-stratum estimates, per-engine predictions and the selected engine.
+*
+* @param plan The plan to print
+*/
+void print_analysis_plan(const AnalysisPlan& plan) {
+   std::cout << "\nAnalysis Plan (" << plan.num_inputs << " inputs, " << plan.num_outputs << " outputs, question: "
+             << analysis_question_name(plan.question) << ")" << std::endl;
+   std::cout << "-----------------------------------------------------------" << std::endl;
+
+   if (!plan.strata.empty()) {
+       std::cout << std::left << std::setw(4) << "k"
+                 << std::setw(12) << "Pairs"
+                 << std::setw(12) << "Pass rate"
+                 << std::setw(14) << "Exp. valid"
+                 << "Bytes/mapping" << std::endl;
+       for (const auto& stratum : plan.strata) {
+           std::stringstream pass_rate;
+           pass_rate << std::fixed << std::setprecision(1) << stratum.prune_pass_rate * 100.0 << "%";
+           std::cout << std::left << std::setw(4) << stratum.k
+                     << std::setw(12) << format_estimate(stratum.pairs)
+                     << std::setw(12) << pass_rate.str()
+                     << std::setw(14) << format_estimate(stratum.expected_valid)
+                     << format_estimate(stratum.bytes_per_mapping) << std::endl;
+       }
+       std::cout << std::right;
+   }
+
+   std::cout << "Total pairs: " << format_estimate(plan.total_pairs)
+             << " | Pairs to check: " << format_estimate(plan.pairs_to_check)
+             << " | Expected valid mappings: " << format_estimate(plan.expected_valid)
+             << " (+/- " << format_estimate(2.0 * plan.valid_standard_error) << ")"
+             << " | Output: " << format_estimate(plan.output_bytes) << " bytes" << std::endl;
+
+   std::cout << "\nEngine predictions (" << plan.threads << " threads):" << std::endl;
+   for (const auto& estimate : plan.engines) {
+       std::cout << (estimate.engine == plan.selected ? " * " : "   ")
+                 << std::left << std::setw(22) << analysis_engine_name(estimate.engine) << std::right
+                 << "runtime " << std::setw(8) << format_duration(estimate.runtime_seconds)
+                 << " | output " << format_estimate(estimate.output_bytes) << " bytes"
+                 << (estimate.answers_question ? "" : " | cannot answer question") << std::endl;
+   }
+
+   std::cout << "Selected engine: " << analysis_engine_name(plan.selected)
+             << " (planning took " << format_duration(plan.planning_seconds) << ")" << std::endl;
+   std::cout << "-----------------------------------------------------------" << std::endl;
+}
+
+/**
+* Runs the sampled estimate engine and prints the estimated number of valid mappings.
+*
+* @param tx_data The transaction data
+* @param samples_per_k Number of random partition pairs sampled for each group count
+* @return The estimated number of valid mappings
+*/
+double run_sampled_estimate(const TransactionData& tx_data, size_t samples_per_k = 20000) {
+   std::cout << "Sampling " << samples_per_k << " random partition pairs per group count..." << std::endl;
+   AnalysisPlan estimate = plan_partition_analysis(tx_data, AnalysisQuestion::SAMPLE, samples_per_k, 7);
+
+   for (const auto& stratum : estimate.strata) {
+       std::cout << "k=" << stratum.k << ": " << format_estimate(stratum.expected_valid)
+                 << " (+/- " << format_estimate(2.0 * stratum.valid_standard_error) << ") valid mappings" << std::endl;
+   }
+   std::cout << "Estimated total valid mappings: " << format_estimate(estimate.expected_valid)
+             << " (95% interval +/- " << format_estimate(2.0 * estimate.valid_standard_error) << ")" << std::endl;
+
+   return estimate.expected_valid;
+}
+
+/**
+* Estimates the number of valid subset combinations from random subset pairs and prints it.
+*
+* @param tx_data The transaction data
+* @param samples Number of random subset pairs to sample
+* @return The estimated number of valid combinations
+*/
+double run_sampled_subset_estimate(const TransactionData& tx_data, size_t samples = 200000) {
+   std::cout << "Sampling " << samples << " random subset pairs..." << std::endl;
+   AnalysisPlan estimate = plan_subset_analysis(tx_data, AnalysisQuestion::SAMPLE, samples, 7);
+
+   std::cout << "Estimated total valid combinations: " << format_estimate(estimate.expected_valid)
+             << " (95% interval +/- " << format_estimate(2.0 * estimate.valid_standard_error) << ")" << std::endl;
+
+   return estimate.expected_valid;
+}
+
+#endif // ANALYSIS_PLANNER_H
@@ -2,53 +2,174 @@
 #define BELL_NUMBER_H
 
 #include <vector>
+#include <string>
+#include <limits>
+#include <cstdint>
 #include <stdexcept>
 
+/**
+* Combinatorial tables shared by the partition generator, the planner and the progress code.
+*
+* All values are 128-bit and computed at compile time. Arithmetic saturates at
+* COUNT_SATURATED instead of wrapping, so a count that does not fit is detected
+* rather than silently corrupted. Bell numbers fit up to B(42), factorials up to 34!;
+* 64-bit values would already overflow at B(26).
+*/
+using count_t = unsigned __int128;
+
+constexpr count_t COUNT_SATURATED = ~static_cast<count_t>(0);
+constexpr size_t COMBINATORICS_TABLE_SIZE = 64;
+
+constexpr count_t saturating_add(count_t a, count_t b) {
+   return (a > COUNT_SATURATED - b) ? COUNT_SATURATED : a + b;
+}
+
+constexpr count_t saturating_mul(count_t a, count_t b) {
+   if (a == 0 || b == 0) return 0;
+   return (a > COUNT_SATURATED / b) ? COUNT_SATURATED : a * b;
+}
+
+/**
+* Bell numbers B(n), factorials n! and Stirling numbers of the second kind S(n,k)
+* for n, k < COMBINATORICS_TABLE_SIZE.
+*/
+struct CombinatoricsTables {
+   count_t bell[COMBINATORICS_TABLE_SIZE] = {};
+   count_t factorial[COMBINATORICS_TABLE_SIZE] = {};
+   count_t stirling[COMBINATORICS_TABLE_SIZE][COMBINATORICS_TABLE_SIZE] = {};
+};
+
+constexpr CombinatoricsTables make_combinatorics_tables() {
+   CombinatoricsTables tables;
+
+   // S(n,k) = k*S(n-1,k) + S(n-1,k-1)
+   tables.stirling[0][0] = 1;
+   for (size_t n = 1; n < COMBINATORICS_TABLE_SIZE; ++n) {
+       for (size_t k = 1; k <= n; ++k) {
+           tables.stirling[n][k] = saturating_add(saturating_mul(k, tables.stirling[n-1][k]),
+                                                  tables.stirling[n-1][k-1]);
+       }
+   }
+
+   // B(n) is the sum of S(n,k) over all k
+   for (size_t n = 0; n < COMBINATORICS_TABLE_SIZE; ++n) {
+       for (size_t k = 0; k <= n; ++k) {
+           tables.bell[n] = saturating_add(tables.bell[n], tables.stirling[n][k]);
+       }
+   }
+
+   tables.factorial[0] = 1;
+   for (size_t n = 1; n < COMBINATORICS_TABLE_SIZE; ++n) {
+       tables.factorial[n] = saturating_mul(tables.factorial[n-1], n);
+   }
+
+   return tables;
+}
+
+inline constexpr CombinatoricsTables COMBINATORICS = make_combinatorics_tables();
+
+static_assert(COMBINATORICS.bell[5] == 52, "Bell table is wrong");
+static_assert(COMBINATORICS.stirling[6][3] == 90, "Stirling table is wrong");
+static_assert(COMBINATORICS.factorial[10] == 3628800, "Factorial table is wrong");
+
+/**
+* Returns the Bell number B(n), or COUNT_SATURATED if it does not fit in 128 bits.
+*/
+constexpr count_t bell_number(size_t n) {
+   return n < COMBINATORICS_TABLE_SIZE ? COMBINATORICS.bell[n] : COUNT_SATURATED;
+}
+
+/**
+* Returns the Stirling number of the second kind S(n,k), or COUNT_SATURATED if it does not fit.
+*/
+constexpr count_t stirling_number(size_t n, size_t k) {
+   if (k > n) return 0;
+   return n < COMBINATORICS_TABLE_SIZE ? COMBINATORICS.stirling[n][k] : COUNT_SATURATED;
+}
+
+/**
+* Returns n!, or COUNT_SATURATED if it does not fit.
+*/
+constexpr count_t factorial(size_t n) {
+   return n < COMBINATORICS_TABLE_SIZE ? COMBINATORICS.factorial[n] : COUNT_SATURATED;
+}
+
+constexpr bool is_saturated(count_t value) {
+   return value == COUNT_SATURATED;
+}
+
+/**
+* Narrows a count to size_t, clamping to the largest size_t if it does not fit.
+*/
+constexpr size_t saturate_to_size(count_t value) {
+   constexpr size_t max_size = std::numeric_limits<size_t>::max();
+   return value > max_size ? max_size : static_cast<size_t>(value);
+}
+
+/**
+* Converts a count to double; saturated counts become infinity.
+*/
+inline double count_to_double(count_t value) {
+   return is_saturated(value) ? std::numeric_limits<double>::infinity() : static_cast<double>(value);
+}
+
+/**
+* Formats a count in decimal, or as ">= 2^128" if it is saturated.
+*/
+inline std::string count_to_string(count_t value) {
+   if (is_saturated(value)) return ">= 2^128";
+   if (value == 0) return "0";
+
+   std::string digits;
+   while (value > 0) {
+       digits.insert(digits.begin(), static_cast<char>('0' + static_cast<int>(value % 10)));
+       value /= 10;
+   }
+   return digits;
+}
+
+/**
+* Computes Stirling numbers of the second kind as doubles, S[i][j] for i, j <= n.
+* Used where only ratios or magnitudes matter, e.g. for sampling; doubles stay
+* finite far beyond the 128-bit tables.
+*/
+std::vector<std::vector<double>> stirling_table_double(size_t n) {
+   std::vector<std::vector<double>> table(n + 1, std::vector<double>(n + 1, 0.0));
+   table[0][0] = 1.0;
+   for (size_t i = 1; i <= n; ++i) {
+       for (size_t j = 1; j <= i; ++j) {
+           table[i][j] = j * table[i-1][j] + table[i-1][j-1];
+       }
+   }
+   return table;
+}
+
 /**
 * Computes the Bell number B(n), which represents the number of ways to partition a set of n elements.
-* 
+*
 * The Bell number counts the number of different ways to partition a set into non-empty subsets.
 * For example:
 * - B(0) = 1 (empty set has one partition)
 * - B(1) = 1 (one element has one partition)
 * - B(2) = 2 (two elements can be partitioned as {{a,b}} or {{a},{b}})
 * - B(3) = 5 (three elements have five possible partitions)
-* 
+*
 * @param n The number of elements in the set
 * @return The Bell number B(n)
 * @throws std::invalid_argument if n is negative
+* @throws std::overflow_error if B(n) does not fit in 64 bits (n > 25)
 */
 unsigned long long compute_bell_number(int n) {
    if (n < 0) {
        throw std::invalid_argument("Number of elements cannot be negative");
    }
-   
-   if (n == 0 || n == 1) {
-       return 1;
-   }
-   
-   // Use Bell triangle method to compute Bell numbers
-   std::vector<std::vector<unsigned long long>> bell_triangle(n);
-   
-   // Initialize the first row with B(1) = 1
-   bell_triangle[0] = {1};
-   
-   // Fill the Bell triangle
-   for (int i = 1; i < n; i++) {
-       // Allocate space for the current row
-       bell_triangle[i].resize(i + 1);
-       
-       // First number in the row is the last number of the previous row
-       bell_triangle[i][0] = bell_triangle[i-1][i-1];
-       
-       // Fill the rest of the row
-       for (int j = 1; j <= i; j++) {
-           bell_triangle[i][j] = bell_triangle[i][j-1] + bell_triangle[i-1][j-1];
-       }
+
+   count_t bell = bell_number(static_cast<size_t>(n));
+   if (bell > std::numeric_limits<unsigned long long>::max()) {
+       throw std::overflow_error("Bell number B(" + std::to_string(n) + ") does not fit in 64 bits");
    }
-   
-   // The Bell number B(n) is the last number in the last row
-   return bell_triangle[n-1][n-1];
+
+   return static_cast<unsigned long long>(bell);
 }
 
 #endif // BELL_NUMBER_H
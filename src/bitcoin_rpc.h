@@ -0,0 +1,312 @@
+#ifndef BITCOIN_RPC_H
+#define BITCOIN_RPC_H
+
+#include <iostream>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
+#include "transaction_data.h"
+
+// Function to handle the response from the RPC call
+size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+   ((std::string*)userp)->append((char*)contents, size * nmemb);
+   return size * nmemb;
+}
+
+/**
+* JSON-RPC client of the local Bitcoin Core node, shared by the whole process.
+*
+* The curl handle is created once and kept, so consecutive requests reuse the
+* HTTP connection instead of paying curl setup and a new TCP connection each time.
+* Values of previous outputs are cached: resolving the inputs of a transaction
+* fetches each previous transaction once and remembers all of its outputs, which
+* later inputs and later transactions spending the same transaction hit.
+*/
+class BitcoinRpcClient {
+private:
+   // Bitcoin Core RPC URL (assuming it's running locally)
+   std::string url = "http://127.0.0.1:8332";  // Default RPC port
+   std::string user = "rpcuser";               // Your RPC username (see bitcoin.conf)
+   std::string pass = "rpcpw";                 // Your RPC password (see bitcoin.conf)
+
+   std::mutex curl_mutex;
+   CURL* curl = nullptr;
+
+   // Previous output values by "txid:vout", evicted in insertion order
+   std::mutex cache_mutex;
+   std::unordered_map<std::string, double> prevout_values;
+   std::deque<std::string> prevout_order;
+   size_t cache_capacity = 1000000;
+   uint64_t cache_hits = 0;
+   uint64_t cache_misses = 0;
+
+   BitcoinRpcClient() {
+       curl_global_init(CURL_GLOBAL_DEFAULT);
+   }
+
+   ~BitcoinRpcClient() {
+       if (curl) {
+           curl_easy_cleanup(curl);
+       }
+       curl_global_cleanup();
+   }
+
+   static std::string prevout_key(const std::string& txid, size_t vout) {
+       return txid + ":" + std::to_string(vout);
+   }
+
+public:
+   static BitcoinRpcClient& instance() {
+       static BitcoinRpcClient client;
+       return client;
+   }
+
+   BitcoinRpcClient(const BitcoinRpcClient&) = delete;
+   BitcoinRpcClient& operator=(const BitcoinRpcClient&) = delete;
+
+   /**
+   * Sends one JSON-RPC request.
+   *
+   * @param json_data The request payload
+   * @return The raw response body, empty if the request failed
+   */
+   std::string request(const nlohmann::json& json_data) {
+       std::lock_guard<std::mutex> lock(curl_mutex);
+       std::string read_buffer;
+
+       if (!curl) {
+           curl = curl_easy_init();
+           if (!curl) {
+               std::cerr << "CURL request failed: Could not create a curl handle" << std::endl;
+               return read_buffer;
+           }
+       }
+
+       struct curl_slist* headers = NULL;
+
+       // Set the content-type header
+       headers = curl_slist_append(headers, "Content-Type: application/json");
+
+       // Set the URL, user and password for authentication
+       curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+       curl_easy_setopt(curl, CURLOPT_USERPWD, (user + ":" + pass).c_str());
+       curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+       // Convert the JSON object to a string and send it as the POST body
+       std::string json_str = json_data.dump();
+       curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_str.c_str());
+
+       // Specify a callback to handle the response
+       curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+       curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
+
+       // Perform the request
+       CURLcode res = curl_easy_perform(curl);
+
+       // Check for errors
+       if (res != CURLE_OK) {
+           std::cerr << "CURL request failed: " << curl_easy_strerror(res) << std::endl;
+           read_buffer.clear();
+       }
+
+       curl_slist_free_all(headers);
+       return read_buffer;
+   }
+
+   /**
+   * Calls an RPC method and parses the response.
+   *
+   * @param method The RPC method, e.g. "getrawtransaction"
+   * @param params The positional parameters
+   * @return The parsed response with "result" and "error", or null if there was none
+   */
+   nlohmann::json call(const std::string& method, const nlohmann::json& params) {
+       nlohmann::json json_request = {
+           {"jsonrpc", "1.0"},
+           {"id", "curltest"},
+           {"method", method},
+           {"params", params}
+       };
+
+       std::string response = request(json_request);
+       if (response.empty()) {
+           return nlohmann::json();
+       }
+
+       try {
+           return nlohmann::json::parse(response);
+       } catch (const nlohmann::json::exception& e) {
+           std::cerr << "Error parsing JSON response of " << method << ": " << e.what() << std::endl;
+           return nlohmann::json();
+       }
+   }
+
+   /**
+   * Remembers the output values of a transaction.
+   *
+   * @param txid The transaction ID
+   * @param vout The "vout" array of the decoded transaction
+   */
+   void remember_outputs(const std::string& txid, const nlohmann::json& vout) {
+       std::lock_guard<std::mutex> lock(cache_mutex);
+       for (size_t i = 0; i < vout.size(); ++i) {
+           if (!vout[i].contains("value")) continue;
+           std::string key = prevout_key(txid, i);
+           if (prevout_values.emplace(key, vout[i]["value"].get<double>()).second) {
+               prevout_order.push_back(std::move(key));
+           }
+       }
+       while (prevout_values.size() > cache_capacity) {
+           prevout_values.erase(prevout_order.front());
+           prevout_order.pop_front();
+       }
+   }
+
+   /**
+   * Looks up the value of a previous output, fetching the previous transaction
+   * if it is not cached.
+   *
+   * @param txid The previous transaction ID
+   * @param vout The output index
+   * @param value Receives the value in BTC
+   * @return true if the value was found
+   */
+   bool prevout_value(const std::string& txid, size_t vout, double& value) {
+       {
+           std::lock_guard<std::mutex> lock(cache_mutex);
+           auto found = prevout_values.find(prevout_key(txid, vout));
+           if (found != prevout_values.end()) {
+               cache_hits++;
+               value = found->second;
+               return true;
+           }
+           cache_misses++;
+       }
+
+       nlohmann::json prev_tx_response = call("getrawtransaction", nlohmann::json::array({txid, true}));
+       if (!prev_tx_response.contains("result") || !prev_tx_response["result"].is_object() ||
+           !prev_tx_response["result"].contains("vout") || !prev_tx_response["result"]["vout"].is_array()) {
+           return false;
+       }
+
+       const auto& prev_vout = prev_tx_response["result"]["vout"];
+       remember_outputs(txid, prev_vout);
+       if (vout >= prev_vout.size() || !prev_vout[vout].contains("value")) {
+           return false;
+       }
+       value = prev_vout[vout]["value"].get<double>();
+       return true;
+   }
+
+   size_t cached_prevouts() {
+       std::lock_guard<std::mutex> lock(cache_mutex);
+       return prevout_values.size();
+   }
+
+   uint64_t prevout_cache_hits() {
+       std::lock_guard<std::mutex> lock(cache_mutex);
+       return cache_hits;
+   }
+
+   uint64_t prevout_cache_misses() {
+       std::lock_guard<std::mutex> lock(cache_mutex);
+       return cache_misses;
+   }
+};
+
+// Function to make the RPC request
+std::string rpc_request(const nlohmann::json& json_data) {
+   return BitcoinRpcClient::instance().request(json_data);
+}
+
+// Helper function to get a previous transaction by its txid
+nlohmann::json get_transaction(const std::string& txid) {
+   return BitcoinRpcClient::instance().call("getrawtransaction", nlohmann::json::array({txid, true}));
+}
+
+/**
+* Reads the input and output values of a decoded transaction, as returned by
+* getrawtransaction or inside getblock. Input values come from the "prevout" of an
+* input if the node included it (getblock verbosity 3), otherwise from the cache
+* of previous outputs, fetching the previous transaction if needed. Inputs without
+* a previous output (coinbase) have value 0.
+*
+* @param tx The decoded transaction
+* @return The transaction data; inputs and outputs are named input_i and output_i
+*/
+TransactionData parse_transaction(const nlohmann::json& tx) {
+   TransactionData tx_data;
+
+   try {
+       // Process inputs (vin)
+       if (tx.contains("vin") && tx["vin"].is_array()) {
+           const auto& vin = tx["vin"];
+           for (size_t i = 0; i < vin.size(); i++) {
+               const auto& input = vin[i];
+               double value = 0.0;
+
+               if (input.contains("prevout") && input["prevout"].contains("value")) {
+                   // The node resolved the previous output already
+                   value = input["prevout"]["value"].get<double>();
+               } else if (input.contains("txid") && input.contains("vout")) {
+                   // Get the previous transaction ID and output index
+                   std::string prev_txid = input["txid"].get<std::string>();
+                   size_t prev_vout = static_cast<size_t>(input["vout"].get<int>());
+
+                   // Look up the value of the previous output, fetching the previous transaction once
+                   if (!BitcoinRpcClient::instance().prevout_value(prev_txid, prev_vout, value)) {
+                       std::cerr << "Warning: Could not retrieve value for input " << i
+                                 << " (prev_txid: " << prev_txid << ", vout: " << prev_vout << ")" << std::endl;
+                   }
+               }
+
+               // Create input ID and add to transaction data
+               std::string input_id = "input_" + std::to_string(i);
+               tx_data.add_input(input_id, value);
+           }
+       }
+
+       // Process outputs (vout)
+       if (tx.contains("vout") && tx["vout"].is_array()) {
+           const auto& vout = tx["vout"];
+           for (size_t i = 0; i < vout.size(); i++) {
+               const auto& output = vout[i];
+               double value = 0.0;
+
+               // Get output value
+               if (output.contains("value")) {
+                   value = output["value"].get<double>();
+               }
+
+               // Create output ID and add to transaction data
+               std::string output_id = "output_" + std::to_string(i);
+               tx_data.add_output(output_id, value);
+           }
+
+           // Later transactions may spend these outputs
+           if (tx.contains("txid")) {
+               BitcoinRpcClient::instance().remember_outputs(tx["txid"].get<std::string>(), vout);
+           }
+       }
+   } catch (const std::exception& e) {
+       std::cerr << "Error parsing transaction data: " << e.what() << std::endl;
+   }
+
+   return tx_data;
+}
+
+// Function to parse transaction data from JSON response
+TransactionData parse_transaction_data(const nlohmann::json& json_response) {
+   // Check if we have a result in the response
+   if (!json_response.contains("result") || json_response["result"].is_null()) {
+       std::cerr << "Error: No transaction data found in response" << std::endl;
+       return TransactionData();
+   }
+
+   return parse_transaction(json_response["result"]);
+}
+
+#endif // BITCOIN_RPC_H
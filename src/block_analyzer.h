@@ -0,0 +1,375 @@
+#ifndef BLOCK_ANALYZER_H
+#define BLOCK_ANALYZER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include "transaction_data.h"
+#include "mapping_sink.h"
+#include "analysis_context.h"
+#include "job_scheduler.h"
+#include "bitcoin_rpc.h"
+
+/**
+* One transaction of a block and the result of its analysis.
+*/
+struct BlockTransaction {
+   std::string txid;
+   size_t position = 0;                 // Index in the block
+   bool coinbase = false;
+   TransactionData tx_data;
+
+   AnalysisEngine engine = AnalysisEngine::PARTITION_ENUMERATE;
+   double estimated_pairs = 0.0;
+   std::string placement;               // "split", "packed", "skipped" or "coinbase"
+
+   AnalysisSummary summary;
+   uint64_t offset = 0;                 // Rows of this transaction in the block output
+   uint64_t bytes = 0;
+};
+
+/**
+* A block with the input and output values of all of its transactions.
+*/
+struct BlockData {
+   std::string hash;
+   int64_t height = -1;
+   std::string previous_hash;           // Empty for the genesis block
+   std::vector<BlockTransaction> transactions;
+};
+
+/**
+* Reads a block from a getblock result.
+*
+* @param result The "result" of getblock with verbosity 2 or 3
+* @param block Receives the block
+* @return true if the result is a block
+*/
+bool parse_block(const nlohmann::json& result, BlockData& block) {
+   try {
+       block.hash = result.at("hash").get<std::string>();
+       block.height = result.at("height").get<int64_t>();
+       block.previous_hash = result.value("previousblockhash", "");
+       block.transactions.clear();
+
+       const auto& transactions = result.at("tx");
+       block.transactions.reserve(transactions.size());
+       for (size_t i = 0; i < transactions.size(); ++i) {
+           const auto& tx = transactions[i];
+           BlockTransaction block_tx;
+           block_tx.txid = tx.value("txid", "");
+           block_tx.position = i;
+           block_tx.coinbase = tx.contains("vin") && !tx["vin"].empty() && tx["vin"][0].contains("coinbase");
+           // In block order, so outputs spent later in the same block are cached before they are needed
+           block_tx.tx_data = parse_transaction(tx);
+           block.transactions.push_back(std::move(block_tx));
+       }
+   } catch (const nlohmann::json::exception& e) {
+       std::cerr << "Error parsing block: " << e.what() << std::endl;
+       return false;
+   }
+   return true;
+}
+
+/**
+* Fetches a block with the values of all inputs. With getblock verbosity 3 the
+* node includes the previous output of every input, so the whole block is one
+* RPC; nodes that do not support it are asked for verbosity 2 and the input
+* values are resolved through the previous output cache.
+*
+* @param block_id Block height or block hash
+* @param block Receives the block
+* @return true if the block was fetched
+*/
+bool fetch_block(const std::string& block_id, BlockData& block) {
+   BitcoinRpcClient& rpc = BitcoinRpcClient::instance();
+
+   std::string hash = block_id;
+   if (!block_id.empty() && block_id.find_first_not_of("0123456789") == std::string::npos) {
+       nlohmann::json response = rpc.call("getblockhash", nlohmann::json::array({std::stoll(block_id)}));
+       if (!response.contains("result") || !response["result"].is_string()) {
+           std::cerr << "Error: Could not get the hash of block " << block_id << std::endl;
+           return false;
+       }
+       hash = response["result"].get<std::string>();
+   }
+
+   nlohmann::json response = rpc.call("getblock", nlohmann::json::array({hash, 3}));
+   if (!response.contains("result") || !response["result"].is_object()) {
+       response = rpc.call("getblock", nlohmann::json::array({hash, 2}));
+   }
+   if (!response.contains("result") || !response["result"].is_object()) {
+       std::cerr << "Error: Could not fetch block " << block_id;
+       if (response.contains("error") && !response["error"].is_null()) {
+           std::cerr << ": " << response["error"].dump();
+       }
+       std::cerr << std::endl;
+       return false;
+   }
+
+   return parse_block(response["result"], block);
+}
+
+/**
+* How the transactions of a block are analyzed.
+*/
+struct BlockAnalysisOptions {
+   AnalysisEngine engine = AnalysisEngine::PARTITION_ENUMERATE;
+   double split_pairs = 1e7;        // Transactions with more estimated pairs use the whole worker pool
+   double max_pairs = 1e12;         // Transactions with more are estimated by sampling, or skipped
+   size_t memory_budget = 0;
+   size_t samples_per_k = 2000;
+};
+
+/**
+* Decides engine and placement of every transaction from its estimated pairs.
+*/
+void plan_block_analysis(BlockData& block, const BlockAnalysisOptions& options) {
+   for (auto& block_tx : block.transactions) {
+       if (block_tx.coinbase) {
+           block_tx.placement = "coinbase";
+           continue;
+       }
+
+       size_t n = block_tx.tx_data.get_input_ids().size();
+       size_t m = block_tx.tx_data.get_output_ids().size();
+       block_tx.engine = options.engine;
+       block_tx.estimated_pairs = estimate_job_pairs(block_tx.tx_data, options.engine, options.samples_per_k);
+
+       if (n == 0 || m == 0) {
+           block_tx.placement = "skipped";
+       } else if (block_tx.estimated_pairs <= options.max_pairs) {
+           block_tx.placement = block_tx.estimated_pairs > options.split_pairs ? "split" : "packed";
+       } else if (options.engine != AnalysisEngine::SUBSET_ENUMERATE &&
+                  n < COMBINATORICS_TABLE_SIZE && m < COMBINATORICS_TABLE_SIZE) {
+           // Too large to enumerate; the estimate answers at least how many mappings there are
+           block_tx.engine = AnalysisEngine::SAMPLED_ESTIMATE;
+           block_tx.estimated_pairs = estimate_job_pairs(block_tx.tx_data, block_tx.engine, options.samples_per_k);
+           block_tx.placement = "packed";
+       } else {
+           block_tx.placement = "skipped";
+       }
+   }
+}
+
+/**
+* Writes the per-transaction summary index of a block output, replacing the file
+* only once it is complete.
+*
+* @param block The analyzed block
+* @param options The options of the analysis
+* @param csv_filename The block output the offsets refer to
+* @param index_filename The index file to write
+* @param seconds Wall-clock time of the block analysis
+* @return true if the index was written
+*/
+bool write_block_index(const BlockData& block, const BlockAnalysisOptions& options, const std::string& csv_filename,
+                       const std::string& index_filename, double seconds) {
+   nlohmann::ordered_json index;
+   index["hash"] = block.hash;
+   index["height"] = block.height;
+   index["previous_hash"] = block.previous_hash;
+   index["engine"] = analysis_engine_name(options.engine);
+   index["results"] = csv_filename;
+   index["seconds"] = seconds;
+
+   size_t valid_count = 0;
+   size_t analyzed = 0;
+   nlohmann::ordered_json transactions = nlohmann::ordered_json::array();
+   for (const auto& block_tx : block.transactions) {
+       nlohmann::ordered_json entry;
+       entry["position"] = block_tx.position;
+       entry["txid"] = block_tx.txid;
+       entry["inputs"] = block_tx.tx_data.get_input_ids().size();
+       entry["outputs"] = block_tx.tx_data.get_output_ids().size();
+       entry["placement"] = block_tx.placement;
+       if (block_tx.placement == "split" || block_tx.placement == "packed") {
+           entry["engine"] = analysis_engine_name(block_tx.engine);
+           entry["estimated_pairs"] = block_tx.estimated_pairs;
+           entry["ok"] = block_tx.summary.ok;
+           entry["valid_count"] = block_tx.summary.valid_count;
+           if (block_tx.engine == AnalysisEngine::SAMPLED_ESTIMATE) {
+               entry["estimated_valid"] = block_tx.summary.estimated_valid;
+           }
+           entry["seconds"] = block_tx.summary.seconds;
+           entry["offset"] = block_tx.offset;
+           entry["bytes"] = block_tx.bytes;
+           valid_count += block_tx.summary.valid_count;
+           analyzed++;
+       }
+       transactions.push_back(entry);
+   }
+   index["analyzed_transactions"] = analyzed;
+   index["valid_count"] = valid_count;
+   index["transactions"] = transactions;
+
+   std::string temporary_filename = index_filename + ".tmp";
+   std::ofstream index_file(temporary_filename);
+   if (!index_file.is_open()) {
+       std::cerr << "Error: Could not open index file " << temporary_filename << std::endl;
+       return false;
+   }
+   index_file << index.dump(2) << "\n";
+   index_file.close();
+   if (!index_file || std::rename(temporary_filename.c_str(), index_filename.c_str()) != 0) {
+       std::cerr << "Error: Could not write index file " << index_filename << std::endl;
+       return false;
+   }
+   return true;
+}
+
+/**
+* Analyzes every transaction of a block.
+*
+* Transactions are ordered by estimated work, largest first, so the block does
+* not wait for one large transaction started last. Transactions above
+* options.split_pairs run one after another, each split across the whole worker
+* pool. The cheap rest is packed onto the cores: every worker takes the next
+* largest remaining transaction and analyzes it on its own thread.
+*
+* The rows of all transactions go to PREFIX.csv, one section with its own CSV
+* header per transaction. PREFIX.index.json lists every transaction with its
+* placement, counts and the byte range of its section; it is written last, so an
+* index exists only for a complete block output.
+*
+* While the block runs, one RunMetrics for the whole block is exported as
+* analysis="block": the counters of every finished transaction are added to it
+* and its progress is the share of estimated pairs done. Packed transactions are
+* not exported on their own; split ones also appear as their own analysis.
+*
+* @param block The block, fetched with fetch_block; receives the results
+* @param context Context whose workers run the analyses
+* @param options Engine and size limits
+* @param output_prefix Prefix of the output files
+* @return true if the block output and index were written
+*/
+bool analyze_block(BlockData& block, AnalysisContext& context, const BlockAnalysisOptions& options,
+                   const std::string& output_prefix) {
+   auto start_time = std::chrono::steady_clock::now();
+   plan_block_analysis(block, options);
+
+   std::vector<BlockTransaction*> split;
+   std::vector<BlockTransaction*> packed;
+   size_t skipped = 0;
+   for (auto& block_tx : block.transactions) {
+       if (block_tx.placement == "split") split.push_back(&block_tx);
+       else if (block_tx.placement == "packed") packed.push_back(&block_tx);
+       else if (block_tx.placement == "skipped") skipped++;
+   }
+   auto largest_first = [](const BlockTransaction* a, const BlockTransaction* b) {
+       return a->estimated_pairs > b->estimated_pairs;
+   };
+   std::stable_sort(split.begin(), split.end(), largest_first);
+   std::stable_sort(packed.begin(), packed.end(), largest_first);
+
+   std::string csv_filename = output_prefix + ".csv";
+   std::ofstream output_file(csv_filename);
+   if (!output_file.is_open()) {
+       std::cerr << "Error: Could not open output file " << csv_filename << std::endl;
+       return false;
+   }
+
+   std::cout << "Block " << block.height << " (" << block.hash << "): " << block.transactions.size()
+             << " transactions, " << split.size() << " split across " << context.threads() << " threads, "
+             << packed.size() << " packed, " << skipped << " skipped" << std::endl;
+
+   RunMetrics block_metrics;
+   block_metrics.threads = context.threads();
+   MetricsExporter::instance().attach(block_metrics, "block");
+
+   double total_pairs = 0.0;
+   for (const BlockTransaction* block_tx : split) total_pairs += block_tx->estimated_pairs;
+   for (const BlockTransaction* block_tx : packed) total_pairs += block_tx->estimated_pairs;
+   double done_pairs = 0.0;
+   std::mutex progress_mutex;
+
+   // Adds a finished transaction to the block metrics
+   auto record = [&](const BlockTransaction* block_tx, const RunMetrics& metrics, unsigned int first_worker) {
+       block_metrics.merge(metrics, first_worker);
+       std::lock_guard<std::mutex> lock(progress_mutex);
+       done_pairs += block_tx->estimated_pairs;
+       double progress = total_pairs > 0.0 ? done_pairs / total_pairs : 1.0;
+       double elapsed = elapsed_ns(block_metrics.start_time) / 1e9;
+       block_metrics.progress = progress;
+       block_metrics.eta_seconds = progress > 0.0 ? elapsed * (1.0 - progress) / progress : -1.0;
+   };
+
+   {
+       // The analyses report their progress on std::cout, which is useless for thousands of them
+       SilencedOutput silenced;
+
+       // Large transactions first, each using all workers; nothing else writes to the file meanwhile
+       for (BlockTransaction* block_tx : split) {
+           AnalysisOptions analysis_options;
+           analysis_options.engine = block_tx->engine;
+           analysis_options.memory_budget = options.memory_budget;
+           analysis_options.samples_per_k = options.samples_per_k;
+
+           block_tx->offset = static_cast<uint64_t>(output_file.tellp());
+           StreamMappingSink sink(output_file);
+           RunMetrics metrics;
+           block_tx->summary = context.analyze(block_tx->tx_data, analysis_options, sink, metrics);
+           block_tx->bytes = static_cast<uint64_t>(output_file.tellp()) - block_tx->offset;
+           record(block_tx, metrics, 0);
+       }
+
+       // Then the cheap ones, one per worker, largest first; each section is appended when complete
+       std::atomic<size_t> next_packed(0);
+       std::mutex file_mutex;
+       context.workers().run(context.threads(), [&](unsigned int lane) {
+           size_t i;
+           while ((i = next_packed++) < packed.size()) {
+               BlockTransaction* block_tx = packed[i];
+               AnalysisOptions analysis_options;
+               analysis_options.engine = block_tx->engine;
+               analysis_options.memory_budget = options.memory_budget;
+               analysis_options.samples_per_k = options.samples_per_k;
+               analysis_options.parallel = false;
+               analysis_options.control.export_metrics = false;
+
+               std::ostringstream rows;
+               StreamMappingSink sink(rows);
+               RunMetrics metrics;
+               block_tx->summary = context.analyze(block_tx->tx_data, analysis_options, sink, metrics);
+               record(block_tx, metrics, lane);
+
+               std::string section = rows.str();
+               std::lock_guard<std::mutex> lock(file_mutex);
+               block_tx->offset = static_cast<uint64_t>(output_file.tellp());
+               block_tx->bytes = section.size();
+               output_file << section;
+           }
+       });
+   }
+   MetricsExporter::instance().detach(block_metrics);
+
+   output_file.close();
+   if (!output_file) {
+       std::cerr << "Error: Could not write output file " << csv_filename << std::endl;
+       return false;
+   }
+
+   double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+   if (!write_block_index(block, options, csv_filename, output_prefix + ".index.json", seconds)) {
+       return false;
+   }
+
+   size_t valid_count = 0;
+   for (const auto& block_tx : block.transactions) {
+       valid_count += block_tx.summary.valid_count;
+   }
+   std::cout << "Block " << block.height << " analyzed in " << format_duration(seconds) << ": "
+             << valid_count << " valid mappings, results in " << csv_filename
+             << ", index in " << output_prefix << ".index.json" << std::endl;
+   return true;
+}
+
+#endif // BLOCK_ANALYZER_H
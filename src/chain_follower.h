@@ -0,0 +1,305 @@
+#ifndef CHAIN_FOLLOWER_H
+#define CHAIN_FOLLOWER_H
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <csignal>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+#include "analysis_context.h"
+#include "block_analyzer.h"
+#include "bitcoin_rpc.h"
+
+/**
+* The last block whose results are complete. An empty hash means that no block
+* has been analyzed yet and height + 1 is the first block to analyze.
+*/
+struct ChainCursor {
+   int64_t height = -1;
+   std::string hash;
+};
+
+/**
+* Keeps per-block analysis results of the active chain up to date.
+*
+* The follower polls the node for its tip and analyzes every block after the
+* cursor once, each fetched with a single getblock call (fetch_block), writing
+* DIR/block_HEIGHT.csv and DIR/block_HEIGHT.index.json. After each block the
+* cursor is replaced atomically in DIR/cursor.json, so a restarted follower
+* resumes with the next block; a block whose index was written before the cursor
+* is recognized by its hash and not analyzed again.
+*
+* Before going on, the follower checks that the cursor block is still on the
+* active chain. If it was disconnected by a reorg, its results are deleted and the
+* cursor steps back to its parent, until it reaches a block the node still has;
+* the blocks of the new branch are then analyzed like any new block.
+*/
+class ChainFollower {
+private:
+   std::string directory;
+   AnalysisContext& context;
+   BlockAnalysisOptions options;
+   double poll_seconds;
+   ChainCursor cursor;
+
+   static std::atomic<bool>& stop_flag() {
+       static std::atomic<bool> stopping{false};
+       return stopping;
+   }
+
+   static void handle_signal(int) {
+       stop_flag() = true;
+   }
+
+   std::string cursor_filename() const {
+       return directory + "/cursor.json";
+   }
+
+   std::string block_prefix(int64_t height) const {
+       return directory + "/block_" + std::to_string(height);
+   }
+
+   bool read_cursor() {
+       std::ifstream cursor_file(cursor_filename());
+       if (!cursor_file.is_open()) {
+           return false;
+       }
+       try {
+           nlohmann::json json_cursor = nlohmann::json::parse(cursor_file);
+           cursor.height = json_cursor.at("height").get<int64_t>();
+           cursor.hash = json_cursor.at("hash").get<std::string>();
+       } catch (const nlohmann::json::exception& e) {
+           std::cerr << "Error: Malformed cursor " << cursor_filename() << ": " << e.what() << std::endl;
+           return false;
+       }
+       return true;
+   }
+
+   // Replaces the cursor file only with a complete, synced copy
+   bool write_cursor() {
+       std::string temporary_filename = cursor_filename() + ".tmp";
+       std::string contents = nlohmann::json({{"height", cursor.height}, {"hash", cursor.hash}}).dump() + "\n";
+
+       FILE* cursor_file = std::fopen(temporary_filename.c_str(), "w");
+       if (!cursor_file) {
+           std::cerr << "Error: Could not open cursor file " << temporary_filename << std::endl;
+           return false;
+       }
+       bool written = std::fwrite(contents.data(), 1, contents.size(), cursor_file) == contents.size() &&
+                      std::fflush(cursor_file) == 0 && fsync(fileno(cursor_file)) == 0;
+       written = std::fclose(cursor_file) == 0 && written;
+       if (!written || std::rename(temporary_filename.c_str(), cursor_filename().c_str()) != 0) {
+           std::cerr << "Error: Could not write cursor file " << cursor_filename() << std::endl;
+           return false;
+       }
+       return true;
+   }
+
+   /**
+   * The hash of the block at a height of the active chain.
+   *
+   * @return The hash, empty if the node has no such block or did not answer
+   */
+   std::string active_block_hash(int64_t height) {
+       nlohmann::json response = BitcoinRpcClient::instance().call("getblockhash", nlohmann::json::array({height}));
+       if (!response.contains("result") || !response["result"].is_string()) {
+           return "";
+       }
+       return response["result"].get<std::string>();
+   }
+
+   // The hash recorded in the index of an analyzed block, empty if there is none
+   std::string indexed_block_hash(int64_t height, std::string* previous_hash = nullptr) {
+       std::ifstream index_file(block_prefix(height) + ".index.json");
+       if (!index_file.is_open()) {
+           return "";
+       }
+       try {
+           nlohmann::json index = nlohmann::json::parse(index_file);
+           if (previous_hash) {
+               *previous_hash = index.value("previous_hash", "");
+           }
+           return index.value("hash", "");
+       } catch (const nlohmann::json::exception&) {
+           return "";
+       }
+   }
+
+   /**
+   * Finds the parent of the cursor block: from its index file, or, if that is
+   * missing, from the node, which keeps the headers of disconnected blocks.
+   *
+   * @param previous_hash Receives the hash of the parent block
+   * @return false if neither knows it; the cursor must not move then, or the
+   *         parent check of the next block would be skipped
+   */
+   bool cursor_parent_hash(std::string& previous_hash) {
+       if (indexed_block_hash(cursor.height, &previous_hash) == cursor.hash && !previous_hash.empty()) {
+           return true;
+       }
+       if (cursor.height == 0) {
+           previous_hash.clear();
+           return true;
+       }
+
+       nlohmann::json response = BitcoinRpcClient::instance().call("getblockheader",
+                                                                    nlohmann::json::array({cursor.hash}));
+       if (!response.contains("result") || !response["result"].is_object() ||
+           !response["result"].contains("previousblockhash") || !response["result"]["previousblockhash"].is_string()) {
+           std::cerr << "Warning: Could not find the parent of block " << cursor.hash << std::endl;
+           return false;
+       }
+       previous_hash = response["result"]["previousblockhash"].get<std::string>();
+       return true;
+   }
+
+   /**
+   * Deletes the results of the cursor block, which is no longer on the active
+   * chain, and moves the cursor to its parent. The index goes first, so a crash
+   * in between never leaves an index describing a deleted block output.
+   *
+   * @param previous_hash Hash of the parent block (cursor_parent_hash)
+   */
+   bool disconnect_cursor_block(const std::string& previous_hash) {
+       std::cout << "Block " << cursor.height << " (" << cursor.hash << ") was disconnected, "
+                 << "deleting its results" << std::endl;
+       std::remove((block_prefix(cursor.height) + ".index.json").c_str());
+       std::remove((block_prefix(cursor.height) + ".csv").c_str());
+
+       cursor.height--;
+       cursor.hash = previous_hash;
+       return write_cursor();
+   }
+
+   /**
+   * Analyzes the block after the cursor, or adopts its results if they are
+   * already complete, and advances the cursor.
+   *
+   * @return false if the node is not reachable or the block changed in between
+   */
+   bool advance() {
+       int64_t height = cursor.height + 1;
+       std::string hash = active_block_hash(height);
+       if (hash.empty()) {
+           return false;
+       }
+
+       std::string previous_hash;
+       if (indexed_block_hash(height, &previous_hash) == hash) {
+           std::cout << "Block " << height << " was analyzed before, resuming after it" << std::endl;
+       } else {
+           BlockData block;
+           if (!fetch_block(hash, block)) {
+               return false;
+           }
+           previous_hash = block.previous_hash;
+           if (!analyze_block(block, context, options, block_prefix(height))) {
+               return false;
+           }
+       }
+
+       // The chain changed since the cursor check; the next check disconnects the cursor block
+       if (!cursor.hash.empty() && previous_hash != cursor.hash) {
+           std::cerr << "Warning: Block " << height << " does not extend block " << cursor.hash << std::endl;
+           return false;
+       }
+
+       cursor.height = height;
+       cursor.hash = hash;
+       return write_cursor();
+   }
+
+   // Sleeps for the poll interval, or less if the follower is stopped
+   void wait_for_next_poll() {
+       auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(poll_seconds);
+       while (!stop_flag() && std::chrono::steady_clock::now() < deadline) {
+           std::this_thread::sleep_for(std::chrono::milliseconds(100));
+       }
+   }
+
+public:
+   /**
+   * @param results_directory Directory of the cursor and the block results; must exist
+   * @param analysis_context Context shared by all block analyses
+   * @param block_options Engine and size limits of the block analyses
+   * @param interval_seconds Seconds between polls of the tip once the follower has caught up
+   */
+   ChainFollower(const std::string& results_directory, AnalysisContext& analysis_context,
+                 const BlockAnalysisOptions& block_options, double interval_seconds)
+       : directory(results_directory), context(analysis_context), options(block_options),
+         poll_seconds(interval_seconds) {}
+
+   /**
+   * Follows the chain until SIGINT or SIGTERM.
+   *
+   * @param start_height First block to analyze if there is no cursor yet, -1 for the current tip
+   * @return true if the follower stopped normally, false if it could not start
+   */
+   bool run(int64_t start_height) {
+       if (!read_cursor()) {
+           if (start_height < 0) {
+               nlohmann::json response = BitcoinRpcClient::instance().call("getblockcount", nlohmann::json::array());
+               if (!response.contains("result") || !response["result"].is_number_integer()) {
+                   std::cerr << "Error: Could not get the block count from the node" << std::endl;
+                   return false;
+               }
+               start_height = response["result"].get<int64_t>();
+           }
+           cursor.height = start_height - 1;
+           cursor.hash.clear();
+           if (!write_cursor()) {
+               return false;
+           }
+       }
+
+       stop_flag() = false;
+       std::signal(SIGINT, handle_signal);
+       std::signal(SIGTERM, handle_signal);
+       std::cout << "Following the chain after block " << cursor.height << ", results in " << directory << std::endl;
+
+       while (!stop_flag()) {
+           // Undo blocks the node no longer has on its active chain
+           if (!cursor.hash.empty()) {
+               std::string active_hash = active_block_hash(cursor.height);
+               bool disconnected = !active_hash.empty() && active_hash != cursor.hash;
+               if (active_hash.empty()) {
+                   // Only a chain shorter than the cursor disconnects it; a failed call is retried
+                   nlohmann::json response = BitcoinRpcClient::instance().call("getblockcount", nlohmann::json::array());
+                   if (!response.contains("result") || !response["result"].is_number_integer() ||
+                       response["result"].get<int64_t>() >= cursor.height) {
+                       wait_for_next_poll();
+                       continue;
+                   }
+                   disconnected = true;
+               }
+               if (disconnected) {
+                   // Without the parent the step is retried, as for a failed call
+                   std::string previous_hash;
+                   if (!cursor_parent_hash(previous_hash)) {
+                       wait_for_next_poll();
+                       continue;
+                   }
+                   if (!disconnect_cursor_block(previous_hash)) {
+                       return false;
+                   }
+                   continue;
+               }
+           }
+
+           if (!advance()) {
+               // Caught up with the tip, or the node did not answer
+               wait_for_next_poll();
+           }
+       }
+
+       std::cout << "Stopped following the chain after block " << cursor.height << std::endl;
+       return true;
+   }
+};
+
+#endif // CHAIN_FOLLOWER_H
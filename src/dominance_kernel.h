@@ -0,0 +1,259 @@
+#ifndef DOMINANCE_KERNEL_H
+#define DOMINANCE_KERNEL_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include "partition_chunk.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DOMINANCE_KERNEL_X86 1
+#endif
+
+/**
+* Signatures of all partitions with k groups of a chunk in structure-of-arrays
+* layout: lane j holds the j-th largest block sum of every partition, so one
+* vector load reads the same lane of several partitions.
+*
+*     lanes[j * stride + p]   j-th largest block sum of the p-th partition
+*     positions[p]            position of that partition in the chunk
+*
+* The stride is padded to a multiple of LANE_PADDING; padding holds +infinity,
+* which never passes the dominance test.
+*
+* The table doubles as a dominance index: partitions are sorted by their largest
+* block sum (lane 0), so only a prefix can pass against a given input signature,
+* and every bucket of BUCKET_SIZE partitions, one mask word, keeps the minimum and
+* maximum of each lane. A bucket whose minimum exceeds the input in some lane fails
+* as a whole; one whose maximum stays below the input in every lane passes as a whole.
+*/
+class SignatureTable {
+private:
+   size_t groups = 0;
+   size_t partitions = 0;
+   size_t lane_stride = 0;
+   std::vector<double> lanes;
+   std::vector<uint32_t> partition_positions;
+   std::vector<double> bucket_minimums;  // [j * buckets + b] minimum of lane j in bucket b
+   std::vector<double> bucket_maximums;
+
+public:
+   static constexpr size_t LANE_PADDING = 8;
+   static constexpr size_t BUCKET_SIZE = 64;
+
+   /**
+   * Collects the signatures of all partitions of the chunk with k groups. The
+   * chunk's blocks must have been added with their values.
+   *
+   * @param chunk The chunk of partitions
+   * @param k Number of groups
+   */
+   void build(const PartitionChunk& chunk, size_t k) {
+       groups = k;
+       partition_positions.clear();
+       for (size_t p = 0; p < chunk.size(); ++p) {
+           if (chunk.group_count(p) == k) {
+               partition_positions.push_back(static_cast<uint32_t>(p));
+           }
+       }
+       partitions = partition_positions.size();
+       lane_stride = (partitions + LANE_PADDING - 1) / LANE_PADDING * LANE_PADDING;
+       lanes.assign(k * lane_stride, std::numeric_limits<double>::infinity());
+
+       // Sort by largest block sum; stable, so equal partitions keep their chunk order
+       std::stable_sort(partition_positions.begin(), partition_positions.end(), [&chunk](uint32_t a, uint32_t b) {
+           return chunk[a].signature()[0] < chunk[b].signature()[0];
+       });
+
+       for (size_t p = 0; p < partitions; ++p) {
+           ValuesView signature = chunk[partition_positions[p]].signature();
+           for (size_t j = 0; j < k; ++j) {
+               lanes[j * lane_stride + p] = signature[j];
+           }
+       }
+
+       size_t buckets = bucket_count();
+       bucket_minimums.assign(k * buckets, std::numeric_limits<double>::infinity());
+       bucket_maximums.assign(k * buckets, -std::numeric_limits<double>::infinity());
+       for (size_t j = 0; j < k; ++j) {
+           for (size_t p = 0; p < partitions; ++p) {
+               double value = lanes[j * lane_stride + p];
+               size_t bucket = j * buckets + p / BUCKET_SIZE;
+               bucket_minimums[bucket] = std::min(bucket_minimums[bucket], value);
+               bucket_maximums[bucket] = std::max(bucket_maximums[bucket], value);
+           }
+       }
+   }
+
+   // Remove all signatures, keeping the capacity
+   void clear() {
+       partitions = 0;
+       lane_stride = 0;
+       partition_positions.clear();
+       lanes.clear();
+       bucket_minimums.clear();
+       bucket_maximums.clear();
+   }
+
+   size_t k() const { return groups; }
+   size_t size() const { return partitions; }
+   size_t stride() const { return lane_stride; }
+   const double* lane(size_t j) const { return lanes.data() + j * lane_stride; }
+   uint32_t position(size_t p) const { return partition_positions[p]; }
+   size_t bucket_count() const { return (partitions + BUCKET_SIZE - 1) / BUCKET_SIZE; }
+   double bucket_min(size_t j, size_t bucket) const { return bucket_minimums[j * bucket_count() + bucket]; }
+   double bucket_max(size_t j, size_t bucket) const { return bucket_maximums[j * bucket_count() + bucket]; }
+
+   // Number of leading partitions whose largest block sum does not exceed largest; no later one can pass
+   size_t candidate_count(double largest) const {
+       return static_cast<size_t>(std::upper_bound(lane(0), lane(0) + partitions, largest) - lane(0));
+   }
+};
+
+/**
+* Outcome of the bounds of one bucket of a SignatureTable against an input signature.
+*/
+enum class BucketBound {
+   NONE_PASS,  // Some lane's minimum exceeds the input
+   ALL_PASS,   // No lane's maximum exceeds the input
+   UNDECIDED   // The partitions have to be tested
+};
+
+inline BucketBound bucket_bound(const double* input_signature, const SignatureTable& table, size_t bucket) {
+   bool all_pass = true;
+   for (size_t j = 0; j < table.k(); ++j) {
+       if (table.bucket_min(j, bucket) > input_signature[j]) {
+           return BucketBound::NONE_PASS;
+       }
+       all_pass = all_pass && !(table.bucket_max(j, bucket) > input_signature[j]);
+   }
+   return all_pass ? BucketBound::ALL_PASS : BucketBound::UNDECIDED;
+}
+
+/**
+* Dominance test of one input signature against the signatures of a table in mask
+* words first_word..last_word-1: bit p of the mask is set if no lane of partition p
+* exceeds the same lane of the input, i.e. if the pair survives value-based
+* pruning. Lanes are compared as !(output > input), exactly like signatures_compatible.
+*/
+using DominanceKernel = void (*)(const double* input_signature, const SignatureTable& table,
+                                 size_t first_word, size_t last_word, uint64_t* mask);
+
+// Number of 64-bit mask words for a table
+inline size_t dominance_mask_words(const SignatureTable& table) {
+   return (table.size() + 63) / 64;
+}
+
+// Clears the bits of the padding partitions if the last mask word was computed
+inline void clear_padding_bits(const SignatureTable& table, size_t last_word, uint64_t* mask) {
+   size_t tail = table.size() % 64;
+   if (tail && last_word == dominance_mask_words(table)) {
+       mask[table.size() / 64] &= (1ULL << tail) - 1;
+   }
+}
+
+inline void dominance_mask_scalar(const double* input_signature, const SignatureTable& table,
+                                  size_t first_word, size_t last_word, uint64_t* mask) {
+   for (size_t word = first_word; word < last_word; ++word) {
+       size_t first = word * 64;
+       size_t count = std::min<size_t>(64, table.size() - first);
+       uint64_t bits = 0;
+       for (size_t p = 0; p < count; ++p) {
+           bool survives = true;
+           for (size_t j = 0; j < table.k() && survives; ++j) {
+               survives = !(table.lane(j)[first + p] > input_signature[j]);
+           }
+           bits |= static_cast<uint64_t>(survives) << p;
+       }
+       mask[word] = bits;
+   }
+}
+
+#ifdef DOMINANCE_KERNEL_X86
+
+__attribute__((target("avx2")))
+inline void dominance_mask_avx2(const double* input_signature, const SignatureTable& table,
+                                size_t first_word, size_t last_word, uint64_t* mask) {
+   for (size_t word = first_word; word < last_word; ++word) {
+       uint64_t bits = 0;
+       // The stride is padded, so groups of 4 never read past a lane
+       for (size_t offset = 0; offset < 64 && word * 64 + offset < table.size(); offset += 4) {
+           size_t p = word * 64 + offset;
+           __m256d survivors = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+           for (size_t j = 0; j < table.k(); ++j) {
+               __m256d outputs = _mm256_loadu_pd(table.lane(j) + p);
+               __m256d input = _mm256_set1_pd(input_signature[j]);
+               survivors = _mm256_and_pd(survivors, _mm256_cmp_pd(outputs, input, _CMP_NGT_UQ));
+               if (_mm256_movemask_pd(survivors) == 0) break;
+           }
+           bits |= static_cast<uint64_t>(_mm256_movemask_pd(survivors)) << offset;
+       }
+       mask[word] = bits;
+   }
+   clear_padding_bits(table, last_word, mask);
+}
+
+__attribute__((target("avx512f")))
+inline void dominance_mask_avx512(const double* input_signature, const SignatureTable& table,
+                                  size_t first_word, size_t last_word, uint64_t* mask) {
+   for (size_t word = first_word; word < last_word; ++word) {
+       uint64_t bits = 0;
+       for (size_t offset = 0; offset < 64 && word * 64 + offset < table.size(); offset += 8) {
+           size_t p = word * 64 + offset;
+           __mmask8 survivors = 0xFF;
+           for (size_t j = 0; j < table.k() && survivors; ++j) {
+               __m512d outputs = _mm512_loadu_pd(table.lane(j) + p);
+               __m512d input = _mm512_set1_pd(input_signature[j]);
+               survivors = _mm512_mask_cmp_pd_mask(survivors, outputs, input, _CMP_NGT_UQ);
+           }
+           bits |= static_cast<uint64_t>(survivors) << offset;
+       }
+       mask[word] = bits;
+   }
+   clear_padding_bits(table, last_word, mask);
+}
+
+#endif
+
+/**
+* Name of the best dominance kernel the CPU supports: "avx512", "avx2" or "scalar".
+*/
+inline std::string best_dominance_kernel_name() {
+#ifdef DOMINANCE_KERNEL_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f")) return "avx512";
+   if (__builtin_cpu_supports("avx2")) return "avx2";
+#endif
+   return "scalar";
+}
+
+/**
+* Looks up a dominance kernel by name.
+*
+* @param name "avx512", "avx2" or "scalar"
+* @return The kernel, or nullptr if it is unknown or not supported by the CPU
+*/
+inline DominanceKernel dominance_kernel_by_name(const std::string& name) {
+   if (name == "scalar") return dominance_mask_scalar;
+#ifdef DOMINANCE_KERNEL_X86
+   __builtin_cpu_init();
+   if (name == "avx2" && __builtin_cpu_supports("avx2")) return dominance_mask_avx2;
+   if (name == "avx512" && __builtin_cpu_supports("avx512f")) return dominance_mask_avx512;
+#endif
+   return nullptr;
+}
+
+/**
+* The dominance kernel used by the partition analysis, chosen once at the first
+* call from the instruction sets the CPU supports.
+*/
+inline DominanceKernel dominance_kernel() {
+   static const DominanceKernel kernel = dominance_kernel_by_name(best_dominance_kernel_name());
+   return kernel;
+}
+
+#endif // DOMINANCE_KERNEL_H
@@ -0,0 +1,384 @@
+#ifndef ENGINE_ORACLE_H
+#define ENGINE_ORACLE_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include "transaction_data.h"
+#include "subset_generator.h"
+#include "subset_analyzer.h"
+#include "partition_analyzer.h"
+#include "analysis_context.h"
+
+/**
+* Differential testing of analysis engines.
+*
+* Every engine has to produce exactly the same set of valid mappings as the
+* reference semantics of the partition analysis (process_partition_chunks with
+* check_all_permutations) and the subset analysis (the nested loop of
+* find_valid_combinations). The reference implementations below restate those
+* semantics in the plainest possible form, independent of the production code,
+* so they remain a fixed yardstick while the production path is optimized.
+*
+* Results are compared as canonical row sets: mapping and combination IDs and the
+* order of groups within a mapping are removed, everything else (element IDs,
+* values and differences as written to the CSV) must match exactly.
+*/
+
+enum class OracleAnalysis {
+   SUBSET,
+   PARTITION
+};
+
+/**
+* An engine under test.
+* run analyzes the transaction and returns its number of valid mappings; engines
+* that write results must write them to the given CSV file.
+*/
+struct OracleEngine {
+   std::string name;
+   OracleAnalysis analysis;
+   bool writes_results;
+   std::function<size_t(const TransactionData&, const std::string&)> run;
+};
+
+/**
+* Context shared by the context engines of the oracle, so that every transaction
+* after the first one runs with warm workers and a reused workspace.
+*/
+AnalysisContext& oracle_analysis_context() {
+   static AnalysisContext context;
+   return context;
+}
+
+/**
+* Runs one engine through the shared analysis context, writing to the given CSV file.
+*/
+size_t run_in_oracle_context(const TransactionData& tx_data, const AnalysisOptions& options,
+                             const std::string& results_filename) {
+   FileMappingSink sink(results_filename);
+   return oracle_analysis_context().analyze(tx_data, options, sink).valid_count;
+}
+
+size_t run_in_oracle_context(const TransactionData& tx_data, AnalysisEngine engine, const std::string& results_filename) {
+   AnalysisOptions options;
+   options.engine = engine;
+   return run_in_oracle_context(tx_data, options, results_filename);
+}
+
+/**
+* All engines known to the oracle. New engines register themselves here.
+*
+* The production paths each engine exercises:
+* - subset_combinations: find_valid_combinations with subset sum tables, writing a file.
+* - partition_enumerate, partition_count: process_partition_chunks with its own pool
+*   and workspace; oracle shapes are small, so partitions are decoded from the catalogs.
+* - context_subset, context_partition: the same through AnalysisContext, with a warm
+*   pool and workspace reused across transactions.
+* - context_partition_generator: the Gray-code PartitionGenerator path, which production
+*   takes for shapes the catalogs do not cover, in chunks sized from the default budget.
+* - context_partition_generator_chunked: the same with chunks of one partition, so that
+*   the generators resume across chunk boundaries and the output generator is recreated
+*   for every input chunk.
+* Engines without catalogs are the only coverage of the generator path.
+*/
+std::vector<OracleEngine> oracle_engines() {
+   return {
+       {"subset_combinations", OracleAnalysis::SUBSET, true,
+        [](const TransactionData& tx_data, const std::string& results_filename) {
+            return find_valid_combinations(tx_data, results_filename);
+        }},
+       {"partition_enumerate", OracleAnalysis::PARTITION, true,
+        [](const TransactionData& tx_data, const std::string& results_filename) {
+            return find_valid_partitions(tx_data, results_filename, true);
+        }},
+       {"partition_count", OracleAnalysis::PARTITION, false,
+        [](const TransactionData& tx_data, const std::string& results_filename) {
+            return find_valid_partitions(tx_data, results_filename, false);
+        }},
+       {"context_subset", OracleAnalysis::SUBSET, true,
+        [](const TransactionData& tx_data, const std::string& results_filename) {
+            return run_in_oracle_context(tx_data, AnalysisEngine::SUBSET_ENUMERATE, results_filename);
+        }},
+       {"context_partition", OracleAnalysis::PARTITION, true,
+        [](const TransactionData& tx_data, const std::string& results_filename) {
+            return run_in_oracle_context(tx_data, AnalysisEngine::PARTITION_ENUMERATE, results_filename);
+        }},
+       {"context_partition_generator", OracleAnalysis::PARTITION, true,
+        [](const TransactionData& tx_data, const std::string& results_filename) {
+            AnalysisOptions options;
+            options.use_catalogs = false;
+            return run_in_oracle_context(tx_data, options, results_filename);
+        }},
+       {"context_partition_generator_chunked", OracleAnalysis::PARTITION, true,
+        [](const TransactionData& tx_data, const std::string& results_filename) {
+            // A budget below what the process uses leaves chunks of a single partition
+            AnalysisOptions options;
+            options.use_catalogs = false;
+            options.memory_budget = 1;
+            return run_in_oracle_context(tx_data, options, results_filename);
+        }},
+   };
+}
+
+/**
+* Splits a CSV line at commas outside of double quotes. Quotes are kept.
+*/
+std::vector<std::string> split_csv_line(const std::string& line) {
+   std::vector<std::string> fields(1);
+   bool quoted = false;
+   for (char c : line) {
+       if (c == '"') {
+           quoted = !quoted;
+       } else if (c == ',' && !quoted) {
+           fields.emplace_back();
+           continue;
+       }
+       fields.back() += c;
+   }
+   return fields;
+}
+
+// Joins sorted group rows to the canonical form of one mapping
+std::string canonical_mapping(std::vector<std::string> group_rows) {
+   std::sort(group_rows.begin(), group_rows.end());
+   std::string mapping;
+   for (const auto& row : group_rows) {
+       mapping += row + ";";
+   }
+   return mapping;
+}
+
+// Canonical form of one group or subset row: input IDs, input value, output IDs, output value, difference
+std::string canonical_row(const std::string& input_ids, double input_value,
+                          const std::string& output_ids, double output_value) {
+   std::stringstream row;
+   row << "\"" << input_ids << "\"|" << input_value << "|\"" << output_ids << "\"|"
+       << output_value << "|" << (input_value - output_value);
+   return row.str();
+}
+
+/**
+* Reads a partition results CSV and returns its mappings in canonical form, sorted.
+*
+* @param filename Results file written by a partition engine
+* @return Sorted canonical mappings; duplicates are kept so they are detected
+*/
+std::vector<std::string> canonicalize_partition_csv(const std::string& filename) {
+   std::ifstream file(filename);
+   std::string line;
+   std::vector<std::string> mappings;
+   std::vector<std::string> group_rows;
+   std::string current_id;
+
+   // Skip the two header lines
+   std::getline(file, line);
+   std::getline(file, line);
+
+   while (std::getline(file, line)) {
+       auto fields = split_csv_line(line);
+       if (fields.size() == 5) {
+           // Mapping header with totals, derived from the group rows
+           if (!group_rows.empty()) {
+               mappings.push_back(canonical_mapping(group_rows));
+               group_rows.clear();
+           }
+           current_id = fields[0];
+       } else if (fields.size() == 7 && fields[0] == current_id) {
+           group_rows.push_back(fields[2] + "|" + fields[3] + "|" + fields[4] + "|" + fields[5] + "|" + fields[6]);
+       } else {
+           group_rows.push_back("malformed:" + line);
+       }
+   }
+   if (!group_rows.empty()) {
+       mappings.push_back(canonical_mapping(group_rows));
+   }
+
+   std::sort(mappings.begin(), mappings.end());
+   return mappings;
+}
+
+/**
+* Reads a subset results CSV and returns its combinations in canonical form, sorted.
+*/
+std::vector<std::string> canonicalize_subset_csv(const std::string& filename) {
+   std::ifstream file(filename);
+   std::string line;
+   std::vector<std::string> combinations;
+
+   std::getline(file, line);  // Header
+   while (std::getline(file, line)) {
+       auto fields = split_csv_line(line);
+       if (fields.size() == 6) {
+           combinations.push_back(fields[1] + "|" + fields[2] + "|" + fields[3] + "|" + fields[4] + "|" + fields[5]);
+       } else {
+           combinations.push_back("malformed:" + line);
+       }
+   }
+
+   std::sort(combinations.begin(), combinations.end());
+   return combinations;
+}
+
+// Joins IDs with commas as in the results CSV
+std::string join_ids(const std::vector<std::string>& ids) {
+   std::string joined;
+   for (size_t i = 0; i < ids.size(); ++i) {
+       joined += (i ? "," : "") + ids[i];
+   }
+   return joined;
+}
+
+// All set partitions of ids; blocks ordered by first element, elements in ID order
+void reference_partitions(const std::vector<std::string>& ids, size_t next,
+                          std::vector<std::vector<std::string>>& blocks,
+                          std::vector<std::vector<std::vector<std::string>>>& result) {
+   if (next == ids.size()) {
+       result.push_back(blocks);
+       return;
+   }
+   for (size_t b = 0; b <= blocks.size(); ++b) {
+       if (b == blocks.size()) {
+           blocks.push_back({});
+       }
+       blocks[b].push_back(ids[next]);
+       reference_partitions(ids, next + 1, blocks, result);
+       blocks[b].pop_back();
+       if (blocks[b].empty()) {
+           blocks.pop_back();
+       }
+   }
+}
+
+/**
+* Reference partition analysis: every pair of input and output partitions with the
+* same number of groups, every assignment of output groups to input groups, valid if
+* no output group exceeds the input group it is assigned to.
+*
+* @param tx_data The transaction data
+* @return Sorted canonical mappings
+*/
+std::vector<std::string> reference_partition_mappings(const TransactionData& tx_data) {
+   std::vector<std::vector<std::vector<std::string>>> input_partitions, output_partitions;
+   std::vector<std::vector<std::string>> blocks;
+   if (!tx_data.get_input_ids().empty()) {
+       reference_partitions(tx_data.get_input_ids(), 0, blocks, input_partitions);
+   }
+   if (!tx_data.get_output_ids().empty()) {
+       reference_partitions(tx_data.get_output_ids(), 0, blocks, output_partitions);
+   }
+
+   std::vector<std::string> mappings;
+   for (const auto& input_partition : input_partitions) {
+       for (const auto& output_partition : output_partitions) {
+           if (input_partition.size() != output_partition.size()) continue;
+
+           std::vector<size_t> order(output_partition.size());
+           std::iota(order.begin(), order.end(), 0);
+           do {
+               std::vector<std::string> group_rows;
+               bool valid = true;
+               for (size_t i = 0; i < order.size() && valid; ++i) {
+                   double input_value = calculate_subset_value(tx_data, input_partition[i], SubsetType::INPUTS);
+                   double output_value = calculate_subset_value(tx_data, output_partition[order[i]], SubsetType::OUTPUTS);
+                   valid = output_value <= input_value;
+                   group_rows.push_back(canonical_row(join_ids(input_partition[i]), input_value,
+                                                      join_ids(output_partition[order[i]]), output_value));
+               }
+               if (valid) {
+                   mappings.push_back(canonical_mapping(group_rows));
+               }
+           } while (std::next_permutation(order.begin(), order.end()));
+       }
+   }
+
+   std::sort(mappings.begin(), mappings.end());
+   return mappings;
+}
+
+/**
+* Reference subset analysis: every pair of non-empty input and output subsets whose
+* output value does not exceed the input value.
+*
+* @param tx_data The transaction data
+* @return Sorted canonical combinations
+*/
+std::vector<std::string> reference_subset_combinations(const TransactionData& tx_data) {
+   const auto& input_ids = tx_data.get_input_ids();
+   const auto& output_ids = tx_data.get_output_ids();
+
+   auto subset_of = [](const std::vector<std::string>& ids, size_t mask) {
+       std::vector<std::string> subset;
+       for (size_t j = 0; j < ids.size(); ++j) {
+           if (mask & (1ULL << j)) subset.push_back(ids[j]);
+       }
+       return subset;
+   };
+
+   std::vector<std::string> combinations;
+   for (size_t input_mask = 1; input_mask < (1ULL << input_ids.size()); ++input_mask) {
+       auto input_subset = subset_of(input_ids, input_mask);
+       double input_value = calculate_subset_value(tx_data, input_subset, SubsetType::INPUTS);
+       for (size_t output_mask = 1; output_mask < (1ULL << output_ids.size()); ++output_mask) {
+           auto output_subset = subset_of(output_ids, output_mask);
+           double output_value = calculate_subset_value(tx_data, output_subset, SubsetType::OUTPUTS);
+           if (output_value <= input_value) {
+               combinations.push_back(canonical_row(join_ids(input_subset), input_value,
+                                                    join_ids(output_subset), output_value));
+           }
+       }
+   }
+
+   std::sort(combinations.begin(), combinations.end());
+   return combinations;
+}
+
+/**
+* Outcome of comparing one engine with the reference on one transaction.
+*/
+struct OracleComparison {
+   size_t reference_count = 0;
+   size_t engine_count = 0;
+   bool counts_match = true;
+   bool sets_match = true;
+   std::vector<std::string> missing;    // In the reference but not produced by the engine (up to 3)
+   std::vector<std::string> unexpected; // Produced by the engine but not in the reference (up to 3)
+
+   bool passed() const {
+       return counts_match && sets_match;
+   }
+};
+
+/**
+* Compares the canonical results of an engine with the reference.
+*/
+OracleComparison compare_results(const std::vector<std::string>& reference, size_t engine_count,
+                                 const std::vector<std::string>* engine_results) {
+   OracleComparison comparison;
+   comparison.reference_count = reference.size();
+   comparison.engine_count = engine_count;
+   comparison.counts_match = engine_count == reference.size();
+
+   if (engine_results) {
+       comparison.sets_match = *engine_results == reference;
+       if (!comparison.sets_match) {
+           std::vector<std::string> difference;
+           std::set_difference(reference.begin(), reference.end(), engine_results->begin(), engine_results->end(),
+                               std::back_inserter(difference));
+           comparison.missing.assign(difference.begin(), difference.begin() + std::min<size_t>(3, difference.size()));
+           difference.clear();
+           std::set_difference(engine_results->begin(), engine_results->end(), reference.begin(), reference.end(),
+                               std::back_inserter(difference));
+           comparison.unexpected.assign(difference.begin(), difference.begin() + std::min<size_t>(3, difference.size()));
+       }
+   }
+
+   return comparison;
+}
+
+#endif // ENGINE_ORACLE_H
@@ -0,0 +1,237 @@
+#ifndef FIXED_BLOCK_KERNELS_H
+#define FIXED_BLOCK_KERNELS_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+/**
+* Kernels specialized at compile time for partitions with few blocks. Almost all
+* partition pairs have at most MAX_FIXED_BLOCKS groups; for those, the block count
+* is a template parameter, so sorting is a fixed sorting network, permutations come
+* from a constexpr table and all scratch arrays are fixed-size arrays on the stack.
+* Larger block counts keep the generic std::sort / std::next_permutation path.
+*/
+constexpr size_t MAX_FIXED_BLOCKS = 8;
+
+/**
+* Comparators (i, j) of a sorting network for K values, with i < j. Applying them
+* in order with a compare-exchange sorts any K values. The networks for up to 8
+* values are the known optimal ones (fewest comparators).
+*/
+template <size_t K>
+struct SortingNetwork;
+
+template <>
+struct SortingNetwork<1> {
+   static constexpr std::array<std::pair<uint8_t, uint8_t>, 0> comparators{};
+};
+
+template <>
+struct SortingNetwork<2> {
+   static constexpr std::array<std::pair<uint8_t, uint8_t>, 1> comparators{{{0, 1}}};
+};
+
+template <>
+struct SortingNetwork<3> {
+   static constexpr std::array<std::pair<uint8_t, uint8_t>, 3> comparators{{{0, 2}, {0, 1}, {1, 2}}};
+};
+
+template <>
+struct SortingNetwork<4> {
+   static constexpr std::array<std::pair<uint8_t, uint8_t>, 5> comparators{{
+       {0, 1}, {2, 3}, {0, 2}, {1, 3}, {1, 2}
+   }};
+};
+
+template <>
+struct SortingNetwork<5> {
+   static constexpr std::array<std::pair<uint8_t, uint8_t>, 9> comparators{{
+       {0, 1}, {3, 4}, {2, 4}, {2, 3}, {1, 4}, {0, 3}, {0, 2}, {1, 3}, {1, 2}
+   }};
+};
+
+template <>
+struct SortingNetwork<6> {
+   static constexpr std::array<std::pair<uint8_t, uint8_t>, 12> comparators{{
+       {1, 2}, {4, 5}, {0, 2}, {3, 5}, {0, 1}, {3, 4}, {2, 5}, {0, 3}, {1, 4}, {2, 4}, {1, 3}, {2, 3}
+   }};
+};
+
+template <>
+struct SortingNetwork<7> {
+   static constexpr std::array<std::pair<uint8_t, uint8_t>, 16> comparators{{
+       {1, 2}, {3, 4}, {5, 6}, {0, 2}, {3, 5}, {4, 6}, {0, 1}, {4, 5},
+       {2, 6}, {0, 4}, {1, 5}, {0, 3}, {2, 5}, {1, 3}, {2, 4}, {2, 3}
+   }};
+};
+
+template <>
+struct SortingNetwork<8> {
+   static constexpr std::array<std::pair<uint8_t, uint8_t>, 19> comparators{{
+       {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}, {0, 1}, {2, 3},
+       {4, 5}, {6, 7}, {2, 4}, {3, 5}, {1, 4}, {3, 6}, {1, 2}, {3, 4}, {5, 6}
+   }};
+};
+
+// Compare-exchange that leaves the larger value first; branch-free max/min
+inline void compare_exchange_descending(double& a, double& b) {
+   double larger = a < b ? b : a;
+   double smaller = a < b ? a : b;
+   a = larger;
+   b = smaller;
+}
+
+template <size_t K, size_t... C>
+inline void sort_descending_fixed(double* values, std::index_sequence<C...>) {
+   constexpr auto& comparators = SortingNetwork<K>::comparators;
+   (compare_exchange_descending(values[comparators[C].first], values[comparators[C].second]), ...);
+}
+
+/**
+* Sorts K values in descending order with a fully unrolled sorting network.
+*/
+template <size_t K>
+inline void sort_descending_fixed(double* values) {
+   sort_descending_fixed<K>(values, std::make_index_sequence<SortingNetwork<K>::comparators.size()>{});
+}
+
+/**
+* Sorts a range of values in descending order: with a sorting network for up to
+* MAX_FIXED_BLOCKS values, with std::sort otherwise.
+*/
+inline void sort_descending(double* first, double* last) {
+   switch (last - first) {
+       case 0:
+       case 1: return;
+       case 2: sort_descending_fixed<2>(first); return;
+       case 3: sort_descending_fixed<3>(first); return;
+       case 4: sort_descending_fixed<4>(first); return;
+       case 5: sort_descending_fixed<5>(first); return;
+       case 6: sort_descending_fixed<6>(first); return;
+       case 7: sort_descending_fixed<7>(first); return;
+       case 8: sort_descending_fixed<8>(first); return;
+       default: std::sort(first, last, std::greater<double>());
+   }
+}
+
+constexpr size_t fixed_factorial(size_t k) {
+   return k <= 1 ? 1 : k * fixed_factorial(k - 1);
+}
+
+/**
+* All permutations of 0..K-1 in lexicographic order, the order std::next_permutation
+* visits them in, computed at compile time. Permutations sharing a prefix of length
+* l are contiguous and aligned to blocks of (K-l)! rows.
+*/
+template <size_t K>
+struct PermutationTable {
+   static constexpr size_t COUNT = fixed_factorial(K);
+   using Row = std::array<uint8_t, K>;
+
+   static constexpr std::array<Row, COUNT> make_rows() {
+       std::array<Row, COUNT> rows{};
+       Row row{};
+       for (size_t i = 0; i < K; ++i) {
+           row[i] = static_cast<uint8_t>(i);
+       }
+
+       for (size_t p = 0; p < COUNT; ++p) {
+           rows[p] = row;
+
+           // Next lexicographic permutation (constexpr std::next_permutation needs C++20)
+           size_t i = K - 1;
+           while (i > 0 && row[i - 1] >= row[i]) --i;
+           if (i == 0) break;
+           size_t j = K - 1;
+           while (row[j] <= row[i - 1]) --j;
+           uint8_t swapped = row[i - 1];
+           row[i - 1] = row[j];
+           row[j] = swapped;
+           for (size_t a = i, b = K - 1; a < b; ++a, --b) {
+               swapped = row[a];
+               row[a] = row[b];
+               row[b] = swapped;
+           }
+       }
+       return rows;
+   }
+
+   static constexpr std::array<Row, COUNT> rows = make_rows();
+};
+
+/**
+* Visits every assignment of output groups to input groups under which no output
+* group exceeds its input group, in std::next_permutation order, for a pair with K
+* groups. Row p of the permutation table assigns output group row[i] to input group i.
+*
+* When output row[i] exceeds input i, every permutation with the same prefix fails
+* as well; they are contiguous in the table, so the whole block is skipped.
+*
+* @param input_values Value of each input group
+* @param output_values Value of each output group
+* @param on_valid Called with the row of every valid assignment
+* @return Number of permutations decided, always K!
+*/
+template <size_t K, typename Values, typename OnValid>
+size_t for_each_valid_permutation(const Values& input_values, const Values& output_values, OnValid&& on_valid) {
+   using Table = PermutationTable<K>;
+
+   std::array<double, K> inputs;
+   std::array<double, K> outputs;
+   for (size_t i = 0; i < K; ++i) {
+       inputs[i] = input_values[i];
+       outputs[i] = output_values[i];
+   }
+
+   size_t p = 0;
+   while (p < Table::COUNT) {
+       const auto& row = Table::rows[p];
+       size_t failed = K;
+       for (size_t i = 0; i < K; ++i) {
+           if (outputs[row[i]] > inputs[i]) {
+               failed = i;
+               break;
+           }
+       }
+
+       if (failed == K) {
+           on_valid(row);
+           ++p;
+       } else {
+           size_t block = fixed_factorial(K - 1 - failed);
+           p = (p / block + 1) * block;
+       }
+   }
+
+   return Table::COUNT;
+}
+
+/**
+* Calls visit with std::integral_constant<size_t, k>, so that a kernel specialized for
+* k groups is chosen once per pair instead of branching on k inside it.
+*
+* @param k Number of groups
+* @param visit Generic callable taking the integral constant
+* @return true if k is between 1 and MAX_FIXED_BLOCKS and visit was called
+*/
+template <typename Visitor>
+bool with_fixed_block_count(size_t k, Visitor&& visit) {
+   switch (k) {
+       case 1: visit(std::integral_constant<size_t, 1>{}); return true;
+       case 2: visit(std::integral_constant<size_t, 2>{}); return true;
+       case 3: visit(std::integral_constant<size_t, 3>{}); return true;
+       case 4: visit(std::integral_constant<size_t, 4>{}); return true;
+       case 5: visit(std::integral_constant<size_t, 5>{}); return true;
+       case 6: visit(std::integral_constant<size_t, 6>{}); return true;
+       case 7: visit(std::integral_constant<size_t, 7>{}); return true;
+       case 8: visit(std::integral_constant<size_t, 8>{}); return true;
+       default: return false;
+   }
+}
+
+#endif // FIXED_BLOCK_KERNELS_H
@@ -0,0 +1,364 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include "transaction_data.h"
+#include "bell_number.h"
+#include "analysis_planner.h"
+#include "memory_budget.h"
+
+/**
+* Cost classes of analysis jobs, from cheap to expensive.
+*/
+enum class JobClass {
+   SMALL,
+   MEDIUM,
+   LARGE
+};
+
+constexpr size_t JOB_CLASS_COUNT = 3;
+
+std::string job_class_name(JobClass job_class) {
+   switch (job_class) {
+       case JobClass::SMALL:  return "small";
+       case JobClass::MEDIUM: return "medium";
+       case JobClass::LARGE:  return "large";
+   }
+   return "unknown";
+}
+
+/**
+* Estimates the work of a job as the number of pairs it examines: the compatible
+* partition pairs sum_k S(n,k) * S(m,k) for the partition engines, the subset
+* pairs (2^n - 1)(2^m - 1) for the subset engine, the sampled pairs for the
+* estimate. Computed from the shared Bell/Stirling tables, no enumeration.
+*
+* @param tx_data The transaction data
+* @param engine The engine that runs the job
+* @param samples_per_k Sampled pairs per group count of SAMPLED_ESTIMATE
+* @return The estimated number of pairs
+*/
+double estimate_job_pairs(const TransactionData& tx_data, AnalysisEngine engine, size_t samples_per_k) {
+   size_t n = tx_data.get_input_ids().size();
+   size_t m = tx_data.get_output_ids().size();
+
+   switch (engine) {
+       case AnalysisEngine::SUBSET_ENUMERATE:
+           return (std::ldexp(1.0, static_cast<int>(n)) - 1.0) * (std::ldexp(1.0, static_cast<int>(m)) - 1.0);
+       case AnalysisEngine::SAMPLED_ESTIMATE:
+           return static_cast<double>(samples_per_k) * static_cast<double>(std::min(n, m));
+       case AnalysisEngine::PARTITION_ENUMERATE:
+       case AnalysisEngine::PARTITION_COUNT:
+           break;
+   }
+
+   count_t pairs = 0;
+   for (size_t k = 1; k <= std::min(n, m); ++k) {
+       pairs = saturating_add(pairs, saturating_mul(stirling_number(n, k), stirling_number(m, k)));
+   }
+   return count_to_double(pairs);
+}
+
+/**
+* Limits of the scheduler. Jobs up to small_pairs are SMALL, up to medium_pairs
+* MEDIUM, larger ones LARGE.
+*/
+struct SchedulerLimits {
+   double small_pairs = 1e6;        // About 8 inputs and 8 outputs
+   double medium_pairs = 1e9;       // About 10 inputs and 10 outputs
+   std::array<unsigned, JOB_CLASS_COUNT> concurrent_jobs = {16, 2, 1};
+   double slice_seconds = 2.0;      // Time an expensive job runs before it yields to waiting jobs
+   size_t memory_budget = 0;        // Shared by all running jobs, 0 for default_memory_budget()
+};
+
+/**
+* Parses class limits given as "SMALL,MEDIUM,LARGE", e.g. "16,2,1".
+*
+* @param text The limits
+* @param limits Receives the limits
+* @return true if three positive numbers were given
+*/
+bool parse_job_class_limits(const std::string& text, SchedulerLimits& limits) {
+   std::array<unsigned, JOB_CLASS_COUNT> parsed;
+   size_t start = 0;
+   for (size_t c = 0; c < JOB_CLASS_COUNT; ++c) {
+       size_t end = c + 1 < JOB_CLASS_COUNT ? text.find(',', start) : text.size();
+       if (end == std::string::npos || end == start) {
+           return false;
+       }
+       std::string field = text.substr(start, end - start);
+       if (field.find_first_not_of("0123456789") != std::string::npos) {
+           return false;
+       }
+       parsed[c] = static_cast<unsigned>(std::stoul(field));
+       if (parsed[c] == 0) {
+           return false;
+       }
+       start = end + 1;
+   }
+   limits.concurrent_jobs = parsed;
+   return true;
+}
+
+/**
+* Admits analysis jobs by cost class so that cheap jobs are not stuck behind
+* expensive ones.
+*
+* - Every class has its own concurrency limit; a job waits for a slot of its
+*   class, first come first served within the class.
+* - Cheap jobs run with priority: their pair checks are taken from the worker
+*   queue first (job_priority), and a running expensive job pauses at its next
+*   chunk boundary while cheaper jobs are running or waiting, for at most one
+*   time slice per boundary so it still makes progress.
+* - Expensive jobs are time-sliced cooperatively: when a MEDIUM or LARGE job has
+*   run for a slice and another job of its class waits, it gives up its slot at
+*   the next chunk boundary and queues again behind that job.
+* - A job that pauses or gives up its slot first frees the scratch memory of its
+*   analysis (AnalysisControl), so waiting jobs keep little more than their
+*   current input chunk and the budget of a class is not held by every job that
+*   was ever admitted to it.
+*
+* Latencies (admission to completion) of the last jobs of every class are kept
+* for the percentiles reported by stats().
+*/
+class JobScheduler {
+public:
+   /**
+   * The slot of one admitted job, released when it goes out of scope.
+   */
+   class Slot {
+   private:
+       JobScheduler* scheduler;
+       JobClass job_class;
+       uint64_t ticket;
+       std::chrono::steady_clock::time_point submitted;
+       std::chrono::steady_clock::time_point slice_start;
+
+       friend class JobScheduler;
+
+       Slot(JobScheduler* owner, JobClass c, uint64_t t, std::chrono::steady_clock::time_point submit_time)
+           : scheduler(owner), job_class(c), ticket(t), submitted(submit_time),
+             slice_start(std::chrono::steady_clock::now()) {}
+
+   public:
+       Slot(const Slot&) = delete;
+       Slot& operator=(const Slot&) = delete;
+
+       ~Slot() {
+           scheduler->release(*this);
+       }
+
+       JobClass get_class() const { return job_class; }
+
+       // Priority of the job's tasks in the WorkerPool, cheaper classes higher
+       unsigned priority() const {
+           return static_cast<unsigned>(JOB_CLASS_COUNT - 1 - static_cast<size_t>(job_class));
+       }
+
+       // Call between chunks; may block while cheaper or waiting jobs run, after calling release_memory
+       void checkpoint(const std::function<void()>& release_memory = {}) {
+           scheduler->checkpoint(*this, release_memory);
+       }
+   };
+
+   struct ClassStats {
+       unsigned running = 0;
+       size_t waiting = 0;
+       uint64_t completed = 0;
+       uint64_t yields = 0;        // Slots given up to jobs of the same class
+       uint64_t pauses = 0;        // Checkpoints that waited for cheaper jobs
+       double p50_seconds = 0.0;
+       double p99_seconds = 0.0;
+   };
+
+private:
+   static constexpr size_t LATENCY_WINDOW = 1024;
+
+   struct ClassState {
+       unsigned running = 0;
+       std::deque<uint64_t> waiting;           // Tickets in arrival order
+       uint64_t completed = 0;
+       uint64_t yields = 0;
+       uint64_t pauses = 0;
+       std::vector<double> latencies;          // Ring buffer of the last LATENCY_WINDOW jobs
+       size_t next_latency = 0;
+   };
+
+   SchedulerLimits limits;
+   std::mutex mutex;
+   std::condition_variable changed;
+   std::array<ClassState, JOB_CLASS_COUNT> classes;
+   uint64_t next_ticket = 0;
+   bool stopping = false;
+
+   static size_t index(JobClass job_class) {
+       return static_cast<size_t>(job_class);
+   }
+
+   // Jobs of cheaper classes than job_class that run or wait; the caller holds the mutex
+   bool cheaper_jobs_active(JobClass job_class) const {
+       for (size_t c = 0; c < index(job_class); ++c) {
+           if (classes[c].running > 0 || !classes[c].waiting.empty()) {
+               return true;
+           }
+       }
+       return false;
+   }
+
+   // Waits until ticket is first in line for a slot of its class and takes the slot; once the
+   // scheduler stops the slot is taken at once, so that the job can see it is cancelled
+   void wait_for_slot(std::unique_lock<std::mutex>& lock, size_t c, uint64_t ticket) {
+       ClassState& state = classes[c];
+       state.waiting.push_back(ticket);
+       changed.wait(lock, [&]() {
+           return stopping || (state.waiting.front() == ticket && state.running < limits.concurrent_jobs[c]);
+       });
+       state.waiting.erase(std::find(state.waiting.begin(), state.waiting.end(), ticket));
+       state.running++;
+       changed.notify_all();
+   }
+
+   void checkpoint(Slot& slot, const std::function<void()>& release_memory) {
+       if (slot.job_class == JobClass::SMALL) {
+           return;
+       }
+
+       size_t c = index(slot.job_class);
+       std::chrono::duration<double> slice(limits.slice_seconds);
+       std::unique_lock<std::mutex> lock(mutex);
+
+       // Frees the job's scratch memory once, outside the lock, before it blocks
+       bool released = false;
+       auto free_scratch = [&]() {
+           if (released || !release_memory) return;
+           released = true;
+           lock.unlock();
+           release_memory();
+           lock.lock();
+       };
+
+       // Cheaper jobs first, but run at least one chunk per slice
+       if (cheaper_jobs_active(slot.job_class)) {
+           free_scratch();
+           classes[c].pauses++;
+           changed.wait_for(lock, slice, [&]() { return stopping || !cheaper_jobs_active(slot.job_class); });
+       }
+
+       // Round robin within the class once the slice is used up
+       auto now = std::chrono::steady_clock::now();
+       if (now - slot.slice_start >= slice && !classes[c].waiting.empty()) {
+           free_scratch();
+           classes[c].yields++;
+           classes[c].running--;
+           changed.notify_all();
+           wait_for_slot(lock, c, slot.ticket);
+           now = std::chrono::steady_clock::now();
+       }
+       if (now - slot.slice_start >= slice) {
+           slot.slice_start = now;
+       }
+   }
+
+   void release(Slot& slot) {
+       double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - slot.submitted).count();
+
+       std::lock_guard<std::mutex> lock(mutex);
+       ClassState& state = classes[index(slot.job_class)];
+       state.running--;
+       state.completed++;
+       if (state.latencies.size() < LATENCY_WINDOW) {
+           state.latencies.push_back(latency);
+       } else {
+           state.latencies[state.next_latency] = latency;
+       }
+       state.next_latency = (state.next_latency + 1) % LATENCY_WINDOW;
+       changed.notify_all();
+   }
+
+public:
+   explicit JobScheduler(const SchedulerLimits& scheduler_limits = SchedulerLimits()) : limits(scheduler_limits) {}
+
+   JobScheduler(const JobScheduler&) = delete;
+   JobScheduler& operator=(const JobScheduler&) = delete;
+
+   const SchedulerLimits& get_limits() const {
+       return limits;
+   }
+
+   /**
+   * Memory budget of one job: the total budget divided by the slots of all classes,
+   * so that every job that can run at the same time fits in it together.
+   */
+   size_t job_memory_budget() const {
+       size_t total = limits.memory_budget ? limits.memory_budget : default_memory_budget();
+       size_t slots = 0;
+       for (unsigned concurrent : limits.concurrent_jobs) {
+           slots += concurrent;
+       }
+       return total / std::max<size_t>(slots, 1);
+   }
+
+   JobClass classify(double estimated_pairs) const {
+       if (estimated_pairs <= limits.small_pairs) return JobClass::SMALL;
+       if (estimated_pairs <= limits.medium_pairs) return JobClass::MEDIUM;
+       return JobClass::LARGE;
+   }
+
+   /**
+   * Waits for a slot of the job's class.
+   *
+   * @param job_class The cost class of the job
+   * @return The slot, held until it is destroyed
+   */
+   std::unique_ptr<Slot> admit(JobClass job_class) {
+       auto submitted = std::chrono::steady_clock::now();
+       std::unique_lock<std::mutex> lock(mutex);
+       uint64_t ticket = next_ticket++;
+       wait_for_slot(lock, index(job_class), ticket);
+       return std::unique_ptr<Slot>(new Slot(this, job_class, ticket, submitted));
+   }
+
+   /**
+   * Wakes every waiting job and admits later ones at once, without limits; used on
+   * shutdown together with the jobs' cancel flag, so they finish at their next chunk.
+   */
+   void stop() {
+       std::lock_guard<std::mutex> lock(mutex);
+       stopping = true;
+       changed.notify_all();
+   }
+
+   /**
+   * Current state of one class, with latency percentiles over its last jobs.
+   */
+   ClassStats stats(JobClass job_class) {
+       std::lock_guard<std::mutex> lock(mutex);
+       const ClassState& state = classes[index(job_class)];
+
+       ClassStats stats;
+       stats.running = state.running;
+       stats.waiting = state.waiting.size();
+       stats.completed = state.completed;
+       stats.yields = state.yields;
+       stats.pauses = state.pauses;
+
+       if (!state.latencies.empty()) {
+           std::vector<double> sorted = state.latencies;
+           std::sort(sorted.begin(), sorted.end());
+           stats.p50_seconds = sorted[(sorted.size() - 1) / 2];
+           stats.p99_seconds = sorted[(sorted.size() - 1) * 99 / 100];
+       }
+       return stats;
+   }
+};
+
+#endif // JOB_SCHEDULER_H
@@ -1,6 +1,5 @@
 #include <iostream>
 #include <string>
-#include <curl/curl.h>
 #include <nlohmann/json.hpp>
 #include <cstdlib>
 #include <limits>
@@ -9,158 +8,12 @@
 #include "bell_number.h"
 #include "subset_analyzer.h"
 #include "partition_analyzer.h"
-
-// Function to handle the response from the RPC call
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-   ((std::string*)userp)->append((char*)contents, size * nmemb);
-   return size * nmemb;
-}
-
-// Function to make the RPC request
-std::string rpc_request(const nlohmann::json& json_data) {
-   // Bitcoin Core RPC URL (assuming it's running locally)
-   std::string url = "http://127.0.0.1:8332";  // Default RPC port
-   std::string user = "rpcuser";               // Your RPC username (see bitcoin.conf)
-   std::string pass = "rpcpw";                 // Your RPC password (see bitcoin.conf)
-   
-   CURL* curl;
-   CURLcode res;
-   std::string read_buffer;
-
-   curl_global_init(CURL_GLOBAL_DEFAULT);
-   curl = curl_easy_init();
-
-   if (curl) {
-       struct curl_slist* headers = NULL;
-
-       // Set the content-type header
-       headers = curl_slist_append(headers, "Content-Type: application/json");
-
-       // Set the URL, user and password for authentication
-       curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-       curl_easy_setopt(curl, CURLOPT_USERPWD, (user + ":" + pass).c_str());
-       curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-       // Convert the JSON object to a string and send it as the POST body
-       std::string json_str = json_data.dump();
-       curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_str.c_str());
-
-       // Specify a callback to handle the response
-       curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-       curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
-
-       // Perform the request
-       res = curl_easy_perform(curl);
-
-       // Check for errors
-       if (res != CURLE_OK) {
-           std::cerr << "CURL request failed: " << curl_easy_strerror(res) << std::endl;
-       }
-
-       // Clean up
-       curl_easy_cleanup(curl);
-       curl_slist_free_all(headers);
-   }
-
-   curl_global_cleanup();
-   return read_buffer;
-}
-
-// Helper function to get a previous transaction by its txid
-nlohmann::json get_transaction(const std::string& txid) {
-   // Create the JSON RPC request payload for getting the transaction
-   nlohmann::json json_request = {
-       {"jsonrpc", "1.0"},
-       {"id", "curltest"},
-       {"method", "getrawtransaction"},
-       {"params", nlohmann::json::array({txid, true})}
-   };
-   
-   // Make the RPC request and get the response
-   std::string response = rpc_request(json_request);
-   
-   // Parse and return the JSON response
-   try {
-       return nlohmann::json::parse(response);
-   } catch (const nlohmann::json::exception& e) {
-       std::cerr << "Error parsing JSON response for txid " << txid << ": " << e.what() << std::endl;
-       return nlohmann::json();
-   }
-}
-
-// Function to parse transaction data from JSON response
-TransactionData parse_transaction_data(const nlohmann::json& json_response) {
-   TransactionData tx_data;
-   
-   try {
-       // Check if we have a result in the response
-       if (!json_response.contains("result") || json_response["result"].is_null()) {
-           std::cerr << "Error: No transaction data found in response" << std::endl;
-           return tx_data;
-       }
-       
-       const auto& result = json_response["result"];
-       
-       // Process inputs (vin)
-       if (result.contains("vin") && result["vin"].is_array()) {
-           const auto& vin = result["vin"];
-           for (size_t i = 0; i < vin.size(); i++) {
-               const auto& input = vin[i];
-               double value = 0.0;
-               
-               // Get the previous transaction ID and output index
-               if (input.contains("txid") && input.contains("vout")) {
-                   std::string prev_txid = input["txid"].get<std::string>();
-                   size_t prev_vout = static_cast<size_t>(input["vout"].get<int>());
-                   
-                   // Get the previous transaction
-                   nlohmann::json prev_tx_response = get_transaction(prev_txid);
-                   
-                   // Extract the value from the previous transaction's output
-                   if (prev_tx_response.contains("result") && 
-                       prev_tx_response["result"].contains("vout") && 
-                       prev_tx_response["result"]["vout"].is_array() && 
-                       prev_vout < prev_tx_response["result"]["vout"].size()) {
-                       
-                       const auto& prev_output = prev_tx_response["result"]["vout"][prev_vout];
-                       if (prev_output.contains("value")) {
-                           value = prev_output["value"].get<double>();
-                       }
-                   } else {
-                       std::cerr << "Warning: Could not retrieve value for input " << i 
-                                 << " (prev_txid: " << prev_txid << ", vout: " << prev_vout << ")" << std::endl;
-                   }
-               }
-               
-               // Create input ID and add to transaction data
-               std::string input_id = "input_" + std::to_string(i);
-               tx_data.add_input(input_id, value);
-           }
-       }
-       
-       // Process outputs (vout)
-       if (result.contains("vout") && result["vout"].is_array()) {
-           const auto& vout = result["vout"];
-           for (size_t i = 0; i < vout.size(); i++) {
-               const auto& output = vout[i];
-               double value = 0.0;
-               
-               // Get output value
-               if (output.contains("value")) {
-                   value = output["value"].get<double>();
-               }
-               
-               // Create output ID and add to transaction data
-               std::string output_id = "output_" + std::to_string(i);
-               tx_data.add_output(output_id, value);
-           }
-       }
-   } catch (const std::exception& e) {
-       std::cerr << "Error parsing transaction data: " << e.what() << std::endl;
-   }
-   
-   return tx_data;
-}
+#include "workload_generator.h"
+#include "analysis_planner.h"
+#include "bitcoin_rpc.h"
+#include "analysis_daemon.h"
+#include "block_analyzer.h"
+#include "chain_follower.h"
 
 /**
 * Creates a custom transaction with user-defined inputs and outputs.
@@ -255,13 +108,174 @@ void display_transaction_summary(const TransactionData& tx_data) {
    }
 }
 
-int main() {
+/**
+* Asks the user to confirm a plan whose selected engine is predicted to run longer
+* than a minute or to write more than a gigabyte.
+* 
+* @param plan The analysis plan
+* @return true if the analysis should run, false if the user cancelled it
+*/
+bool confirm_expensive_plan(const AnalysisPlan& plan) {
+   const double runtime_warning_seconds = 60.0;
+   const double output_warning_bytes = 1e9;
+   
+   const EngineEstimate& estimate = plan.selected_estimate();
+   if (estimate.runtime_seconds <= runtime_warning_seconds && estimate.output_bytes <= output_warning_bytes) {
+       return true;
+   }
+   
+   std::cout << "\nWarning: The analysis is predicted to take " << format_duration(estimate.runtime_seconds)
+             << " and write " << format_estimate(estimate.output_bytes) << " bytes." << std::endl;
+   std::cout << "Do you want to continue? (y/n): ";
+   
+   char continue_analysis;
+   std::cin >> continue_analysis;
+   return continue_analysis == 'y' || continue_analysis == 'Y';
+}
+
+/**
+* Prints the command line options.
+* 
+* @param program Name of the executable
+*/
+void print_usage(const char* program) {
+   std::cerr << "Usage: " << program << " [--trace FILE] [--question count|sample|enumerate] [--dry-run]"
+             << " [--metrics-file FILE] [--metrics-port PORT] [--metrics-interval SECONDS] [--memory-budget SIZE]"
+             << " [--catalog-dir DIR] [--daemon SOCKET] [--job-limits S,M,L] [--time-slice SECONDS]"
+             << " [--block HEIGHT|HASH] [--block-engine ENGINE] [--block-output PREFIX] [--block-max-pairs N]"
+             << " [--follow DIR] [--follow-start HEIGHT] [--follow-interval SECONDS]" << std::endl;
+   std::cerr << "  --trace FILE   Record a timeline of the analysis threads as Chrome trace-event JSON" << std::endl;
+   std::cerr << "  --question Q   What the analysis has to answer (default: enumerate)" << std::endl;
+   std::cerr << "  --dry-run      Only print the analysis plan" << std::endl;
+   std::cerr << "  --metrics-file FILE        Periodically rewrite FILE with live Prometheus metrics" << std::endl;
+   std::cerr << "  --metrics-port PORT        Serve live Prometheus metrics on http://127.0.0.1:PORT/metrics" << std::endl;
+   std::cerr << "  --metrics-interval SECONDS Rewrite interval of the metrics file (default: 5)" << std::endl;
+   std::cerr << "  --memory-budget SIZE       Memory the partition analysis may use, e.g. 512M or 4G" << std::endl;
+   std::cerr << "                             (default: a quarter of the physical memory, at most 2G)" << std::endl;
+   std::cerr << "  --catalog-dir DIR          Persist partition catalogs in DIR to reuse them across runs (default: memory only)" << std::endl;
+   std::cerr << "  --daemon SOCKET            Serve analysis jobs on a Unix domain socket instead of asking" << std::endl;
+   std::cerr << "  --job-limits S,M,L         Concurrent small, medium and large daemon jobs (default: 16,2,1)" << std::endl;
+   std::cerr << "  --time-slice SECONDS       Time an expensive daemon job runs before it yields (default: 2)" << std::endl;
+   std::cerr << "  --block HEIGHT|HASH        Analyze every transaction of a block instead of asking" << std::endl;
+   std::cerr << "  --block-engine ENGINE      Engine for the block transactions (default: partition_enumerate)" << std::endl;
+   std::cerr << "  --block-output PREFIX      Block output PREFIX.csv and index PREFIX.index.json (default: block_HEIGHT)" << std::endl;
+   std::cerr << "  --block-max-pairs N        Transactions with more estimated pairs are only sampled (default: 1e12)" << std::endl;
+   std::cerr << "  --follow DIR               Analyze every new block of the chain into DIR, resuming from DIR/cursor.json" << std::endl;
+   std::cerr << "  --follow-start HEIGHT      First block to analyze without a cursor (default: the current tip)" << std::endl;
+   std::cerr << "  --follow-interval SECONDS  Seconds between polls of the tip (default: 10)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+   // Parse command line options
+   std::string trace_filename;
+   AnalysisQuestion question = AnalysisQuestion::ENUMERATE;
+   bool dry_run = false;
+   std::string metrics_filename;
+   int metrics_port = 0;
+   double metrics_interval = 5.0;
+   size_t memory_budget = 0;
+   std::string daemon_socket;
+   SchedulerLimits scheduler_limits;
+   std::string block_id;
+   std::string block_output;
+   BlockAnalysisOptions block_options;
+   std::string follow_directory;
+   int64_t follow_start = -1;
+   double follow_interval = 10.0;
+   
+   for (int i = 1; i < argc; ++i) {
+       std::string arg = argv[i];
+       if (arg == "--trace" && i + 1 < argc) {
+           trace_filename = argv[++i];
+       } else if (arg == "--question" && i + 1 < argc && parse_analysis_question(argv[i + 1], question)) {
+           ++i;
+       } else if (arg == "--dry-run") {
+           dry_run = true;
+       } else if (arg == "--metrics-file" && i + 1 < argc) {
+           metrics_filename = argv[++i];
+       } else if (arg == "--metrics-port" && i + 1 < argc) {
+           metrics_port = std::atoi(argv[++i]);
+       } else if (arg == "--metrics-interval" && i + 1 < argc) {
+           metrics_interval = std::atof(argv[++i]);
+       } else if (arg == "--memory-budget" && i + 1 < argc && parse_byte_size(argv[i + 1], memory_budget)) {
+           ++i;
+       } else if (arg == "--catalog-dir" && i + 1 < argc) {
+           PartitionCatalogStore::instance().set_directory(argv[++i]);
+       } else if (arg == "--daemon" && i + 1 < argc) {
+           daemon_socket = argv[++i];
+       } else if (arg == "--job-limits" && i + 1 < argc && parse_job_class_limits(argv[i + 1], scheduler_limits)) {
+           ++i;
+       } else if (arg == "--time-slice" && i + 1 < argc) {
+           scheduler_limits.slice_seconds = std::atof(argv[++i]);
+       } else if (arg == "--block" && i + 1 < argc) {
+           block_id = argv[++i];
+       } else if (arg == "--block-engine" && i + 1 < argc && parse_analysis_engine(argv[i + 1], block_options.engine)) {
+           ++i;
+       } else if (arg == "--block-output" && i + 1 < argc) {
+           block_output = argv[++i];
+       } else if (arg == "--block-max-pairs" && i + 1 < argc) {
+           block_options.max_pairs = std::atof(argv[++i]);
+       } else if (arg == "--follow" && i + 1 < argc) {
+           follow_directory = argv[++i];
+       } else if (arg == "--follow-start" && i + 1 < argc) {
+           follow_start = std::atoll(argv[++i]);
+       } else if (arg == "--follow-interval" && i + 1 < argc) {
+           follow_interval = std::atof(argv[++i]);
+       } else {
+           print_usage(argv[0]);
+           return EXIT_FAILURE;
+       }
+   }
+   
+   if (!trace_filename.empty()) {
+       TraceRecorder::instance().enable();
+   }
+   
+   if (!metrics_filename.empty() || metrics_port > 0) {
+       if (!MetricsExporter::instance().start(metrics_filename, metrics_port, metrics_interval)) {
+           return EXIT_FAILURE;
+       }
+   }
+   
+   if (!daemon_socket.empty()) {
+       AnalysisContext context;
+       scheduler_limits.memory_budget = memory_budget;
+       AnalysisDaemon daemon(daemon_socket, context, scheduler_limits);
+       bool served = daemon.run();
+       MetricsExporter::instance().stop();
+       return served ? EXIT_SUCCESS : EXIT_FAILURE;
+   }
+   
+   if (!block_id.empty()) {
+       BlockData block;
+       block_options.memory_budget = memory_budget;
+       AnalysisContext context;
+       bool analyzed = fetch_block(block_id, block) &&
+                       analyze_block(block, context, block_options,
+                                     block_output.empty() ? "block_" + std::to_string(block.height) : block_output);
+       if (!trace_filename.empty()) {
+           TraceRecorder::instance().write_chrome_trace(trace_filename);
+       }
+       MetricsExporter::instance().stop();
+       return analyzed ? EXIT_SUCCESS : EXIT_FAILURE;
+   }
+   
+   if (!follow_directory.empty()) {
+       block_options.memory_budget = memory_budget;
+       AnalysisContext context;
+       ChainFollower follower(follow_directory, context, block_options, follow_interval);
+       bool followed = follower.run(follow_start);
+       MetricsExporter::instance().stop();
+       return followed ? EXIT_SUCCESS : EXIT_FAILURE;
+   }
+   
    // Ask user if they want to fetch a real transaction or create a custom one
    std::cout << "Bitcoin Transaction Taint Analysis" << std::endl;
    std::cout << "=================================" << std::endl;
    std::cout << "1. Fetch a real Bitcoin transaction" << std::endl;
    std::cout << "2. Create a custom transaction" << std::endl;
-   std::cout << "Enter choice (1 or 2): ";
+   std::cout << "3. Load a transaction from a corpus file" << std::endl;
+   std::cout << "Enter choice (1, 2 or 3): ";
    
    int choice;
    std::cin >> choice;
@@ -312,6 +326,37 @@ int main() {
    } else if (choice == 2) {
        // Create a custom transaction
        tx_data = create_custom_transaction();
+   } else if (choice == 3) {
+       // Load a generated transaction from a corpus file
+       std::string corpus_filename;
+       std::cout << "Enter corpus filename (default: transaction_corpus.jsonl): ";
+       std::cin.ignore(); // Clear the input buffer
+       std::getline(std::cin, corpus_filename);
+       
+       if (corpus_filename.empty()) {
+           corpus_filename = "transaction_corpus.jsonl";
+       }
+       
+       auto corpus = read_transaction_corpus(corpus_filename);
+       if (corpus.empty()) {
+           std::cerr << "Error: No transactions found in " << corpus_filename << std::endl;
+           return EXIT_FAILURE;
+       }
+       
+       for (size_t i = 0; i < corpus.size(); ++i) {
+           std::cout << i << ". " << corpus[i].name << std::endl;
+       }
+       
+       size_t entry_index;
+       std::cout << "Enter transaction number (0-" << corpus.size() - 1 << "): ";
+       std::cin >> entry_index;
+       
+       if (entry_index >= corpus.size()) {
+           std::cout << "Invalid transaction number. Exiting." << std::endl;
+           return EXIT_FAILURE;
+       }
+       
+       tx_data = corpus[entry_index].tx_data;
    } else {
        std::cout << "Invalid choice. Exiting." << std::endl;
        return EXIT_FAILURE;
@@ -343,70 +388,86 @@ int main() {
    std::cin >> analysis_choice;
    
    if (analysis_choice == 1) {
-       // Generate all subsets of inputs
-       std::cout << "\nGenerating input subsets..." << std::endl;
-       auto input_subsets = generate_subsets(tx_data, SubsetType::INPUTS);
-       std::cout << "Generated " << input_subsets.size() << " input subsets." << std::endl;
+       // Subsets are bit masks and their values come from subset sum tables, which bound the size
+       size_t num_inputs = tx_data.get_input_ids().size();
+       size_t num_outputs = tx_data.get_output_ids().size();
+       if (num_inputs > SubsetSumTable::MAX_VALUES || num_outputs > SubsetSumTable::MAX_VALUES) {
+           std::cerr << "Error: Subset analysis supports at most " << SubsetSumTable::MAX_VALUES
+                     << " inputs and outputs" << std::endl;
+           return EXIT_FAILURE;
+       }
        
-       // Generate all subsets of outputs
-       std::cout << "\nGenerating output subsets..." << std::endl;
-       auto output_subsets = generate_subsets(tx_data, SubsetType::OUTPUTS);
-       std::cout << "Generated " << output_subsets.size() << " output subsets." << std::endl;
+       // Estimate the cost before generating anything
+       AnalysisPlan plan = plan_subset_analysis(tx_data, question);
+       print_analysis_plan(plan);
        
-       // Display some statistics
-       std::cout << "\nSubset Statistics:" << std::endl;
-       std::cout << "Number of inputs: " << tx_data.get_input_ids().size() << std::endl;
-       std::cout << "Number of outputs: " << tx_data.get_output_ids().size() << std::endl;
-       std::cout << "Number of possible input subsets: " << input_subsets.size() << std::endl;
-       std::cout << "Number of possible output subsets: " << output_subsets.size() << std::endl;
+       if (dry_run) {
+           return EXIT_SUCCESS;
+       }
        
-       // Ask for output filename
-       std::string output_filename;
-       std::cout << "\nEnter output filename for valid combinations (default: valid_combinations.csv): ";
-       std::cin.ignore(); // Clear the input buffer
-       std::getline(std::cin, output_filename);
+       if (plan.selected == AnalysisEngine::SAMPLED_ESTIMATE) {
+           run_sampled_subset_estimate(tx_data);
+           return EXIT_SUCCESS;
+       }
        
-       if (output_filename.empty()) {
-           output_filename = "valid_combinations.csv";
+       if (!confirm_expensive_plan(plan)) {
+           std::cout << "Operation cancelled by user." << std::endl;
+           return EXIT_SUCCESS;
        }
        
+       RunMetrics metrics;
+       
+       // Subsets are enumerated as bit masks during the analysis, no need to build them here
+       size_t input_subset_count = (1ULL << num_inputs) - 1;
+       size_t output_subset_count = (1ULL << num_outputs) - 1;
+       
+       // Display some statistics
+       std::cout << "\nSubset Statistics:" << std::endl;
+       std::cout << "Number of inputs: " << num_inputs << std::endl;
+       std::cout << "Number of outputs: " << num_outputs << std::endl;
+       std::cout << "Number of possible input subsets: " << input_subset_count << std::endl;
+       std::cout << "Number of possible output subsets: " << output_subset_count << std::endl;
+       
        // Calculate the maximum possible combinations
-       size_t max_combinations = input_subsets.size() * output_subsets.size();
-       std::cout << "Maximum possible combinations: " << max_combinations << std::endl;
+       std::cout << "Maximum possible combinations: " << format_estimate(plan.total_pairs) << std::endl;
        
-       // Check if there are too many combinations
-       if (max_combinations > 1000) {
-           char confirm;
-           std::cout << "Warning: This will generate a large number of combinations." << std::endl;
-           std::cout << "Are you sure you want to continue? (y/n): ";
-           std::cin >> confirm;
+       if (plan.question != AnalysisQuestion::ENUMERATE) {
+           // Only count the valid combinations, nothing is written
+           CountingMappingSink sink;
+           size_t valid_count = find_valid_combinations(tx_data, sink, metrics);
+           std::cout << "Total valid combinations found: " << valid_count << std::endl;
+       } else {
+           // Ask for output filename
+           std::string output_filename;
+           std::cout << "\nEnter output filename for valid combinations (default: valid_combinations.csv): ";
+           std::cin.ignore(); // Clear the input buffer
+           std::getline(std::cin, output_filename);
            
-           if (confirm != 'y' && confirm != 'Y') {
-               std::cout << "Operation cancelled by user." << std::endl;
-               return EXIT_SUCCESS;
+           if (output_filename.empty()) {
+               output_filename = "valid_combinations.csv";
            }
+           
+           // Find valid combinations and write to file
+           find_valid_combinations(tx_data, output_filename, metrics);
        }
-       
-       // Find valid combinations and write to file
-       size_t valid_count = find_valid_combinations(tx_data, input_subsets, output_subsets, output_filename);
    } else if (analysis_choice == 2) {
        // Inform user about complexity
-       size_t num_inputs = tx_data.get_input_ids().size();
-       size_t num_outputs = tx_data.get_output_ids().size();
+       std::cout << "\nEstimating analysis cost..." << std::endl;
+       AnalysisPlan plan = plan_partition_analysis(tx_data, question, 200, 1, memory_budget);
+       print_analysis_plan(plan);
        
-       if (num_inputs > 5 || num_outputs > 5) {
-           std::cout << "\nWarning: This transaction has " << num_inputs << " inputs and " 
-                     << num_outputs << " outputs, which may generate a very large number of partitions." << std::endl;
-           std::cout << "The analysis could take a long time or exhaust memory." << std::endl;
-           std::cout << "Do you want to continue? (y/n): ";
-           
-           char continue_analysis;
-           std::cin >> continue_analysis;
-           
-           if (continue_analysis != 'y' && continue_analysis != 'Y') {
-               std::cout << "Analysis cancelled. Exiting." << std::endl;
-               return EXIT_SUCCESS;
-           }
+       if (dry_run) {
+           return EXIT_SUCCESS;
+       }
+       
+       if (plan.selected == AnalysisEngine::SAMPLED_ESTIMATE) {
+           run_sampled_estimate(tx_data);
+           return EXIT_SUCCESS;
+       }
+       
+       if (!confirm_expensive_plan(plan)) {
+           std::cout << "Analysis cancelled. Exiting." << std::endl;
+           return EXIT_SUCCESS;
        }
        
        // Ask for output filename
@@ -419,13 +480,20 @@ int main() {
            output_filename = "valid_mappings.csv";
        }
        
-       // Perform comprehensive partition analysis and write to file
+       // Perform comprehensive partition analysis and write to file (or only count)
        std::cout << "\nPerforming comprehensive partition analysis..." << std::endl;
-       find_valid_partitions(tx_data, output_filename);
+       find_valid_partitions(tx_data, output_filename, plan.selected == AnalysisEngine::PARTITION_ENUMERATE,
+                             memory_budget);
    } else {
        std::cout << "Invalid choice. Exiting." << std::endl;
        return EXIT_FAILURE;
    }
    
+   if (!trace_filename.empty()) {
+       TraceRecorder::instance().write_chrome_trace(trace_filename);
+   }
+   
+   MetricsExporter::instance().stop();
+   
    return EXIT_SUCCESS;
 }
@@ -0,0 +1,102 @@
+#ifndef MAPPING_SINK_H
+#define MAPPING_SINK_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+
+/**
+* Destination of the CSV rows of an analysis. The analyses format a valid mapping
+* only if the sink wants mappings; otherwise they only count it. Writes from
+* worker threads are serialized by the analysis, so a sink needs no locking.
+*/
+class MappingSink {
+public:
+   virtual ~MappingSink() = default;
+
+   // Whether valid mappings are formatted and written, or only counted
+   virtual bool wants_mappings() const = 0;
+
+   virtual void write(const std::string& rows) = 0;
+
+   virtual void flush() {}
+};
+
+/**
+* Writes the rows to a CSV file through a buffer of the given size.
+*/
+class FileMappingSink : public MappingSink {
+private:
+   std::vector<char> buffer;  // Must outlive the stream
+   std::ofstream file;
+
+public:
+   /**
+   * @param filename The CSV file, truncated on open
+   * @param buffer_bytes Size of the stream buffer, 0 for the library default
+   */
+   explicit FileMappingSink(const std::string& filename, size_t buffer_bytes = 0) : buffer(buffer_bytes) {
+       if (buffer_bytes > 0) {
+           file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+       }
+       file.open(filename);
+       if (!file.is_open()) {
+           std::cerr << "Error: Could not open output file " << filename << std::endl;
+       }
+   }
+
+   bool is_open() const { return file.is_open(); }
+   bool wants_mappings() const override { return file.is_open(); }
+   void write(const std::string& rows) override { file << rows; }
+   void flush() override { file.flush(); }
+};
+
+/**
+* Writes the rows to a stream owned by the caller, e.g. a string stream or a socket stream.
+*/
+class StreamMappingSink : public MappingSink {
+private:
+   std::ostream& stream;
+
+public:
+   explicit StreamMappingSink(std::ostream& output) : stream(output) {}
+
+   bool wants_mappings() const override { return true; }
+   void write(const std::string& rows) override { stream << rows; }
+   void flush() override { stream.flush(); }
+};
+
+/**
+* Discards all rows; valid mappings are only counted.
+*/
+class CountingMappingSink : public MappingSink {
+public:
+   bool wants_mappings() const override { return false; }
+   void write(const std::string&) override {}
+};
+
+/**
+* Redirects std::cout to nowhere while in scope; engines report their progress there.
+*/
+class SilencedOutput {
+private:
+   std::streambuf* original;
+   std::ofstream null_stream;
+
+public:
+   SilencedOutput() : original(std::cout.rdbuf()), null_stream("/dev/null") {
+       std::cout.rdbuf(null_stream.rdbuf());
+   }
+
+   ~SilencedOutput() {
+       std::cout.rdbuf(original);
+   }
+
+   // The stream std::cout wrote to before, for output that must still be shown
+   std::streambuf* original_buffer() const {
+       return original;
+   }
+};
+
+#endif // MAPPING_SINK_H
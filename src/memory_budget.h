@@ -0,0 +1,303 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+#include <unistd.h>
+#include "run_metrics.h"
+
+/**
+* Returns the current resident set size of this process in bytes.
+* Falls back to the peak resident set size where the current one is not available.
+*/
+uint64_t current_rss_bytes() {
+#ifdef __linux__
+   std::ifstream statm("/proc/self/statm");
+   uint64_t total_pages = 0, resident_pages = 0;
+   if (statm >> total_pages >> resident_pages) {
+       return resident_pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+   }
+#endif
+   return peak_rss_bytes();
+}
+
+/**
+* Returns the physical memory of the host in bytes, or 0 if it is unknown.
+*/
+uint64_t physical_memory_bytes() {
+   long pages = sysconf(_SC_PHYS_PAGES);
+   long page_size = sysconf(_SC_PAGESIZE);
+   if (pages <= 0 || page_size <= 0) {
+       return 0;
+   }
+   return static_cast<uint64_t>(pages) * static_cast<uint64_t>(page_size);
+}
+
+/**
+* Default memory budget: a quarter of the physical memory, at most 2 GiB.
+*/
+size_t default_memory_budget() {
+   const uint64_t max_default = 2ull << 30;
+   uint64_t physical = physical_memory_bytes();
+   return static_cast<size_t>(physical ? std::min(physical / 4, max_default) : max_default / 4);
+}
+
+/**
+* Parses a byte size such as "512M", "2G", "64k" or "1048576".
+*
+* @param text The size; suffixes K, M and G are powers of 1024
+* @param bytes Set to the parsed size on success
+* @return true if text is a valid size, false otherwise
+*/
+bool parse_byte_size(const std::string& text, size_t& bytes) {
+   size_t digits = 0;
+   while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+       digits++;
+   }
+   if (digits == 0 || text.size() > digits + 1) {
+       return false;
+   }
+
+   errno = 0;
+   unsigned long long parsed = std::strtoull(text.c_str(), nullptr, 10);
+   if (errno == ERANGE || parsed > SIZE_MAX) {
+       return false;
+   }
+   size_t value = static_cast<size_t>(parsed);
+   size_t shift = 0;
+   if (digits < text.size()) {
+       switch (std::toupper(static_cast<unsigned char>(text[digits]))) {
+           case 'K': shift = 10; break;
+           case 'M': shift = 20; break;
+           case 'G': shift = 30; break;
+           default: return false;
+       }
+   }
+
+   // The suffix must not push the size past what size_t holds
+   if (value > (SIZE_MAX >> shift)) {
+       return false;
+   }
+   bytes = value << shift;
+   return bytes > 0;
+}
+
+/**
+* Derives chunk sizes, the number of pairs handed to the workers at once and the
+* results file buffer from a memory budget.
+*
+* The partition analysis keeps one chunk of input partitions, one chunk of output
+* partitions and the compatible pairs, which are positions in the chunks, alive at the
+* same time:
+*
+*     input_chunk * input_bytes + output_chunk * output_bytes
+*         + input_chunk * output_chunk * pair_fraction * pair_bytes  <=  working budget
+*
+* The pairs of one chunk combination are also limited to MAX_PAIRS_PER_BATCH, so
+* that progress and metrics are updated regularly even with a large budget.
+*
+* The working budget is what remains of the budget after the memory the process
+* already uses and the file buffer, minus a safety margin. The per-partition sizes
+* and the fraction of compatible pairs start at worst-case values and are replaced
+* by the largest values measured on the chunks actually generated. If the resident
+* set still grows past the budget, the chunks are halved once per overshoot and
+* grow back when the growth has fallen well below it again. The growth is measured
+* from the resident set when the governor was created, so memory of other analyses
+* running in the same process (daemon, block mode) and mapped catalogs that were
+* already resident do not throttle this one. Memory the analysis holds for its whole
+* run, such as the partition catalogs it reads, is reserved up front and taken off
+* the working budget.
+*/
+class MemoryGovernor {
+private:
+   size_t budget_bytes;
+   size_t baseline_bytes;
+   size_t file_buffer_bytes;
+   size_t reserved_bytes = 0;
+   size_t pair_object_bytes;
+
+   // Heap bytes per partition and fraction of input-output combinations that form a pair
+   double input_partition_bytes;
+   double output_partition_bytes;
+   double pair_fraction = 1.0;
+   bool input_measured = false;
+   bool output_measured = false;
+   bool pairs_measured = false;
+
+   double shrink_factor = 1.0;
+   bool over_budget = false;
+
+   static constexpr size_t MAX_CHUNK_SIZE = 1 << 20;
+   static constexpr double MAX_PAIRS_PER_BATCH = 1 << 22;
+   static constexpr double SAFETY_MARGIN = 0.8;
+   static constexpr double MIN_SHRINK_FACTOR = 1.0 / 1024;
+
+   double working_budget() const {
+       return std::max(0.0, (unreserved_bytes() - reserved_bytes) * SAFETY_MARGIN * shrink_factor);
+   }
+
+   // What the budget leaves after the memory already in use and the file buffer
+   double unreserved_bytes() const {
+       return static_cast<double>(budget_bytes) - baseline_bytes - file_buffer_bytes;
+   }
+
+   // The pair vector; workers read their batches from it in place
+   double pair_bytes() const {
+       return static_cast<double>(pair_object_bytes);
+   }
+
+   static size_t clamp_chunk(double size) {
+       if (!(size >= 1.0)) return 1;
+       return static_cast<size_t>(std::min(size, static_cast<double>(MAX_CHUNK_SIZE)));
+   }
+
+public:
+   /**
+   * @param budget Memory budget of the whole process in bytes
+   * @param num_inputs Number of input elements
+   * @param num_outputs Number of output elements
+   * @param element_bytes Size of one element index
+   * @param offset_bytes Size of one block or partition offset of a chunk
+   * @param value_bytes Size of one block sum or signature entry of a chunk
+   * @param pair_bytes Size of one pair object
+   */
+   MemoryGovernor(size_t budget, size_t num_inputs, size_t num_outputs, size_t element_bytes,
+                  size_t offset_bytes, size_t value_bytes, size_t pair_bytes)
+       : budget_bytes(budget), baseline_bytes(current_rss_bytes()), pair_object_bytes(pair_bytes) {
+       // Large enough to batch writes, small compared to the budget
+       file_buffer_bytes = std::min<size_t>(std::max<size_t>(budget / 64, 64 << 10), 16 << 20);
+
+       // Worst case until measured: every element in its own block, i.e. n elements,
+       // n block offsets, one partition offset and n block sums and signature entries
+       auto worst_case = [&](size_t n) {
+           return static_cast<double>(n * element_bytes + (n + 1) * offset_bytes + 2 * n * value_bytes);
+       };
+       input_partition_bytes = worst_case(num_inputs);
+       output_partition_bytes = worst_case(num_outputs);
+   }
+
+   size_t budget() const {
+       return budget_bytes;
+   }
+
+   size_t output_buffer_bytes() const {
+       return file_buffer_bytes;
+   }
+
+   /**
+   * Reserves memory held for the whole analysis, if it leaves at least half of
+   * the budget to the chunks and pairs.
+   *
+   * @param bytes Bytes to reserve
+   * @return false, reserving nothing, if they do not fit
+   */
+   bool reserve(size_t bytes) {
+       if (static_cast<double>(reserved_bytes) + bytes > unreserved_bytes() / 2.0) {
+           return false;
+       }
+       reserved_bytes += bytes;
+       return true;
+   }
+
+   /**
+   * Size of the next input chunk. Input and output chunks are balanced so that the
+   * pairs of a square chunk fill the working budget.
+   */
+   size_t input_chunk_size() const {
+       // Solve fraction * pair_bytes * c^2 + (input_bytes + output_bytes) * c = working budget
+       double a = pair_fraction * pair_bytes();
+       double b = input_partition_bytes + output_partition_bytes;
+       double by_memory = (-b + std::sqrt(b * b + 4.0 * a * working_budget())) / (2.0 * a);
+       return clamp_chunk(std::min(by_memory, std::sqrt(MAX_PAIRS_PER_BATCH / pair_fraction)));
+   }
+
+   /**
+   * Size of the next output chunk given the length of the input chunk that is held.
+   */
+   size_t output_chunk_size(size_t input_chunk_length) const {
+       double remaining = working_budget() - input_chunk_length * input_partition_bytes;
+       double per_output = output_partition_bytes + input_chunk_length * pair_fraction * pair_bytes();
+       double by_pairs = MAX_PAIRS_PER_BATCH / (input_chunk_length * pair_fraction);
+       return clamp_chunk(std::min(remaining / per_output, by_pairs));
+   }
+
+   /**
+   * Updates the per-partition size from a generated chunk.
+   *
+   * @param bytes Bytes the chunk occupies
+   * @param partitions Number of partitions in the chunk
+   * @param inputs Whether the chunk holds input partitions
+   */
+   void observe_chunk(size_t bytes, size_t partitions, bool inputs) {
+       if (partitions == 0) return;
+
+       double measured = static_cast<double>(bytes) / partitions;
+
+       // The first measurement replaces the worst-case start value, later ones can only raise it
+       double& estimate = inputs ? input_partition_bytes : output_partition_bytes;
+       bool& measured_before = inputs ? input_measured : output_measured;
+       estimate = measured_before ? std::max(estimate, measured) : measured;
+       measured_before = true;
+   }
+
+   // Update the fraction of compatible pairs from one chunk combination
+   void observe_pairs(size_t pairs, size_t candidates) {
+       if (candidates == 0) return;
+       double measured = std::max(static_cast<double>(pairs) / candidates, 1e-3);
+       pair_fraction = pairs_measured ? std::max(pair_fraction, measured) : measured;
+       pairs_measured = true;
+   }
+
+   /**
+   * Compares the growth of the resident set since the governor was created with
+   * what the budget leaves for this analysis. The chunks are halved when the growth
+   * first exceeds it, not again while it stays exceeded, and doubled back towards
+   * their original size while the growth is below half of it.
+   *
+   * @return true if the budget was exceeded
+   */
+   bool check_resident_set() {
+       uint64_t rss = current_rss_bytes();
+       double growth = rss > baseline_bytes ? static_cast<double>(rss - baseline_bytes) : 0.0;
+       double allowance = std::max(0.0, static_cast<double>(budget_bytes) - baseline_bytes);
+
+       if (growth > allowance) {
+           if (!over_budget) {
+               shrink_factor = std::max(shrink_factor / 2.0, MIN_SHRINK_FACTOR);
+               over_budget = true;
+           }
+           return true;
+       }
+
+       over_budget = false;
+       if (growth < allowance / 2.0) {
+           shrink_factor = std::min(shrink_factor * 2.0, 1.0);
+       }
+       return false;
+   }
+};
+
+/**
+* Formats a byte count as e.g. "512.0 MiB".
+*/
+std::string format_bytes(double bytes) {
+   const char* units[] = {"bytes", "KiB", "MiB", "GiB", "TiB"};
+   size_t unit = 0;
+   while (bytes >= 1024.0 && unit < 4) {
+       bytes /= 1024.0;
+       unit++;
+   }
+   char text[32];
+   std::snprintf(text, sizeof(text), unit ? "%.1f %s" : "%.0f %s", bytes, units[unit]);
+   return text;
+}
+
+#endif // MEMORY_BUDGET_H
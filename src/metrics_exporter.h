@@ -0,0 +1,323 @@
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "run_metrics.h"
+
+/**
+* Exposes the counters of the running analysis in Prometheus text format,
+* either as a periodically rewritten file, on a local HTTP endpoint, or both.
+*
+* The exporter only reads the atomic counters that the analysis maintains anyway;
+* rates and utilization are derived from deltas between two scrapes, so the
+* worker threads do no additional work. An analysis makes its RunMetrics visible
+* with attach() and removes them with detach() before they go out of scope.
+* Several analyses may be attached at once (daemon jobs, a block and its large
+* transactions); each is exported with its own rate state under the labels
+* analysis="NAME" and run="N", where N is the lowest number not used by another
+* attached run, so the label values stay few however many runs come and go.
+*/
+class MetricsExporter {
+private:
+   // One attached analysis and the state of its previous scrape, for rates
+   struct Run {
+       const RunMetrics* metrics;
+       std::string name;
+       unsigned number;
+       std::chrono::steady_clock::time_point last_scrape_time;
+       uint64_t last_pairs_processed = 0;
+       uint64_t last_worker_busy_ns[MAX_WORKER_THREADS] = {};
+       double throughput = 0.0;
+       double utilization[MAX_WORKER_THREADS] = {};
+   };
+
+   std::mutex run_mutex;
+   std::vector<Run> runs;
+
+   std::string metrics_filename;
+   int http_port = 0;
+   double interval_seconds = 5.0;
+
+   std::thread exporter_thread;
+   std::atomic<bool> running{false};
+   int listen_fd = -1;
+
+   MetricsExporter() = default;
+
+   // Open a listening socket bound to localhost only
+   bool open_http_socket() {
+       listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+       if (listen_fd < 0) {
+           std::cerr << "Error: Could not create metrics socket: " << std::strerror(errno) << std::endl;
+           return false;
+       }
+
+       int reuse = 1;
+       setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+       sockaddr_in address{};
+       address.sin_family = AF_INET;
+       address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+       address.sin_port = htons(static_cast<uint16_t>(http_port));
+
+       if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd, 8) < 0) {
+           std::cerr << "Error: Could not listen on 127.0.0.1:" << http_port << ": " << std::strerror(errno) << std::endl;
+           close(listen_fd);
+           listen_fd = -1;
+           return false;
+       }
+
+       return true;
+   }
+
+   // Answer one HTTP request with the current metrics
+   void serve_http_request() {
+       int client_fd = accept(listen_fd, nullptr, nullptr);
+       if (client_fd < 0) return;
+
+       // The request itself is irrelevant, every path returns the metrics
+       char request[1024];
+       pollfd client_poll{client_fd, POLLIN, 0};
+       if (poll(&client_poll, 1, 1000) > 0) {
+           (void)!read(client_fd, request, sizeof(request));
+       }
+
+       std::string body = render();
+       std::string response = "HTTP/1.0 200 OK\r\n"
+                              "Content-Type: text/plain; version=0.0.4\r\n"
+                              "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                              "Connection: close\r\n\r\n" + body;
+
+       size_t sent = 0;
+       while (sent < response.size()) {
+           ssize_t written = write(client_fd, response.data() + sent, response.size() - sent);
+           if (written <= 0) break;
+           sent += static_cast<size_t>(written);
+       }
+       close(client_fd);
+   }
+
+   // Rewrite the metrics file atomically so readers never see a partial file
+   void write_metrics_file() {
+       std::string temp_filename = metrics_filename + ".tmp";
+       {
+           std::ofstream metrics_file(temp_filename);
+           if (!metrics_file.is_open()) return;
+           metrics_file << render();
+       }
+       std::rename(temp_filename.c_str(), metrics_filename.c_str());
+   }
+
+   void run_loop() {
+       auto next_file_write = std::chrono::steady_clock::now();
+       auto interval = std::chrono::milliseconds(static_cast<int64_t>(interval_seconds * 1000));
+
+       while (running.load()) {
+           auto now = std::chrono::steady_clock::now();
+           if (!metrics_filename.empty() && now >= next_file_write) {
+               write_metrics_file();
+               next_file_write = now + interval;
+           }
+
+           // Sleep until the next file write, waking up early for HTTP scrapes
+           int timeout_ms = static_cast<int>(std::min<int64_t>(200,
+               std::chrono::duration_cast<std::chrono::milliseconds>(next_file_write - now).count()));
+           timeout_ms = std::max(timeout_ms, 10);
+
+           if (listen_fd >= 0) {
+               pollfd listen_poll{listen_fd, POLLIN, 0};
+               if (poll(&listen_poll, 1, timeout_ms) > 0) {
+                   serve_http_request();
+               }
+           } else {
+               std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+           }
+       }
+
+       // Leave the final state behind for post-mortem inspection
+       if (!metrics_filename.empty()) {
+           write_metrics_file();
+       }
+   }
+
+public:
+   static MetricsExporter& instance() {
+       static MetricsExporter exporter;
+       return exporter;
+   }
+
+   ~MetricsExporter() {
+       stop();
+   }
+
+   /**
+   * Starts exporting.
+   *
+   * @param filename File rewritten every interval (empty to disable)
+   * @param port Local HTTP port (0 to disable)
+   * @param interval File rewrite interval in seconds
+   * @return true if the exporter is running
+   */
+   bool start(const std::string& filename, int port, double interval) {
+       metrics_filename = filename;
+       http_port = port;
+       interval_seconds = std::max(interval, 0.1);
+
+       if (http_port > 0 && !open_http_socket()) {
+           return false;
+       }
+
+       running = true;
+       exporter_thread = std::thread(&MetricsExporter::run_loop, this);
+
+       if (!metrics_filename.empty()) {
+           std::cout << "Live metrics are written to: " << metrics_filename << std::endl;
+       }
+       if (listen_fd >= 0) {
+           std::cout << "Live metrics are served at: http://127.0.0.1:" << http_port << "/metrics" << std::endl;
+       }
+       return true;
+   }
+
+   void stop() {
+       if (running.exchange(false) && exporter_thread.joinable()) {
+           exporter_thread.join();
+       }
+       if (listen_fd >= 0) {
+           close(listen_fd);
+           listen_fd = -1;
+       }
+   }
+
+   // Make the counters of a running analysis visible next to those already attached
+   void attach(const RunMetrics& metrics, const std::string& name) {
+       std::lock_guard<std::mutex> lock(run_mutex);
+       unsigned number = 0;
+       while (std::any_of(runs.begin(), runs.end(), [number](const Run& run) { return run.number == number; })) {
+           number++;
+       }
+       Run run;
+       run.metrics = &metrics;
+       run.name = name;
+       run.number = number;
+       run.last_scrape_time = std::chrono::steady_clock::now();
+       runs.push_back(run);
+   }
+
+   // Must be called before the attached RunMetrics is destroyed; other runs stay attached
+   void detach(const RunMetrics& metrics) {
+       std::lock_guard<std::mutex> lock(run_mutex);
+       runs.erase(std::remove_if(runs.begin(), runs.end(), [&metrics](const Run& run) {
+           return run.metrics == &metrics;
+       }), runs.end());
+   }
+
+   /**
+   * Renders all metrics in Prometheus text exposition format, one series per
+   * attached run.
+   */
+   std::string render() {
+       std::lock_guard<std::mutex> lock(run_mutex);
+       std::stringstream out;
+
+       out << "# HELP btc_mapper_up Whether an analysis is running.\n"
+           << "# TYPE btc_mapper_up gauge\n"
+           << "btc_mapper_up " << (runs.empty() ? 0 : 1) << "\n"
+           << "# HELP btc_mapper_runs Analyses currently running.\n"
+           << "# TYPE btc_mapper_runs gauge\n"
+           << "btc_mapper_runs " << runs.size() << "\n";
+       if (runs.empty()) {
+           return out.str();
+       }
+
+       // Derive rates from the change since the previous scrape of each run
+       auto now = std::chrono::steady_clock::now();
+       for (Run& run : runs) {
+           double delta_seconds = std::chrono::duration<double>(now - run.last_scrape_time).count();
+           if (delta_seconds < 0.5) continue;
+
+           uint64_t pairs = run.metrics->pairs_processed.load(std::memory_order_relaxed);
+           run.throughput = (pairs - run.last_pairs_processed) / delta_seconds;
+           run.last_pairs_processed = pairs;
+
+           for (size_t i = 0; i < MAX_WORKER_THREADS; ++i) {
+               uint64_t busy = run.metrics->worker_busy_ns[i].load(std::memory_order_relaxed);
+               run.utilization[i] = std::min(1.0, (busy - run.last_worker_busy_ns[i]) / 1e9 / delta_seconds);
+               run.last_worker_busy_ns[i] = busy;
+           }
+           run.last_scrape_time = now;
+       }
+
+       auto labels = [](const Run& run) {
+           return "analysis=\"" + run.name + "\",run=\"" + std::to_string(run.number) + "\"";
+       };
+       auto series = [&](const char* name, const char* help, const char* type, auto value) {
+           out << "# HELP " << name << " " << help << "\n"
+               << "# TYPE " << name << " " << type << "\n";
+           for (const Run& run : runs) {
+               out << name << "{" << labels(run) << "} " << value(run) << "\n";
+           }
+       };
+       auto counter = [&](const char* name, const char* help, auto value) {
+           series(name, help, "counter", value);
+       };
+       auto gauge = [&](const char* name, const char* help, auto value) {
+           series(name, help, "gauge", value);
+       };
+
+       counter("btc_mapper_pairs_processed_total", "Partition pairs handed to workers.",
+               [](const Run& run) { return run.metrics->pairs_processed.load(); });
+       counter("btc_mapper_pairs_pruned_total", "Partition pairs rejected by value pruning.",
+               [](const Run& run) { return run.metrics->pruned_count.load(); });
+       counter("btc_mapper_pairs_checked_total", "Partition pairs whose permutations were checked.",
+               [](const Run& run) { return run.metrics->checked_count.load(); });
+       counter("btc_mapper_valid_mappings_total", "Valid mappings found.",
+               [](const Run& run) { return run.metrics->valid_count.load(); });
+       counter("btc_mapper_permutations_tested_total", "Group orderings tested.",
+               [](const Run& run) { return run.metrics->permutations_tested.load(); });
+       counter("btc_mapper_bytes_written_total", "Bytes written to the results file.",
+               [](const Run& run) { return run.metrics->bytes_written.load(); });
+
+       gauge("btc_mapper_throughput_pairs_per_second", "Pairs processed per second since the previous scrape.",
+             [](const Run& run) { return run.throughput; });
+       gauge("btc_mapper_queued_pairs", "Pairs dispatched to workers and not yet finished.",
+             [](const Run& run) { return static_cast<double>(run.metrics->queued_pairs.load()); });
+       gauge("btc_mapper_progress_ratio", "Estimated fraction of the analysis completed.",
+             [](const Run& run) { return run.metrics->progress.load(); });
+       gauge("btc_mapper_eta_seconds", "Estimated seconds until completion (-1 if unknown).",
+             [](const Run& run) { return run.metrics->eta_seconds.load(); });
+       gauge("btc_mapper_threads", "Worker threads used by the analysis.",
+             [](const Run& run) { return run.metrics->threads; });
+       gauge("btc_mapper_elapsed_seconds", "Seconds since the analysis started.",
+             [](const Run& run) { return elapsed_ns(run.metrics->start_time) / 1e9; });
+
+       out << "# HELP btc_mapper_worker_utilization_ratio Fraction of time each worker slot was busy since the previous scrape.\n"
+           << "# TYPE btc_mapper_worker_utilization_ratio gauge\n";
+       for (const Run& run : runs) {
+           for (unsigned int i = 0; i < std::min<unsigned int>(run.metrics->threads, MAX_WORKER_THREADS); ++i) {
+               out << "btc_mapper_worker_utilization_ratio{" << labels(run) << ",worker=\"" << i << "\"} "
+                   << run.utilization[i] << "\n";
+           }
+       }
+
+       return out.str();
+   }
+};
+
+#endif // METRICS_EXPORTER_H
@@ -15,13 +15,25 @@
 #include <cmath>    // For std::min
 #include <fstream>  // For file output
 #include <sstream>  // For string stream
+#include <memory_resource>
 #include "transaction_data.h"
 #include "subset_generator.h"
+#include "bell_number.h"
+#include "run_metrics.h"
+#include "trace_events.h"
+#include "metrics_exporter.h"
+#include "progress_model.h"
+#include "memory_budget.h"
+#include "scratch_arena.h"
+#include "partition_chunk.h"
+#include "dominance_kernel.h"
+#include "fixed_block_kernels.h"
+#include "partition_catalog.h"
+#include "mapping_sink.h"
+#include "worker_pool.h"
 
-// Memory-efficient type definitions
-using ElementIndex = uint16_t;
-using IndexSet = std::vector<ElementIndex>;
-using IndexPartition = std::vector<IndexSet>;
+// A pair of partitions with the same number of groups: positions in the input and output chunk
+using PartitionPair = std::pair<uint32_t, uint32_t>;
 
 /**
 * Struct to hold element mappings between strings and indices
@@ -62,13 +74,15 @@ struct ElementMapper {
 * Generates Bell triangle for efficient partition generation.
 * The Bell triangle is used to enumerate all partitions of a set.
 * 
+* Entries saturate at COUNT_SATURATED instead of overflowing.
+* 
 * @param n The size of the set
 * @return A 2D vector representing the Bell triangle
 */
-std::vector<std::vector<size_t>> generate_bell_triangle(size_t n) {
+std::vector<std::vector<count_t>> generate_bell_triangle(size_t n) {
    if (n == 0) return {};
    
-   std::vector<std::vector<size_t>> triangle(n);
+   std::vector<std::vector<count_t>> triangle(n);
    
    // First row is always [1]
    triangle[0] = {1};
@@ -82,7 +96,7 @@ std::vector<std::vector<size_t>> generate_bell_triangle(size_t n) {
        
        // Rest of the numbers in the row
        for (size_t j = 1; j <= i; ++j) {
-           triangle[i][j] = triangle[i][j-1] + triangle[i-1][j-1];
+           triangle[i][j] = saturating_add(triangle[i][j-1], triangle[i-1][j-1]);
        }
    }
    
@@ -90,112 +104,236 @@ std::vector<std::vector<size_t>> generate_bell_triangle(size_t n) {
 }
 
 /**
-* Class to generate partitions in chunks to reduce memory usage
+* Class to generate partitions in chunks to reduce memory usage.
+*
+* Partitions are enumerated as restricted growth strings: rgs[i] is the block of
+* element i, rgs[0] = 0 and rgs[i] <= 1 + max(rgs[0..i-1]). Stepping through these
+* strings in lexicographic order visits every partition exactly once, and the
+* generator only has to keep the current string between chunks, so a chunk can
+* have any size and the next one continues where the previous one stopped.
+* Blocks are ordered by their first element and elements ascend within a block.
+*
+* If the generator knows the element values, flat chunks also carry the value of
+* every block and the signature of every partition (see PartitionChunk). Sums are
+* accumulated in block order from 0.0, exactly as calculate_subset_value does.
+*
+* In GRAY_CODE order the strings follow a reflected Gray code instead (Kaye's
+* ordering): each digit sweeps its range 0..1+max(rgs[0..i-1]) and reverses
+* direction whenever a digit before it changes. Successive partitions then differ
+* by moving one element to another block, and the block masks and sums are
+* maintained incrementally instead of being recomputed for every partition (see
+* advance_gray). The partitions, their block order and sums are the same as in
+* lexicographic order; only the order of the partitions differs.
 */
+enum class PartitionOrder {
+   LEXICOGRAPHIC,
+   GRAY_CODE
+};
+
 class PartitionGenerator {
 private:
    std::vector<ElementIndex> elements;
+   std::vector<double> element_values;  // Indexed by ElementIndex; empty if unknown
+   PartitionOrder order;
+   std::vector<size_t> rgs;         // Block number of each element
+   std::vector<size_t> prefix_max;  // prefix_max[i] = max(rgs[0..i-1])
+   std::vector<ElementIndex> block_elements;  // Scratch for grouping elements by block
+   std::vector<uint32_t> block_ends;
    size_t current_idx;
    size_t max_partitions;
    size_t elements_size;
+   bool exhausted;
    
-   // Generate a chunk of partitions using iterative approach
-   std::vector<IndexPartition> generate_partitions_chunk(size_t chunk_size) {
-       std::vector<IndexPartition> result;
-       
-       if (elements.empty()) {
-           return result;
+   // State of the Gray code order
+   std::vector<int> directions;        // Sweep direction of each digit, +1 or -1
+   std::vector<uint64_t> block_masks;  // Bit i is set in the mask of the block of element i
+   std::vector<double> level_sums;     // [l * elements_size + b]: sum of block b over elements 0..l-1
+   std::vector<size_t> changed_blocks;
+   
+   // Build the partition described by the current restricted growth string
+   IndexPartition current_partition() const {
+       IndexPartition partition;
+       for (size_t i = 0; i < elements_size; ++i) {
+           if (rgs[i] == partition.size()) {
+               partition.emplace_back();
+           }
+           partition[rgs[i]].push_back(elements[i]);
        }
+       return partition;
+   }
+   
+   // Append the partition described by the current restricted growth string to a flat chunk
+   void append_current_partition(PartitionChunk& chunk) {
+       size_t block_count = 1 + std::max(prefix_max[elements_size - 1], rgs[elements_size - 1]);
        
-       if (elements.size() == 1) {
-           if (current_idx == 0) {
-               result.push_back({{elements[0]}});
-               current_idx = 1;
-           }
-           return result;
+       if (order == PartitionOrder::GRAY_CODE) {
+           append_gray_partition(chunk, block_count);
+           return;
        }
        
-       // Initialize with the first element in its own subset
-       std::vector<IndexPartition> current_level = {{{elements[0]}}};
+       // Counting sort of the elements by block, keeping element order within a block
+       std::fill(block_ends.begin(), block_ends.begin() + block_count + 1, 0);
+       for (size_t i = 0; i < elements_size; ++i) {
+           block_ends[rgs[i] + 1]++;
+       }
+       for (size_t b = 1; b <= block_count; ++b) {
+           block_ends[b] += block_ends[b - 1];
+       }
+       for (size_t i = 0; i < elements_size; ++i) {
+           block_elements[block_ends[rgs[i]]++] = elements[i];
+       }
        
-       // Process each remaining element
-       for (size_t i = 1; i < elements.size(); ++i) {
-           std::vector<IndexPartition> next_level;
-           
-           // For each partition at the current level
-           for (const auto& partition : current_level) {
-               // Option 1: Add the element to each existing subset
-               for (size_t j = 0; j < partition.size(); ++j) {
-                   IndexPartition new_partition = partition;
-                   new_partition[j].push_back(elements[i]);
-                   next_level.push_back(new_partition);
-                   
-                   // If we've reached our chunk size, return what we have
-                   if (result.size() + next_level.size() >= chunk_size) {
-                       result.insert(result.end(), next_level.begin(), next_level.end());
-                       current_idx += result.size();
-                       return result;
-                   }
+       // block_ends[b] is now the end of block b
+       uint32_t block_start = 0;
+       for (size_t b = 0; b < block_count; ++b) {
+           auto first = block_elements.begin() + block_start;
+           auto last = block_elements.begin() + block_ends[b];
+           if (element_values.empty()) {
+               chunk.add_block(first, last);
+           } else {
+               double sum = 0.0;
+               for (auto it = first; it != last; ++it) {
+                   sum += element_values[*it];
                }
-               
-               // Option 2: Create a new subset with just this element
-               IndexPartition new_partition = partition;
-               new_partition.push_back({elements[i]});
-               next_level.push_back(new_partition);
-               
-               // If we've reached our chunk size, return what we have
-               if (result.size() + next_level.size() >= chunk_size) {
-                   result.insert(result.end(), next_level.begin(), next_level.end());
-                       current_idx += result.size();
-                       return result;
-                   }
+               chunk.add_block(first, last, sum);
+           }
+           block_start = block_ends[b];
+       }
+       chunk.end_partition();
+   }
+   
+   // Step to the lexicographically next restricted growth string
+   bool advance() {
+       for (size_t i = elements_size; i-- > 1;) {
+           if (rgs[i] <= prefix_max[i]) {
+               rgs[i]++;
+               size_t block_max = std::max(prefix_max[i], rgs[i]);
+               for (size_t j = i + 1; j < elements_size; ++j) {
+                   rgs[j] = 0;
+                   prefix_max[j] = block_max;
                }
-           
-           // Move to the next level
-           current_level = std::move(next_level);
+               return true;
+           }
        }
-       
-       // Add all partitions from the final level
-       result.insert(result.end(), current_level.begin(), current_level.end());
-       current_idx += result.size();
-       
-       return result;
+       return false;
    }
    
-public:
-   PartitionGenerator(const std::vector<ElementIndex>& elems) 
-       : elements(elems), current_idx(0), elements_size(elems.size()) {
-       // Calculate Bell number to know total partitions
-       std::vector<size_t> bell_numbers(elements_size + 1, 0);
-       bell_numbers[0] = 1;
+   // Append the current partition from the maintained block masks and sums
+   void append_gray_partition(PartitionChunk& chunk, size_t block_count) {
+       const double* sums = level_sums.data() + elements_size * elements_size;
+       for (size_t b = 0; b < block_count; ++b) {
+           size_t count = 0;
+           for (uint64_t bits = block_masks[b]; bits != 0; bits &= bits - 1) {
+               block_elements[count++] = elements[__builtin_ctzll(bits)];
+           }
+           if (element_values.empty()) {
+               chunk.add_block(block_elements.begin(), block_elements.begin() + count);
+           } else {
+               chunk.add_block(block_elements.begin(), block_elements.begin() + count, sums[b]);
+           }
+       }
+       chunk.end_partition();
+   }
+   
+   // Move element i to block b, recording both blocks as changed
+   void move_element(size_t i, size_t b) {
+       block_masks[rgs[i]] ^= 1ULL << i;
+       block_masks[b] ^= 1ULL << i;
+       changed_blocks.push_back(rgs[i]);
+       changed_blocks.push_back(b);
+       rgs[i] = b;
+   }
+   
+   /**
+   * Step to the next restricted growth string in Gray code order: the last digit
+   * that can still move in its direction moves one step, every later digit reverses
+   * direction and stays where it is as a set partition. A later digit sitting on
+   * "new block" is relabeled to the new 1 + max of its prefix, which does not move
+   * its element either.
+   *
+   * Block sums are kept per prefix length, level_sums[l][b] being the sum of block
+   * b over elements 0..l-1, so that every sum is still accumulated in element order
+   * from 0.0. Only the blocks whose members changed are updated on the levels after
+   * the moved digit. The last digit moves in most steps and touches two blocks on
+   * one level; a digit d places from the end moves in at most one of 2^d steps, so
+   * the work per step is constant on average.
+   */
+   bool advance_gray() {
+       size_t moving = 0;
+       for (size_t i = elements_size; i-- > 1;) {
+           if (directions[i] > 0 ? rgs[i] <= prefix_max[i] : rgs[i] > 0) {
+               moving = i;
+               break;
+           }
+       }
+       if (moving == 0) {
+           return false;
+       }
        
-       for (size_t i = 1; i <= elements_size; ++i) {
-           bell_numbers[i] = 0;
-           for (size_t j = 0; j < i; ++j) {
-               bell_numbers[i] += bell_numbers[j] * binomial_coefficient(i - 1, j);
+       changed_blocks.clear();
+       move_element(moving, rgs[moving] + directions[moving]);
+       for (size_t j = moving + 1; j < elements_size; ++j) {
+           directions[j] = -directions[j];
+           prefix_max[j] = std::max(prefix_max[j - 1], rgs[j - 1]);
+           // Digits that finished a forward sweep sit on "new block"
+           if (directions[j] < 0 && rgs[j] != prefix_max[j] + 1) {
+               move_element(j, prefix_max[j] + 1);
            }
        }
        
-       max_partitions = bell_numbers[elements_size];
+       if (!element_values.empty()) {
+           for (size_t l = moving + 1; l <= elements_size; ++l) {
+               const double* previous = level_sums.data() + (l - 1) * elements_size;
+               double* current = level_sums.data() + l * elements_size;
+               for (size_t b : changed_blocks) {
+                   current[b] = previous[b];
+                   if (rgs[l - 1] == b) {
+                       current[b] += element_values[elements[l - 1]];
+                   }
+               }
+           }
+       }
+       return true;
    }
    
-   // Helper function to calculate binomial coefficient
-   size_t binomial_coefficient(size_t n, size_t k) {
-       if (k > n) return 0;
-       if (k == 0 || k == n) return 1;
+   bool step() {
+       return order == PartitionOrder::GRAY_CODE ? advance_gray() : advance();
+   }
+   
+   // Generate the next chunk of partitions, resuming from the current state
+   std::vector<IndexPartition> generate_partitions_chunk(size_t chunk_size) {
+       std::vector<IndexPartition> result;
+       result.reserve(std::min(chunk_size, max_partitions - current_idx));
        
-       size_t result = 1;
-       for (size_t i = 1; i <= k; ++i) {
-           result *= (n - (k - i));
-           result /= i;
+       while (!exhausted && result.size() < chunk_size) {
+           result.push_back(current_partition());
+           current_idx++;
+           exhausted = !step();
        }
        
        return result;
    }
    
+public:
+   /**
+   * @param elems The elements to partition
+   * @param values Value of each element, indexed by ElementIndex; empty if chunks carry no values
+   * @param partition_order Order of the partitions; GRAY_CODE needs at most 64 elements
+   *                        and falls back to LEXICOGRAPHIC otherwise
+   */
+   PartitionGenerator(const std::vector<ElementIndex>& elems, std::vector<double> values = {},
+                      PartitionOrder partition_order = PartitionOrder::LEXICOGRAPHIC)
+       : elements(elems), element_values(std::move(values)),
+         order(elems.size() <= 64 ? partition_order : PartitionOrder::LEXICOGRAPHIC),
+         current_idx(0), elements_size(elems.size()) {
+       // Bell number from the shared table to know total partitions
+       max_partitions = saturate_to_size(bell_number(elements_size));
+       reset();
+   }
+   
    // Check if more partitions are available
    bool has_more() const {
-       return current_idx < max_partitions;
+       return !exhausted;
    }
    
    // Get next chunk of partitions
@@ -207,9 +345,43 @@ public:
        return generate_partitions_chunk(chunk_size);
    }
    
+   // Replace the contents of a flat chunk with the next chunk of partitions
+   void next_chunk(size_t chunk_size, PartitionChunk& chunk) {
+       chunk.clear();
+       chunk.reserve(std::min(chunk_size, max_partitions - current_idx), elements_size);
+       if (!element_values.empty()) {
+           chunk.reserve_values(std::min(chunk_size, max_partitions - current_idx), elements_size);
+       }
+       
+       while (!exhausted && chunk.size() < chunk_size) {
+           append_current_partition(chunk);
+           current_idx++;
+           exhausted = !step();
+       }
+   }
+   
    // Reset the generator
    void reset() {
+       rgs.assign(elements_size, 0);
+       prefix_max.assign(elements_size, 0);
+       block_elements.assign(elements_size, 0);
+       block_ends.assign(elements_size + 1, 0);
        current_idx = 0;
+       exhausted = elements.empty();
+       
+       if (order == PartitionOrder::GRAY_CODE && !exhausted) {
+           // All elements start in block 0 and every digit sweeps forward
+           directions.assign(elements_size, 1);
+           block_masks.assign(elements_size, 0);
+           block_masks[0] = elements_size == 64 ? ~0ULL : (1ULL << elements_size) - 1;
+           changed_blocks.reserve(2 * elements_size);
+           if (!element_values.empty()) {
+               level_sums.assign((elements_size + 1) * elements_size, 0.0);
+               for (size_t l = 1; l <= elements_size; ++l) {
+                   level_sums[l * elements_size] = level_sums[(l - 1) * elements_size] + element_values[elements[l - 1]];
+               }
+           }
+       }
    }
    
    // Get total number of partitions
@@ -223,10 +395,127 @@ public:
    }
 };
 
+/**
+* Sums the values of each block of a partition into a vector allocated from the given
+* memory resource. Elements are added in block order starting from 0.0, exactly as
+* calculate_subset_value does, so the sums are bit-identical to it.
+* 
+* @param element_values Value of each element, indexed by ElementIndex
+* @param partition A partition of input or output indices (IndexPartition or PartitionView)
+* @param resource Memory resource for the result, normally a ScratchArena
+* @return The value of each block
+*/
+template <typename Partition>
+std::pmr::vector<double> partition_block_values(
+   const std::vector<double>& element_values,
+   const Partition& partition,
+   std::pmr::memory_resource* resource
+) {
+   std::pmr::vector<double> values(resource);
+   values.reserve(partition.size());
+   
+   for (size_t b = 0; b < partition.size(); ++b) {
+       double total = 0.0;
+       for (ElementIndex idx : partition[b]) {
+           total += element_values[idx];
+       }
+       values.push_back(total);
+   }
+   
+   return values;
+}
+
+/**
+* Value-based pruning on precomputed signatures (block values sorted in descending
+* order): a pair can only have a valid mapping if no output value exceeds the input
+* value at the same position.
+* 
+* @param input_signature Sorted values of the input groups
+* @param output_signature Sorted values of the output groups
+* @return true if the partition pair might be valid, false if it's definitely invalid
+*/
+template <typename Signature>
+bool signatures_compatible(const Signature& input_signature, const Signature& output_signature) {
+   if (input_signature.size() != output_signature.size()) {
+       return false;
+   }
+   
+   for (size_t i = 0; i < output_signature.size(); ++i) {
+       if (output_signature[i] > input_signature[i]) {
+           // This partition pair can never be valid, no matter the permutation
+           return false;
+       }
+   }
+   
+   return true;
+}
+
+/**
+* Value-based pruning on precomputed block values: a pair can only have a valid mapping
+* if, with both value lists sorted in descending order, no output value exceeds the
+* input value at the same position.
+* 
+* @param input_values Value of each input group
+* @param output_values Value of each output group
+* @param resource Memory resource for the sorted copies
+* @return true if the partition pair might be valid, false if it's definitely invalid
+*/
+bool could_have_valid_mapping(
+   const std::pmr::vector<double>& input_values,
+   const std::pmr::vector<double>& output_values,
+   std::pmr::memory_resource* resource
+) {
+   if (input_values.size() != output_values.size()) {
+       return false;
+   }
+   
+   // Up to MAX_FIXED_BLOCKS groups, sort copies on the stack with a sorting network
+   if (input_values.size() <= MAX_FIXED_BLOCKS) {
+       std::array<double, MAX_FIXED_BLOCKS> sorted_inputs;
+       std::array<double, MAX_FIXED_BLOCKS> sorted_outputs;
+       std::copy(input_values.begin(), input_values.end(), sorted_inputs.begin());
+       std::copy(output_values.begin(), output_values.end(), sorted_outputs.begin());
+       sort_descending(sorted_inputs.data(), sorted_inputs.data() + input_values.size());
+       sort_descending(sorted_outputs.data(), sorted_outputs.data() + output_values.size());
+       return signatures_compatible(ValuesView{sorted_inputs.data(), sorted_inputs.data() + input_values.size()},
+                                    ValuesView{sorted_outputs.data(), sorted_outputs.data() + output_values.size()});
+   }
+   
+   std::pmr::vector<double> sorted_inputs(input_values.begin(), input_values.end(), resource);
+   std::pmr::vector<double> sorted_outputs(output_values.begin(), output_values.end(), resource);
+   sort_descending(sorted_inputs.data(), sorted_inputs.data() + sorted_inputs.size());
+   sort_descending(sorted_outputs.data(), sorted_outputs.data() + sorted_outputs.size());
+   return signatures_compatible(sorted_inputs, sorted_outputs);
+}
+
 /**
 * Performs value-based pruning to quickly determine if a partition pair could possibly be valid.
 * Sorts group values in descending order and checks if any output group exceeds its corresponding input group.
 * 
+* @param values The transaction values indexed by element index
+* @param input_partition A partition of input indices
+* @param output_partition A partition of output indices
+* @return true if the partition pair might be valid, false if it's definitely invalid
+*/
+bool could_have_valid_mapping(
+   const TransactionValues& values,
+   const IndexPartition& input_partition,
+   const IndexPartition& output_partition
+) {
+   // If the number of groups doesn't match, no valid mapping is possible
+   if (input_partition.size() != output_partition.size()) {
+       return false;
+   }
+   
+   ScratchArena<> arena;
+   auto input_values = partition_block_values(values.inputs(), input_partition, arena.get());
+   auto output_values = partition_block_values(values.outputs(), output_partition, arena.get());
+   return could_have_valid_mapping(input_values, output_values, arena.get());
+}
+
+/**
+* Overloaded version that looks the values up in the transaction data.
+* 
 * @param tx_data The transaction data
 * @param input_partition A partition of input indices
 * @param output_partition A partition of output indices
@@ -240,51 +529,45 @@ bool could_have_valid_mapping(
    const IndexPartition& output_partition,
    const ElementMapper& input_mapper,
    const ElementMapper& output_mapper
+) {
+   return could_have_valid_mapping(TransactionValues(tx_data), input_partition, output_partition);
+}
+
+/**
+* Checks if a specific mapping between input and output partition groups is valid.
+* Uses indices for memory efficiency.
+* 
+* @param values The transaction values indexed by element index
+* @param input_partition A partition of input indices
+* @param output_partition A partition of output indices
+* @return true if the mapping is valid, false otherwise
+*/
+bool is_valid_mapping(
+   const TransactionValues& values,
+   const IndexPartition& input_partition,
+   const IndexPartition& output_partition
 ) {
    // If the number of groups doesn't match, no valid mapping is possible
    if (input_partition.size() != output_partition.size()) {
        return false;
    }
    
-   // Calculate and store the value of each input group
-   std::vector<double> input_values;
-   input_values.reserve(input_partition.size());
-   
-   for (const auto& group : input_partition) {
-       auto input_set = input_mapper.to_string_set(group);
-       double group_value = calculate_subset_value(tx_data, input_set, SubsetType::INPUTS);
-       input_values.push_back(group_value);
-   }
-   
-   // Calculate and store the value of each output group
-   std::vector<double> output_values;
-   output_values.reserve(output_partition.size());
-   
-   for (const auto& group : output_partition) {
-       auto output_set = output_mapper.to_string_set(group);
-       double group_value = calculate_subset_value(tx_data, output_set, SubsetType::OUTPUTS);
-       output_values.push_back(group_value);
-   }
-   
-   // Sort both value lists in descending order
-   std::sort(input_values.begin(), input_values.end(), std::greater<double>());
-   std::sort(output_values.begin(), output_values.end(), std::greater<double>());
+   ScratchArena<> arena;
+   auto input_values = partition_block_values(values.inputs(), input_partition, arena.get());
+   auto output_values = partition_block_values(values.outputs(), output_partition, arena.get());
    
-   // Check if any output group value exceeds its corresponding input group value
-   for (size_t i = 0; i < output_values.size(); ++i) {
+   // If any output group exceeds its input group, the mapping is invalid
+   for (size_t i = 0; i < input_values.size(); ++i) {
        if (output_values[i] > input_values[i]) {
-           // This partition pair can never be valid, no matter the permutation
            return false;
        }
    }
    
-   // This partition pair might have valid mappings
    return true;
 }
 
 /**
-* Checks if a specific mapping between input and output partition groups is valid.
-* Uses indices for memory efficiency.
+* Overloaded version that looks the values up in the transaction data.
 * 
 * @param tx_data The transaction data
 * @param input_partition A partition of input indices
@@ -300,63 +583,43 @@ bool is_valid_mapping(
    const ElementMapper& input_mapper,
    const ElementMapper& output_mapper
 ) {
-   // If the number of groups doesn't match, no valid mapping is possible
-   if (input_partition.size() != output_partition.size()) {
-       return false;
-   }
-   
-   // Check each group pair
-   for (size_t i = 0; i < input_partition.size(); ++i) {
-       // Convert index sets to string sets for value calculation
-       auto input_set = input_mapper.to_string_set(input_partition[i]);
-       auto output_set = output_mapper.to_string_set(output_partition[i]);
-       
-       double input_value = calculate_subset_value(tx_data, input_set, SubsetType::INPUTS);
-       double output_value = calculate_subset_value(tx_data, output_set, SubsetType::OUTPUTS);
-       
-       // If any output group exceeds its input group, the mapping is invalid
-       if (output_value > input_value) {
-           return false;
-       }
-   }
-   
-   return true;
+   return is_valid_mapping(TransactionValues(tx_data), input_partition, output_partition);
 }
 
 /**
-* Formats a mapping for CSV output
+* Formats a mapping for CSV output from the group values. Input group i is mapped to
+* output group indices[i]; string IDs are only looked up here.
 * 
-* @param tx_data The transaction data
-* @param input_partition A partition of input indices
+* @param input_partition A partition of input indices (IndexPartition or PartitionView)
 * @param output_partition A partition of output indices
-* @param indices Permutation indices
+* @param input_values Value of each input group
+* @param output_values Value of each output group
+* @param indices Output group of each input group
 * @param input_mapper Mapper for input elements
 * @param output_mapper Mapper for output elements
 * @param mapping_idx The index of this mapping
 * @return A string containing the CSV-formatted mapping
 */
+template <typename Partition, typename Values, typename Indices>
 std::string format_mapping_for_csv(
-   const TransactionData& tx_data,
-   const IndexPartition& input_partition,
-   const IndexPartition& output_partition,
-   const std::vector<size_t>& indices,
+   const Partition& input_partition,
+   const Partition& output_partition,
+   const Values& input_values,
+   const Values& output_values,
+   const Indices& indices,
    const ElementMapper& input_mapper,
    const ElementMapper& output_mapper,
    size_t mapping_idx
 ) {
    std::stringstream ss;
    
-   // Convert index partitions back to string partitions for output
-   auto input_string_partition = input_mapper.to_string_partition(input_partition);
-   auto output_string_partition = output_mapper.to_string_partition(output_partition);
-   
    // Calculate total values
    double total_input = 0.0;
    double total_output = 0.0;
    
-   for (size_t i = 0; i < input_string_partition.size(); ++i) {
-       total_input += calculate_subset_value(tx_data, input_string_partition[i], SubsetType::INPUTS);
-       total_output += calculate_subset_value(tx_data, output_string_partition[i], SubsetType::OUTPUTS);
+   for (size_t i = 0; i < input_partition.size(); ++i) {
+       total_input += input_values[i];
+       total_output += output_values[indices[i]];
    }
    
    // Write mapping header
@@ -366,39 +629,33 @@ std::string format_mapping_for_csv(
    ss << total_output << ",";
    ss << (total_input - total_output) << "\n";
    
-   // Write each group mapping
-   for (size_t i = 0; i < input_string_partition.size(); ++i) {
-       double input_value = calculate_subset_value(tx_data, input_string_partition[i], SubsetType::INPUTS);
-       double output_value = calculate_subset_value(tx_data, output_string_partition[i], SubsetType::OUTPUTS);
-       double difference = input_value - output_value;
-       
-       // Group number
-       ss << mapping_idx << "," << i << ",";
-       
-       // Input group
+   // Quoted, comma separated IDs of a group
+   auto write_group = [&ss](const auto& group, const ElementMapper& mapper) {
        ss << "\"";
-       for (size_t j = 0; j < input_string_partition[i].size(); ++j) {
-           ss << input_string_partition[i][j];
-           if (j < input_string_partition[i].size() - 1) {
+       for (size_t j = 0; j < group.size(); ++j) {
+           ss << mapper.elements[group[j]];
+           if (j < group.size() - 1) {
                ss << ",";
            }
        }
        ss << "\",";
+   };
+   
+   // Write each group mapping
+   for (size_t i = 0; i < input_partition.size(); ++i) {
+       double input_value = input_values[i];
+       double output_value = output_values[indices[i]];
+       double difference = input_value - output_value;
        
-       // Input value
-       ss << input_value << ",";
+       // Group number
+       ss << mapping_idx << "," << i << ",";
        
-       // Output group
-       ss << "\"";
-       for (size_t j = 0; j < output_string_partition[i].size(); ++j) {
-           ss << output_string_partition[i][j];
-           if (j < output_string_partition[i].size() - 1) {
-               ss << ",";
-           }
-       }
-       ss << "\",";
+       // Input group and value
+       write_group(input_partition[i], input_mapper);
+       ss << input_value << ",";
        
-       // Output value and difference
+       // Output group, value and difference
+       write_group(output_partition[indices[i]], output_mapper);
        ss << output_value << "," << difference << "\n";
    }
    
@@ -406,122 +663,401 @@ std::string format_mapping_for_csv(
 }
 
 /**
-* Generates all permutations of a partition and checks each one for validity.
-* Writes valid mappings directly to file.
+* Formats a mapping for CSV output
 * 
 * @param tx_data The transaction data
 * @param input_partition A partition of input indices
 * @param output_partition A partition of output indices
+* @param indices Output group of each input group
 * @param input_mapper Mapper for input elements
 * @param output_mapper Mapper for output elements
-* @param valid_count Reference to the counter for valid mappings
-* @param file_mutex Mutex for thread-safe file access
-* @param output_file Reference to the output file stream
+* @param mapping_idx The index of this mapping
+* @return A string containing the CSV-formatted mapping
 */
-void check_all_permutations(
+std::string format_mapping_for_csv(
    const TransactionData& tx_data,
    const IndexPartition& input_partition,
-   IndexPartition output_partition,
+   const IndexPartition& output_partition,
+   const std::vector<size_t>& indices,
+   const ElementMapper& input_mapper,
+   const ElementMapper& output_mapper,
+   size_t mapping_idx
+) {
+   TransactionValues values(tx_data);
+   ScratchArena<> arena;
+   auto input_values = partition_block_values(values.inputs(), input_partition, arena.get());
+   auto output_values = partition_block_values(values.outputs(), output_partition, arena.get());
+   return format_mapping_for_csv(input_partition, output_partition, input_values, output_values, indices,
+                                 input_mapper, output_mapper, mapping_idx);
+}
+
+/**
+* Counts a valid mapping and, if the sink wants mappings, formats it and writes it
+* to the sink.
+* 
+* @param input_partition A partition of input indices
+* @param output_partition A partition of output indices
+* @param input_values Value of each input group
+* @param output_values Value of each output group
+* @param indices Output group of each input group
+* @param input_mapper Mapper for input elements
+* @param output_mapper Mapper for output elements
+* @param valid_count Reference to the counter for valid mappings
+* @param file_mutex Mutex for thread-safe file access
+* @param sink Destination of the CSV rows of valid mappings
+* @param counters Per-thread accumulator for formatting and I/O statistics
+*/
+template <typename Partition, typename Values, typename Indices>
+void record_valid_mapping(
+   const Partition& input_partition,
+   const Partition& output_partition,
+   const Values& input_values,
+   const Values& output_values,
+   const Indices& indices,
+   const ElementMapper& input_mapper,
+   const ElementMapper& output_mapper,
+   std::atomic<size_t>& valid_count,
+   std::mutex& file_mutex,
+   MappingSink& sink,
+   PhaseCounters& counters
+) {
+   // Increment the atomic counter
+   size_t current_count = valid_count.fetch_add(1) + 1;
+   
+   if (!sink.wants_mappings()) {
+       return;
+   }
+   
+   // Format the mapping for CSV output
+   auto format_start = std::chrono::steady_clock::now();
+   std::string csv_data;
+   {
+       TraceScope trace("format_mapping");
+       csv_data = format_mapping_for_csv(
+           input_partition, 
+           output_partition, 
+           input_values,
+           output_values,
+           indices, 
+           input_mapper, 
+           output_mapper,
+           current_count
+       );
+   }
+   counters.formatting_ns += elapsed_ns(format_start);
+   
+   // Write to file with mutex protection
+   auto io_start = std::chrono::steady_clock::now();
+   {
+       std::unique_lock<std::mutex> lock(file_mutex, std::defer_lock);
+       {
+           TraceScope trace("file_mutex_wait");
+           lock.lock();
+       }
+       
+       TraceScope trace("file_write");
+       sink.write(csv_data);
+   }
+   counters.io_wait_ns += elapsed_ns(io_start);
+   counters.bytes_written += csv_data.size();
+}
+
+/**
+* Checks every assignment of output groups to input groups of one partition pair
+* with K groups, using the compile-time permutation table (for_each_valid_permutation).
+*/
+template <size_t K, typename Partition, typename Values>
+void check_all_permutations_fixed(
+   const Partition& input_partition,
+   const Partition& output_partition,
+   const Values& input_values,
+   const Values& output_values,
+   const ElementMapper& input_mapper,
+   const ElementMapper& output_mapper,
+   std::atomic<size_t>& valid_count,
+   std::mutex& file_mutex,
+   MappingSink& sink,
+   PhaseCounters& counters
+) {
+   counters.permutations_tested += for_each_valid_permutation<K>(input_values, output_values, [&](const auto& indices) {
+       record_valid_mapping(input_partition, output_partition, input_values, output_values, indices,
+                            input_mapper, output_mapper, valid_count, file_mutex, sink, counters);
+   });
+}
+
+/**
+* Checks every assignment of output groups to input groups of one partition pair of
+* any size. Assignments are permutations of an index array from the scratch memory
+* resource, visited with std::next_permutation.
+*/
+template <typename Partition, typename Values>
+void check_all_permutations_generic(
+   const Partition& input_partition,
+   const Partition& output_partition,
+   const Values& input_values,
+   const Values& output_values,
    const ElementMapper& input_mapper,
    const ElementMapper& output_mapper,
    std::atomic<size_t>& valid_count,
    std::mutex& file_mutex,
-   std::ofstream& output_file
+   MappingSink& sink,
+   PhaseCounters& counters,
+   std::pmr::memory_resource* resource
 ) {
    // Create indices for permutation
-   std::vector<size_t> indices(output_partition.size());
+   std::pmr::vector<size_t> indices(output_partition.size(), resource);
    for (size_t i = 0; i < indices.size(); ++i) {
        indices[i] = i;
    }
    
    // Generate all permutations of indices
    do {
-       // Create permuted output partition
-       IndexPartition permuted_output;
-       permuted_output.resize(output_partition.size());
+       counters.permutations_tested++;
        
+       // Check if this mapping is valid: no output group may exceed its input group
+       bool valid = true;
        for (size_t i = 0; i < indices.size(); ++i) {
-           permuted_output[i] = output_partition[indices[i]];
+           if (output_values[indices[i]] > input_values[i]) {
+               valid = false;
+               break;
+           }
+       }
+       if (valid) {
+           record_valid_mapping(input_partition, output_partition, input_values, output_values, indices,
+                                input_mapper, output_mapper, valid_count, file_mutex, sink, counters);
+       }
+   } while (std::next_permutation(indices.begin(), indices.end()));
+}
+
+/**
+* Checks every assignment of output groups to input groups of one partition pair,
+* given the precomputed group values. Pairs with up to MAX_FIXED_BLOCKS groups use the
+* kernel specialized for their group count, larger pairs the generic one; both visit
+* the assignments in the same order. If the sink does not want mappings, valid
+* mappings are only counted.
+* 
+* @param input_partition A partition of input indices
+* @param output_partition A partition of output indices
+* @param input_values Value of each input group (a vector or the block sums of a chunk)
+* @param output_values Value of each output group
+* @param input_mapper Mapper for input elements
+* @param output_mapper Mapper for output elements
+* @param valid_count Reference to the counter for valid mappings
+* @param file_mutex Mutex for thread-safe file access
+* @param sink Destination of the CSV rows of valid mappings
+* @param counters Per-thread accumulator for permutation, formatting and I/O statistics
+* @param resource Memory resource for the permutation indices of the generic kernel
+*/
+template <typename Partition, typename Values>
+void check_all_permutations(
+   const Partition& input_partition,
+   const Partition& output_partition,
+   const Values& input_values,
+   const Values& output_values,
+   const ElementMapper& input_mapper,
+   const ElementMapper& output_mapper,
+   std::atomic<size_t>& valid_count,
+   std::mutex& file_mutex,
+   MappingSink& sink,
+   PhaseCounters& counters,
+   std::pmr::memory_resource* resource
+) {
+   bool fixed = with_fixed_block_count(output_partition.size(), [&](auto k) {
+       check_all_permutations_fixed<decltype(k)::value>(input_partition, output_partition, input_values, output_values,
+                                                        input_mapper, output_mapper, valid_count, file_mutex,
+                                                        sink, counters);
+   });
+   
+   if (!fixed) {
+       check_all_permutations_generic(input_partition, output_partition, input_values, output_values,
+                                      input_mapper, output_mapper, valid_count, file_mutex, sink,
+                                      counters, resource);
+   }
+}
+
+/**
+* Generates all permutations of a partition and checks each one for validity.
+* Writes valid mappings directly to file. If the sink does not want mappings, valid
+* mappings are only counted.
+* 
+* @param values The transaction values indexed by element index
+* @param input_partition A partition of input indices
+* @param output_partition A partition of output indices
+* @param input_mapper Mapper for input elements
+* @param output_mapper Mapper for output elements
+* @param valid_count Reference to the counter for valid mappings
+* @param file_mutex Mutex for thread-safe file access
+* @param sink Destination of the CSV rows of valid mappings
+* @param counters Per-thread accumulator for permutation, formatting and I/O statistics
+*/
+void check_all_permutations(
+   const TransactionValues& values,
+   const IndexPartition& input_partition,
+   const IndexPartition& output_partition,
+   const ElementMapper& input_mapper,
+   const ElementMapper& output_mapper,
+   std::atomic<size_t>& valid_count,
+   std::mutex& file_mutex,
+   MappingSink& sink,
+   PhaseCounters& counters
+) {
+   ScratchArena<> arena;
+   auto input_values = partition_block_values(values.inputs(), input_partition, arena.get());
+   auto output_values = partition_block_values(values.outputs(), output_partition, arena.get());
+   check_all_permutations(input_partition, output_partition, input_values, output_values,
+                          input_mapper, output_mapper, valid_count, file_mutex, sink, counters, arena.get());
+}
+
+/**
+* Overloaded version that looks the values up in the transaction data.
+*/
+void check_all_permutations(
+   const TransactionData& tx_data,
+   const IndexPartition& input_partition,
+   const IndexPartition& output_partition,
+   const ElementMapper& input_mapper,
+   const ElementMapper& output_mapper,
+   std::atomic<size_t>& valid_count,
+   std::mutex& file_mutex,
+   MappingSink& sink,
+   PhaseCounters& counters
+) {
+   check_all_permutations(TransactionValues(tx_data), input_partition, output_partition, input_mapper, output_mapper,
+                          valid_count, file_mutex, sink, counters);
+}
+
+/**
+* Value-based pruning of all pairs of an input chunk and an output chunk. For every
+* input partition, the output signatures with the same number of groups are looked
+* up in their dominance index: only the prefix whose largest block sum does not
+* exceed the input's is considered, buckets are decided from their bounds where
+* possible, and the dominance kernel tests the remaining buckets at once and returns
+* a bitmask of the survivors; only those become pairs.
+* 
+* @param input_chunk The chunk of input partitions
+* @param output_tables Signatures of the output chunk, indexed by number of groups
+* @param partition_pairs Vector the surviving pairs are appended to
+* @param mask Scratch for the kernel's bitmask, reused across calls
+* @return Number of pairs with matching group counts that were tested
+*/
+size_t prune_partition_pairs(
+   const PartitionChunk& input_chunk,
+   const std::vector<SignatureTable>& output_tables,
+   std::vector<PartitionPair>& partition_pairs,
+   std::vector<uint64_t>& mask
+) {
+   DominanceKernel kernel = dominance_kernel();
+   size_t tested = 0;
+   
+   for (size_t i = 0; i < input_chunk.size(); ++i) {
+       size_t k = input_chunk.group_count(i);
+       if (k >= output_tables.size() || output_tables[k].size() == 0) {
+           continue;
        }
        
-       // Check if this mapping is valid
-       if (is_valid_mapping(tx_data, input_partition, permuted_output, input_mapper, output_mapper)) {
-           // Increment the atomic counter
-           size_t current_count = valid_count.fetch_add(1) + 1;
-           
-           // Format the mapping for CSV output
-           std::string csv_data = format_mapping_for_csv(
-               tx_data, 
-               input_partition, 
-               permuted_output, 
-               indices, 
-               input_mapper, 
-               output_mapper,
-               current_count
-           );
+       const SignatureTable& table = output_tables[k];
+       const double* input_signature = input_chunk[i].signature().begin();
+       mask.resize(dominance_mask_words(table));
+       tested += table.size();
+       
+       // Buckets past the candidates fail on the largest block alone
+       size_t candidate_words = (table.candidate_count(input_signature[0]) + 63) / 64;
+       for (size_t word = 0; word < candidate_words; ++word) {
+           switch (bucket_bound(input_signature, table, word)) {
+               case BucketBound::NONE_PASS:
+                   continue;
+               case BucketBound::ALL_PASS:
+                   mask[word] = ~0ULL;
+                   clear_padding_bits(table, word + 1, mask.data());
+                   break;
+               case BucketBound::UNDECIDED:
+                   kernel(input_signature, table, word, word + 1, mask.data());
+                   break;
+           }
            
-           // Write to file with mutex protection
-           {
-               std::lock_guard<std::mutex> lock(file_mutex);
-               output_file << csv_data;
-               output_file.flush(); // Ensure data is written immediately
+           for (uint64_t bits = mask[word]; bits != 0; bits &= bits - 1) {
+               size_t p = word * 64 + __builtin_ctzll(bits);
+               partition_pairs.emplace_back(static_cast<uint32_t>(i), table.position(p));
            }
        }
-   } while (std::next_permutation(indices.begin(), indices.end()));
+   }
+   
+   return tested;
 }
 
 /**
 * Processes a batch of partition pairs in parallel.
-* Uses indices for memory efficiency.
+* Pairs are positions in the chunks held by the coordinator and have already passed
+* value-based pruning (prune_partition_pairs). All scratch memory of a pair comes
+* from an arena on this thread's stack that is reset for every pair.
 * 
-* @param tx_data The transaction data
-* @param partition_pairs Vector of input-output partition pairs to process
+* @param input_chunk The chunk of input partitions
+* @param output_chunk The chunk of output partitions
+* @param pairs_first First input-output partition pair to process
+* @param pairs_last End of the pairs; the range is a slice of the coordinator's pair list, not a copy
 * @param input_mapper Mapper for input elements
 * @param output_mapper Mapper for output elements
 * @param valid_count Reference to the counter for valid mappings
 * @param file_mutex Mutex for thread-safe file access
-* @param output_file Reference to the output file stream
-* @param pruned_count Reference to counter for pruned partition pairs
+* @param sink Destination of the CSV rows of valid mappings
 * @param checked_count Reference to counter for checked partition pairs
+* @param metrics Run metrics that the batch's phase times and counters are merged into
 */
 void process_partition_batch(
-   const TransactionData& tx_data,
-   const std::vector<std::pair<IndexPartition, IndexPartition>>& partition_pairs,
+   const PartitionChunk& input_chunk,
+   const PartitionChunk& output_chunk,
+   const PartitionPair* pairs_first,
+   const PartitionPair* pairs_last,
    const ElementMapper& input_mapper,
    const ElementMapper& output_mapper,
    std::atomic<size_t>& valid_count,
    std::mutex& file_mutex,
-   std::ofstream& output_file,
-   std::atomic<size_t>& pruned_count,
-   std::atomic<size_t>& checked_count
+   MappingSink& sink,
+   std::atomic<size_t>& checked_count,
+   RunMetrics& metrics
 ) {
-   for (const auto& [input_partition, output_partition] : partition_pairs) {
-       // Skip if the number of groups doesn't match
-       if (input_partition.size() != output_partition.size()) {
-           continue;
-       }
+   TraceScope batch_trace("process_batch");
+   
+   // Accumulate locally and merge once to keep the shared counters out of the loop
+   PhaseCounters counters;
+   ScratchArena<> arena;
+   
+   for (const PartitionPair* pair = pairs_first; pair != pairs_last; ++pair) {
+       const auto& [input_position, output_position] = *pair;
+       PartitionView input_partition = input_chunk[input_position];
+       PartitionView output_partition = output_chunk[output_position];
+       arena.reset();
        
-       // Apply value-based pruning
-       if (!could_have_valid_mapping(tx_data, input_partition, output_partition, input_mapper, output_mapper)) {
-           pruned_count.fetch_add(1);
-           continue;
+       // Check all permutations of this output partition; formatting and I/O
+       // are accounted separately inside check_all_permutations
+       auto check_start = std::chrono::steady_clock::now();
+       uint64_t formatting_and_io_before = counters.formatting_ns + counters.io_wait_ns;
+       
+       {
+           TraceScope trace("check_permutations");
+           check_all_permutations(
+               input_partition, 
+               output_partition, 
+               input_partition.block_sums(),
+               output_partition.block_sums(),
+               input_mapper, 
+               output_mapper, 
+               valid_count, 
+               file_mutex, 
+               sink,
+               counters,
+               arena.get()
+           );
        }
        
-       // Check all permutations of this output partition
-       check_all_permutations(
-           tx_data, 
-           input_partition, 
-           output_partition, 
-           input_mapper, 
-           output_mapper, 
-           valid_count, 
-           file_mutex, 
-           output_file
-       );
+       uint64_t formatting_and_io = counters.formatting_ns + counters.io_wait_ns - formatting_and_io_before;
+       counters.permutation_ns += elapsed_ns(check_start) - formatting_and_io;
        
        // Increment the counter for checked partition pairs
        checked_count.fetch_add(1);
    }
+   
+   metrics.add(counters);
 }
 
 /**
@@ -555,50 +1091,110 @@ std::string draw_progress_bar(double progress, int width = 20) {
 }
 
 /**
-* Calculates Stirling numbers of the second kind.
-* S(n,k) = number of ways to partition a set of n objects into k non-empty subsets.
+* Returns the number of worker threads used for partition analysis.
+* 
+* @return Number of hardware threads, limited to 16
+*/
+unsigned int default_thread_count() {
+   unsigned int num_threads = std::thread::hardware_concurrency();
+   if (num_threads == 0) num_threads = 4; // Default if hardware_concurrency is not available
+   return std::min(num_threads, 16u); // Limit to reasonable number
+}
+
+/**
+* Creates the memory governor that sizes the chunks of a partition analysis.
 * 
-* @param n Number of objects
-* @param k Number of non-empty subsets
-* @return The Stirling number S(n,k)
+* @param memory_budget Memory budget in bytes, 0 for default_memory_budget()
+* @param num_inputs Number of input elements
+* @param num_outputs Number of output elements
+* @return The governor
 */
-size_t stirling_second_kind(size_t n, size_t k) {
-    if (k == 0) return (n == 0) ? 1 : 0;
-    if (k > n) return 0;
-    if (k == 1 || k == n) return 1;
-    
-    // Use recurrence relation: S(n,k) = k*S(n-1,k) + S(n-1,k-1)
-    return k * stirling_second_kind(n-1, k) + stirling_second_kind(n-1, k-1);
+MemoryGovernor partition_memory_governor(size_t memory_budget, size_t num_inputs, size_t num_outputs) {
+   return MemoryGovernor(memory_budget ? memory_budget : default_memory_budget(), num_inputs, num_outputs,
+                         sizeof(ElementIndex), sizeof(uint32_t), sizeof(double),
+                         sizeof(PartitionPair));
 }
 
+/**
+* Decides whether the partitions of n inputs and m outputs are decoded from the
+* shared catalogs. Both shapes must be covered by the catalog, since otherwise the
+* generators run anyway, and the catalogs must fit in the budget, which is then
+* charged with them; the same catalog serves both sides when n equals m.
+*
+* @param governor Governor of the analysis; reserves the catalog bytes on success
+* @param n Number of inputs
+* @param m Number of outputs
+* @return true if the catalogs are used
+*/
+bool reserve_partition_catalogs(MemoryGovernor& governor, size_t n, size_t m) {
+   if (n > PartitionCatalog::MAX_ELEMENTS || m > PartitionCatalog::MAX_ELEMENTS) {
+       return false;
+   }
+   size_t bytes = PartitionCatalog::storage_bytes(n) + (m != n ? PartitionCatalog::storage_bytes(m) : 0);
+   return governor.reserve(bytes);
+}
+
+/**
+* State of the partition analysis that is reused across chunks and, if the caller
+* keeps the workspace, across analyses: the chunks, signature tables, pair list and
+* kernel scratch of the coordinator. Their capacity survives clear(), so a warm
+* workspace does not allocate.
+*/
+struct PartitionWorkspace {
+   PartitionChunk input_chunk;
+   PartitionChunk output_chunk;
+   std::vector<SignatureTable> output_tables;
+   std::vector<PartitionPair> partition_pairs;
+   std::vector<uint64_t> dominance_mask;
+};
+
 /**
 * Processes chunks of partitions to reduce memory usage.
-* Writes valid mappings directly to a CSV file.
+* Writes valid mappings to the sink as they are found.
+* Chunk sizes, and with them the number of pairs handed to the workers at once,
+* follow the memory budget and are adjusted to the memory measured during the run.
 * 
 * @param tx_data The transaction data
 * @param input_mapper Mapper for input elements
 * @param output_mapper Mapper for output elements
-* @param chunk_size Size of partition chunks to process at once
-* @param output_filename Name of the output CSV file
+* @param governor Memory governor sized for this transaction (partition_memory_governor)
+* @param sink Destination of the CSV rows; if it does not want mappings they are only counted
+* @param workspace Reusable chunks and scratch
+* @param pool Workers for the pair checks; without workers the pairs are checked on this thread
+* @param metrics Run metrics of this analysis
+* @param control Priority of the pair checks in the pool, the callback between chunk combinations
+*                and the cancel flag checked there
+* @param use_catalogs If false, partitions are generated even for shapes the catalogs would serve
 * @return Number of valid mappings found
 */
 size_t process_partition_chunks(
    const TransactionData& tx_data,
    const ElementMapper& input_mapper,
    const ElementMapper& output_mapper,
-   size_t chunk_size,
-   const std::string& output_filename
+   MemoryGovernor& governor,
+   MappingSink& sink,
+   PartitionWorkspace& workspace,
+   WorkerPool& pool,
+   RunMetrics& metrics,
+   const AnalysisControl& control = AnalysisControl(),
+   bool use_catalogs = true
 ) {
-   // Open output file
-   std::ofstream output_file(output_filename);
-   if (!output_file.is_open()) {
-       std::cerr << "Error: Could not open output file " << output_filename << std::endl;
-       return 0;
-   }
+   bool write_mappings = sink.wants_mappings();
+   
+   // Storage for statistics
+   std::atomic<size_t>& valid_count = metrics.valid_count;
+   std::atomic<size_t>& pruned_count = metrics.pruned_count;
+   std::atomic<size_t>& checked_count = metrics.checked_count;
+   std::mutex file_mutex;
    
    // Write CSV header
-   output_file << "Mapping_ID,Group_Count,Total_Input_Value,Total_Output_Value,Total_Difference\n";
-   output_file << "Mapping_ID,Group_Number,Input_Group,Input_Value,Output_Group,Output_Value,Difference\n";
+   if (write_mappings) {
+       const std::string csv_header =
+           "Mapping_ID,Group_Count,Total_Input_Value,Total_Output_Value,Total_Difference\n"
+           "Mapping_ID,Group_Number,Input_Group,Input_Value,Output_Group,Output_Value,Difference\n";
+       sink.write(csv_header);
+       metrics.bytes_written += csv_header.size();
+   }
    
    // Convert element IDs to indices
    std::vector<ElementIndex> input_indices(input_mapper.elements.size());
@@ -615,188 +1211,276 @@ size_t process_partition_chunks(
        output_indices[i] = i;
    }
    
-   // Create partition generators
-   PartitionGenerator input_generator(input_indices);
-   PartitionGenerator output_generator_for_count(output_indices);
-   
-   // Calculate total possible combinations
-   size_t total_input_partitions = input_generator.total_partitions();
-   size_t total_output_partitions = output_generator_for_count.total_partitions();
-   
-   std::cout << "Total possible input partitions: " << total_input_partitions << std::endl;
-   std::cout << "Total possible output partitions: " << total_output_partitions << std::endl;
-   
-   // Calculate distribution of partitions by group size
-   std::vector<size_t> input_partitions_by_size(input_ids.size() + 1, 0);
-   std::vector<size_t> output_partitions_by_size(output_ids.size() + 1, 0);
-   
-   // Calculate using Stirling numbers of the second kind
-   for (size_t k = 1; k <= input_ids.size(); ++k) {
-       input_partitions_by_size[k] = stirling_second_kind(input_ids.size(), k);
+   // Chunks carry block sums and signatures of the element values. Partitions come from the
+   // shared catalogs of both shapes if they fit in the budget, otherwise from generators
+   TransactionValues values(tx_data);
+   std::shared_ptr<const PartitionCatalog> input_catalog, output_catalog;
+   if (use_catalogs && reserve_partition_catalogs(governor, input_ids.size(), output_ids.size())) {
+       input_catalog = PartitionCatalogStore::instance().get(input_ids.size());
+       output_catalog = PartitionCatalogStore::instance().get(output_ids.size());
    }
    
-   for (size_t k = 1; k <= output_ids.size(); ++k) {
-       output_partitions_by_size[k] = stirling_second_kind(output_ids.size(), k);
-   }
+   std::cout << "Total possible input partitions: " << count_to_string(bell_number(input_ids.size())) << std::endl;
+   std::cout << "Total possible output partitions: " << count_to_string(bell_number(output_ids.size())) << std::endl;
    
    // Calculate total compatible pairs (only those with matching group counts)
-   size_t total_compatible_pairs = 0;
+   // using the shared Stirling table; saturates instead of overflowing
+   count_t total_compatible_pairs = 0;
    for (size_t k = 1; k <= std::min(input_ids.size(), output_ids.size()); ++k) {
        // For each group size k, we need to consider all pairs of input and output partitions
        // with exactly k groups
-       total_compatible_pairs += input_partitions_by_size[k] * output_partitions_by_size[k];
+       total_compatible_pairs = saturating_add(total_compatible_pairs,
+           saturating_mul(stirling_number(input_ids.size(), k), stirling_number(output_ids.size(), k)));
    }
    
-   std::cout << "Estimated compatible pairs to check: " << total_compatible_pairs << std::endl;
-   std::cout << "Writing results to: " << output_filename << std::endl;
-   
-   // Storage for statistics
-   std::atomic<size_t> valid_count(0);
-   std::atomic<size_t> pruned_count(0);
-   std::atomic<size_t> checked_count(0);
-   std::mutex file_mutex;
+   std::cout << "Estimated compatible pairs to check: " << count_to_string(total_compatible_pairs) << std::endl;
+   if (!write_mappings) {
+       std::cout << "Counting valid mappings without writing them." << std::endl;
+   }
    
-   // Determine the number of threads to use
-   unsigned int num_threads = std::thread::hardware_concurrency();
-   if (num_threads == 0) num_threads = 4; // Default if hardware_concurrency is not available
-   num_threads = std::min(num_threads, 16u); // Limit to reasonable number
+   // Without workers, pairs are checked on this thread
+   unsigned int num_threads = std::max(1u, pool.size());
    
-   std::cout << "Using " << num_threads << " threads for parallel processing." << std::endl;
-   std::cout << "Processing partitions in chunks of size " << chunk_size << "..." << std::endl;
+   std::cout << "Using " << num_threads << " threads for parallel processing, "
+             << best_dominance_kernel_name() << " pruning kernel." << std::endl;
+   metrics.threads = num_threads;
+   if (control.export_metrics) {
+       MetricsExporter::instance().attach(metrics, "partition");
+   }
+   std::cout << "Memory budget: " << format_bytes(governor.budget()) << " (initial chunks of "
+             << governor.input_chunk_size() << " partitions, results buffer "
+             << format_bytes(governor.output_buffer_bytes()) << ")" << std::endl;
    
    // Process input partitions in chunks
    size_t pairs_processed = 0;
    
-   // For progress tracking
-   auto start_time = std::chrono::high_resolution_clock::now();
-   auto last_update_time = start_time;
+   // For progress tracking, measured in estimated work rather than input partitions
+   ProgressModel progress(input_ids.size(), output_ids.size());
+   auto last_update_time = std::chrono::steady_clock::now();
+   
+   TraceRecorder::instance().set_thread_name("coordinator");
+   
+   // Chunks are reused across iterations, so after the first chunks generation does not allocate
+   PartitionChunk& input_chunk = workspace.input_chunk;
+   PartitionChunk& output_chunk = workspace.output_chunk;
+   std::vector<SignatureTable>& output_tables = workspace.output_tables;
+   std::vector<PartitionPair>& partition_pairs = workspace.partition_pairs;
+   std::vector<uint64_t>& dominance_mask = workspace.dominance_mask;
    
-   // Main processing loop
-   while (input_generator.has_more()) {
-       // Get chunk of input partitions
-       auto input_chunk = input_generator.next_chunk(chunk_size);
+   // Counts the partitions of a chunk by group count, for the run metrics and for the chunk itself
+   auto count_chunk = [](const PartitionChunk& chunk, std::vector<uint64_t>& run_by_k, std::vector<uint64_t>& chunk_by_k) {
+       chunk_by_k.clear();
+       for (size_t p = 0; p < chunk.size(); ++p) {
+           RunMetrics::count_partition(run_by_k, chunk.group_count(p));
+           RunMetrics::count_partition(chunk_by_k, chunk.group_count(p));
+       }
+   };
+   std::vector<uint64_t> input_chunk_by_k;
+   std::vector<uint64_t> output_chunk_by_k;
+   
+   // Prunes and checks all pairs of the current input and output chunk
+   auto process_chunk_combination = [&]() {
+       // Every input partition with k groups is paired with every output partition with k groups
+       size_t expected_pairs = 0;
+       for (size_t k = 1; k < std::min(input_chunk_by_k.size(), output_chunk_by_k.size()); ++k) {
+           expected_pairs += input_chunk_by_k[k] * output_chunk_by_k[k];
+       }
+       governor.observe_pairs(expected_pairs, input_chunk.size() * output_chunk.size());
        
-       // Reset output generator for each input chunk
-       PartitionGenerator output_generator(output_indices);
+       // Signatures of the output chunk per group count, for the dominance kernel
+       auto generation_start = std::chrono::steady_clock::now();
+       output_tables.resize(output_chunk_by_k.size());
+       for (size_t k = 1; k < output_tables.size(); ++k) {
+           if (k < input_chunk_by_k.size() && input_chunk_by_k[k] > 0 && output_chunk_by_k[k] > 0) {
+               output_tables[k].build(output_chunk, k);
+           } else {
+               output_tables[k].clear();
+           }
+       }
+       metrics.generation_ns += elapsed_ns(generation_start);
        
-       // Process all output partitions for this input chunk
-       while (output_generator.has_more()) {
-           // Get chunk of output partitions
-           auto output_chunk = output_generator.next_chunk(chunk_size);
+       // Create the pairs of this chunk combination that survive value-based pruning
+       auto prune_start = std::chrono::steady_clock::now();
+       partition_pairs.clear();
+       {
+           TraceScope trace("prune");
+           prune_partition_pairs(input_chunk, output_tables, partition_pairs, dominance_mask);
+       }
+       metrics.pruning_ns += elapsed_ns(prune_start);
+       
+       pruned_count += expected_pairs - partition_pairs.size();
+       pairs_processed += expected_pairs;
+       metrics.pairs_processed += expected_pairs;
+       
+       // Process partition pairs in parallel
+       if (partition_pairs.empty()) {
+           // Every pair of this chunk combination was pruned
+       } else if (num_threads <= 1 || partition_pairs.size() <= 1) {
+           // If only one thread or one pair, process directly
+           auto busy_start = std::chrono::steady_clock::now();
+           metrics.queued_pairs = partition_pairs.size();
+           process_partition_batch(
+               input_chunk,
+               output_chunk,
+               partition_pairs.data(),
+               partition_pairs.data() + partition_pairs.size(),
+               input_mapper,
+               output_mapper,
+               valid_count,
+               file_mutex,
+               sink,
+               checked_count,
+               metrics
+           );
+           metrics.queued_pairs = 0;
+           metrics.worker_busy_ns[0] += elapsed_ns(busy_start);
+       } else {
+           // Divide the work among the workers
+           size_t thread_batch_size = (partition_pairs.size() + num_threads - 1) / num_threads;
+           unsigned int batch_count = static_cast<unsigned int>(
+               (partition_pairs.size() + thread_batch_size - 1) / thread_batch_size);
+           metrics.queued_pairs = partition_pairs.size();
            
-           // Create partition pairs for this chunk combination
-           std::vector<std::pair<IndexPartition, IndexPartition>> partition_pairs;
-           for (const auto& input_partition : input_chunk) {
-               for (const auto& output_partition : output_chunk) {
-                   // Only add pairs with matching group counts
-                   if (input_partition.size() == output_partition.size()) {
-                       partition_pairs.emplace_back(input_partition, output_partition);
-                   }
-               }
-           }
+           // Each worker slot records its busy time and drains the queue gauge
+           TraceScope trace("wait_for_batch");
+           pool.run(batch_count, [&](unsigned int i) {
+               size_t start_idx = i * thread_batch_size;
+               size_t end_idx = std::min(start_idx + thread_batch_size, partition_pairs.size());
+               
+               auto busy_start = std::chrono::steady_clock::now();
+               process_partition_batch(input_chunk, output_chunk, partition_pairs.data() + start_idx,
+                                       partition_pairs.data() + end_idx, input_mapper, output_mapper, valid_count,
+                                       file_mutex, sink, checked_count, metrics);
+               metrics.queued_pairs -= end_idx - start_idx;
+               metrics.worker_busy_ns[i] += elapsed_ns(busy_start);
+           }, control.priority);
+       }
+       
+       for (size_t k = 1; k < std::min(input_chunk_by_k.size(), output_chunk_by_k.size()); ++k) {
+           progress.record_pairs(k, input_chunk_by_k[k] * output_chunk_by_k[k]);
+       }
+       
+       // Shrink the chunks if the resident set exceeded the budget while the pairs were alive
+       governor.check_resident_set();
+       
+       // Update progress display once per second
+       auto current_time = std::chrono::steady_clock::now();
+       if (current_time - last_update_time >= std::chrono::seconds(1)) {
+           last_update_time = current_time;
            
-           // If no compatible pairs in this chunk, continue
-           if (partition_pairs.empty()) {
-               continue;
-           }
+           double estimated_seconds_remaining = progress.update(metrics);
+           double progress_percentage = progress.fraction() * 100.0;
+           metrics.progress = progress.fraction();
+           metrics.eta_seconds = estimated_seconds_remaining;
+           std::string time_remaining = format_eta(estimated_seconds_remaining);
            
-           pairs_processed += partition_pairs.size();
+           // Draw progress bar
+           std::string progress_bar = draw_progress_bar(progress_percentage);
            
-           // Process partition pairs in parallel
-           if (num_threads <= 1 || partition_pairs.size() <= 1) {
-               // If only one thread or one pair, process directly
-               process_partition_batch(
-                   tx_data,
-                   partition_pairs,
-                   input_mapper,
-                   output_mapper,
-                   valid_count,
-                   file_mutex,
-                   output_file,
-                   pruned_count,
-                   checked_count
-               );
-           } else {
-               // Divide the work among threads
-               std::vector<std::future<void>> futures;
-               
-               // Calculate batch size for threads
-               size_t thread_batch_size = (partition_pairs.size() + num_threads - 1) / num_threads;
+           // Clear the current line and print progress
+           std::cout << "\r" << std::string(80, ' ') << "\r"; // Clear line
+           std::cout << progress_bar << " " << std::fixed << std::setprecision(1) << progress_percentage << "% | "
+                     << "Pairs: " << pairs_processed << " | "
+                     << "Valid: " << valid_count << " | "
+                     << "Pruned: " << pruned_count << " | "
+                     << "ETA: " << time_remaining << std::flush;
+       }
+       
+       // Other analyses may take over here, nothing of this chunk combination is in flight
+       if (control.at_chunk_boundary) {
+           TraceScope trace("chunk_boundary");
+           control.at_chunk_boundary([&]() {
+               // Only the input chunk is needed to go on; the output chunk is decoded again
+               std::vector<PartitionPair>().swap(partition_pairs);
+               std::vector<SignatureTable>().swap(output_tables);
+               std::vector<uint64_t>().swap(dominance_mask);
+               output_chunk = PartitionChunk();
+           });
+       }
+   };
+   
+   if (input_catalog && output_catalog) {
+       // Iterate by stratum: only partitions with the same number of groups are ever paired
+       size_t output_decoded_k = 0, output_decoded_first = 0, output_decoded_last = 0;
+       for (size_t k = 1; k <= std::min(input_ids.size(), output_ids.size()) && !control.cancelled(); ++k) {
+           size_t input_count = input_catalog->stratum_size(k);
+           size_t output_count = output_catalog->stratum_size(k);
+           
+           for (size_t input_first = 0; input_first < input_count && !control.cancelled();
+                input_first += input_chunk.size()) {
+               // Decode the next chunk of input partitions with k groups
+               auto generation_start = std::chrono::steady_clock::now();
+               {
+                   TraceScope trace("generate_input_chunk");
+                   size_t input_last = std::min(input_first + governor.input_chunk_size(), input_count);
+                   input_catalog->decode(k, input_first, input_last, values.inputs(), input_chunk);
+               }
+               governor.observe_chunk(input_chunk.memory_bytes(), input_chunk.size(), true);
+               count_chunk(input_chunk, metrics.input_partitions_by_k, input_chunk_by_k);
+               metrics.generation_ns += elapsed_ns(generation_start);
                
-               // Launch threads
-               for (unsigned int i = 0; i < num_threads; ++i) {
-                   size_t start_idx = i * thread_batch_size;
-                   size_t end_idx = std::min(start_idx + thread_batch_size, partition_pairs.size());
+               for (size_t output_first = 0; output_first < output_count && !control.cancelled();
+                    output_first = output_decoded_last) {
+                   size_t output_last = std::min(output_first + governor.output_chunk_size(input_chunk.size()),
+                                                 output_count);
                    
-                   if (start_idx >= partition_pairs.size()) break;
-                   
-                   std::vector<std::pair<IndexPartition, IndexPartition>> thread_batch(
-                       partition_pairs.begin() + start_idx,
-                       partition_pairs.begin() + end_idx
-                   );
+                   // An output chunk that is still decoded, e.g. a whole stratum, is reused
+                   if (output_decoded_k != k || output_decoded_first != output_first || output_decoded_last != output_last ||
+                       output_chunk.empty()) {
+                       generation_start = std::chrono::steady_clock::now();
+                       {
+                           TraceScope trace("generate_output_chunk");
+                           output_catalog->decode(k, output_first, output_last, values.outputs(), output_chunk);
+                       }
+                       governor.observe_chunk(output_chunk.memory_bytes(), output_chunk.size(), false);
+                       count_chunk(output_chunk, metrics.output_partitions_by_k, output_chunk_by_k);
+                       output_decoded_k = k;
+                       output_decoded_first = output_first;
+                       output_decoded_last = output_last;
+                       metrics.generation_ns += elapsed_ns(generation_start);
+                   }
                    
-                   futures.push_back(std::async(std::launch::async, 
-                       process_partition_batch, 
-                       std::ref(tx_data), 
-                       std::move(thread_batch), 
-                       std::ref(input_mapper),
-                       std::ref(output_mapper),
-                       std::ref(valid_count), 
-                       std::ref(file_mutex), 
-                       std::ref(output_file),
-                       std::ref(pruned_count),
-                       std::ref(checked_count)
-                   ));
+                   process_chunk_combination();
                }
                
-               // Wait for all threads to complete
-               for (auto& future : futures) {
-                   future.wait();
-               }
+               // Rows are buffered by the sink and written out once per input chunk
+               sink.flush();
            }
+       }
+   } else {
+       // Gray code order moves one element per partition, so block sums are updated instead of recomputed
+       PartitionGenerator input_generator(input_indices, values.inputs(), PartitionOrder::GRAY_CODE);
+       while (input_generator.has_more() && !control.cancelled()) {
+           // Get chunk of input partitions
+           auto generation_start = std::chrono::steady_clock::now();
+           {
+               TraceScope trace("generate_input_chunk");
+               input_generator.next_chunk(governor.input_chunk_size(), input_chunk);
+           }
+           governor.observe_chunk(input_chunk.memory_bytes(), input_chunk.size(), true);
+           count_chunk(input_chunk, metrics.input_partitions_by_k, input_chunk_by_k);
            
-           // Update progress display
-           auto current_time = std::chrono::high_resolution_clock::now();
-           auto time_elapsed = std::chrono::duration_cast<std::chrono::seconds>(current_time - last_update_time).count();
+           // Reset output generator for each input chunk
+           PartitionGenerator output_generator(output_indices, values.outputs(), PartitionOrder::GRAY_CODE);
+           metrics.generation_ns += elapsed_ns(generation_start);
            
-           // Update progress once per second
-           if (time_elapsed >= 1) {
-               last_update_time = current_time;
-               
-               // Calculate progress based on input partitions processed
-               double input_progress = static_cast<double>(input_generator.current_progress()) / total_input_partitions;
-               
-               // Ensure progress doesn't exceed 100%
-               double progress_percentage = std::min(input_progress * 100.0, 99.9);
-               
-               // Calculate estimated time remaining
-               auto total_elapsed = std::chrono::duration_cast<std::chrono::seconds>(current_time - start_time).count();
-               double seconds_per_percent = total_elapsed / progress_percentage;
-               double estimated_seconds_remaining = seconds_per_percent * (100.0 - progress_percentage);
-               
-               // Format time remaining
-               std::string time_remaining;
-               if (estimated_seconds_remaining > 3600) {
-                   time_remaining = std::to_string(static_cast<int>(estimated_seconds_remaining / 3600)) + "h " +
-                                   std::to_string(static_cast<int>((static_cast<int>(estimated_seconds_remaining) % 3600) / 60)) + "m";
-               } else if (estimated_seconds_remaining > 60) {
-                   time_remaining = std::to_string(static_cast<int>(estimated_seconds_remaining / 60)) + "m " +
-                                   std::to_string(static_cast<int>(static_cast<int>(estimated_seconds_remaining) % 60)) + "s";
-               } else {
-                   time_remaining = std::to_string(static_cast<int>(estimated_seconds_remaining)) + "s";
+           // Process all output partitions for this input chunk
+           while (output_generator.has_more() && !control.cancelled()) {
+               // Get chunk of output partitions
+               generation_start = std::chrono::steady_clock::now();
+               {
+                   TraceScope trace("generate_output_chunk");
+                   output_generator.next_chunk(governor.output_chunk_size(input_chunk.size()), output_chunk);
                }
+               governor.observe_chunk(output_chunk.memory_bytes(), output_chunk.size(), false);
+               count_chunk(output_chunk, metrics.output_partitions_by_k, output_chunk_by_k);
+               metrics.generation_ns += elapsed_ns(generation_start);
                
-               // Draw progress bar
-               std::string progress_bar = draw_progress_bar(progress_percentage);
-               
-               // Clear the current line and print progress
-               std::cout << "\r" << std::string(80, ' ') << "\r"; // Clear line
-               std::cout << progress_bar << " " << std::fixed << std::setprecision(1) << progress_percentage << "% | "
-                         << "Pairs: " << pairs_processed << " | "
-                         << "Valid: " << valid_count << " | "
-                         << "Pruned: " << pruned_count << " | "
-                         << "ETA: " << time_remaining << std::flush;
+               process_chunk_combination();
            }
+           
+           // Rows are buffered by the sink and written out once per input chunk
+           sink.flush();
        }
    }
    
@@ -807,12 +1491,69 @@ size_t process_partition_chunks(
              << "Pruned " << pruned_count << " pairs. Found " 
              << valid_count << " valid mappings." << std::endl;
    
-   // Close the output file
-   output_file.close();
+   sink.flush();
+   metrics.progress = 1.0;
+   metrics.eta_seconds = 0.0;
+   MetricsExporter::instance().detach(metrics);
    
-   std::cout << "\nResults have been written to: " << output_filename << std::endl;
+   return valid_count;
+}
+
+/**
+* Processes chunks of partitions to reduce memory usage.
+* Writes valid mappings directly to a CSV file as they are found, using a
+* worker pool and workspace that live for this analysis only.
+* 
+* @param tx_data The transaction data
+* @param input_mapper Mapper for input elements
+* @param output_mapper Mapper for output elements
+* @param memory_budget Memory budget in bytes, 0 for default_memory_budget()
+* @param output_filename Filename for the output CSV file
+* @param write_mappings If false, valid mappings are only counted
+* @return Number of valid mappings found
+*/
+size_t process_partition_chunks(
+   const TransactionData& tx_data,
+   const ElementMapper& input_mapper,
+   const ElementMapper& output_mapper,
+   size_t memory_budget,
+   const std::string& output_filename,
+   bool write_mappings = true
+) {
+   MemoryGovernor governor = partition_memory_governor(memory_budget, input_mapper.elements.size(),
+                                                       output_mapper.elements.size());
+   
+   // Open output file; the buffer is sized from the budget
+   std::unique_ptr<MappingSink> sink;
+   if (write_mappings) {
+       auto file_sink = std::make_unique<FileMappingSink>(output_filename, governor.output_buffer_bytes());
+       if (!file_sink->is_open()) {
+           return 0;
+       }
+       sink = std::move(file_sink);
+   } else {
+       sink = std::make_unique<CountingMappingSink>();
+   }
+   
+   // A single thread checks the pairs itself instead of handing them to one worker
+   unsigned int num_threads = default_thread_count();
+   WorkerPool pool(num_threads > 1 ? num_threads : 0);
+   PartitionWorkspace workspace;
+   RunMetrics metrics;
+   
+   size_t valid_count = process_partition_chunks(tx_data, input_mapper, output_mapper, governor, *sink,
+                                                 workspace, pool, metrics);
+   
+   // Close the output file
+   sink.reset();
+   if (write_mappings) {
+       std::cout << "\nResults have been written to: " << output_filename << std::endl;
+   }
    std::cout << "Total valid partitions and mappings found: " << valid_count << std::endl;
    
+   write_metrics_report(metrics, "partition", output_filename,
+                        input_mapper.elements.size(), output_mapper.elements.size(), num_threads);
+   
    return valid_count;
 }
 
@@ -823,25 +1564,27 @@ size_t process_partition_chunks(
 * 
 * @param tx_data The transaction data
 * @param output_filename Optional filename for the output CSV file
+* @param write_mappings If false, valid mappings are only counted
+* @param memory_budget Memory budget in bytes, 0 for default_memory_budget()
 * @return The number of valid partitions and mappings found
 */
-size_t find_valid_partitions(const TransactionData& tx_data, const std::string& output_filename = "valid_mappings.csv") {
+size_t find_valid_partitions(const TransactionData& tx_data, const std::string& output_filename = "valid_mappings.csv",
+                             bool write_mappings = true, size_t memory_budget = 0) {
    // Get input and output IDs
    const auto& input_ids = tx_data.get_input_ids();
    const auto& output_ids = tx_data.get_output_ids();
    
    std::cout << "Finding valid partitions using memory-efficient chunked processing..." << std::endl;
-   std::cout << "Results will be written to: " << output_filename << std::endl;
+   if (write_mappings) {
+       std::cout << "Results will be written to: " << output_filename << std::endl;
+   }
    
    // Create element mappers
    ElementMapper input_mapper(input_ids);
    ElementMapper output_mapper(output_ids);
    
-   // Fixed chunk size of 500
-   const size_t chunk_size = 500;
-   
-   // Process partitions in chunks and write to file
-   return process_partition_chunks(tx_data, input_mapper, output_mapper, chunk_size, output_filename);
+   // Process partitions in chunks sized from the memory budget and write to file
+   return process_partition_chunks(tx_data, input_mapper, output_mapper, memory_budget, output_filename, write_mappings);
 }
 
 #endif // PARTITION_ANALYZER_H
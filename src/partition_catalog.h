@@ -0,0 +1,437 @@
+#ifndef PARTITION_CATALOG_H
+#define PARTITION_CATALOG_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bell_number.h"
+#include "partition_chunk.h"
+
+/**
+* All set partitions of the elements 0..n-1, grouped by their number of blocks k.
+*
+* Partitions do not depend on the values of a transaction, only on its shape, so
+* the catalog for n elements is built once and shared by every transaction with n
+* inputs or outputs. A partition is stored as its restricted growth string (RGS),
+* the block of each element, packed into one 64-bit code with 4 bits per element:
+*
+*     block of element i = (code >> (4 * i)) & 0xF
+*
+* The codes of stratum k (all partitions with k blocks) are contiguous and in
+* lexicographic RGS order, the order PartitionGenerator produces them in.
+*
+* Catalogs are persisted as files of a fixed header followed by the codes and are
+* mapped read-only, so all processes analyzing the same shape share one copy in
+* the page cache. The cache directory is writable by the user, so the codes of a
+* mapped file are checked before they are used: every code must be a restricted
+* growth string with the number of blocks of its stratum, in strictly increasing
+* lexicographic order, which makes each stratum exactly the partitions it stands for.
+*/
+class PartitionCatalog {
+public:
+   // 4 bits per element in a 64-bit code; 13 elements are 27.6M partitions (221 MB)
+   static constexpr size_t MAX_ELEMENTS = 13;
+   static constexpr uint32_t FORMAT_VERSION = 1;
+
+private:
+   struct Header {
+       char magic[8];
+       uint32_t version;
+       uint32_t elements;
+       uint64_t stratum_offsets[MAX_ELEMENTS + 2];  // Stratum k holds codes[offsets[k] .. offsets[k+1])
+   };
+
+   static constexpr char MAGIC[8] = {'B', 'T', 'C', 'P', 'C', 'A', 'T', '\n'};
+
+   Header header{};
+   const uint64_t* codes = nullptr;
+   std::vector<uint64_t> owned_codes;  // Codes of a catalog that is not mapped from a file
+   void* mapping = nullptr;
+   size_t mapping_bytes = 0;
+
+   PartitionCatalog() = default;
+
+public:
+   PartitionCatalog(const PartitionCatalog&) = delete;
+   PartitionCatalog& operator=(const PartitionCatalog&) = delete;
+
+   ~PartitionCatalog() {
+       if (mapping) {
+           munmap(mapping, mapping_bytes);
+       }
+   }
+
+   // Bytes the catalog of n elements occupies in memory, mapped or built
+   static size_t storage_bytes(size_t n) {
+       return sizeof(Header) + saturate_to_size(saturating_mul(bell_number(n), sizeof(uint64_t)));
+   }
+
+   /**
+   * Enumerates all partitions of n elements in memory.
+   *
+   * @param n Number of elements, 1 to MAX_ELEMENTS
+   * @return The catalog, or nullptr if n is out of range
+   */
+   static std::unique_ptr<PartitionCatalog> build(size_t n) {
+       if (n == 0 || n > MAX_ELEMENTS) {
+           return nullptr;
+       }
+
+       std::unique_ptr<PartitionCatalog> catalog(new PartitionCatalog());
+       catalog->init_header(n);
+       catalog->owned_codes.resize(saturate_to_size(bell_number(n)));
+
+       // Next free slot of each stratum
+       std::vector<uint64_t> next(catalog->header.stratum_offsets, catalog->header.stratum_offsets + n + 1);
+
+       // Lexicographic enumeration of restricted growth strings, as in PartitionGenerator
+       std::vector<size_t> rgs(n, 0);
+       std::vector<size_t> prefix_max(n, 0);
+       while (true) {
+           uint64_t code = 0;
+           size_t block_count = 0;
+           for (size_t i = 0; i < n; ++i) {
+               code |= static_cast<uint64_t>(rgs[i]) << (4 * i);
+               block_count = std::max(block_count, rgs[i] + 1);
+           }
+           catalog->owned_codes[next[block_count]++] = code;
+
+           // Step to the next string: increment the last element that may still grow
+           size_t i = n - 1;
+           while (i > 0 && rgs[i] > prefix_max[i]) {
+               --i;
+           }
+           if (i == 0) {
+               break;
+           }
+           rgs[i]++;
+           size_t block_max = std::max(prefix_max[i], rgs[i]);
+           for (size_t j = i + 1; j < n; ++j) {
+               rgs[j] = 0;
+               prefix_max[j] = block_max;
+           }
+       }
+
+       catalog->codes = catalog->owned_codes.data();
+       return catalog;
+   }
+
+   /**
+   * Maps a persisted catalog read-only.
+   *
+   * @param path The catalog file
+   * @param n Expected number of elements
+   * @return The catalog, or nullptr if the file is missing, truncated, corrupt or of another shape or format
+   */
+   static std::unique_ptr<PartitionCatalog> open(const std::string& path, size_t n) {
+       int fd = ::open(path.c_str(), O_RDONLY);
+       if (fd < 0) {
+           return nullptr;
+       }
+
+       struct stat file_stat;
+       if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+           ::close(fd);
+           return nullptr;
+       }
+
+       size_t bytes = static_cast<size_t>(file_stat.st_size);
+       void* mapping = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+       ::close(fd);
+       if (mapping == MAP_FAILED) {
+           return nullptr;
+       }
+
+       std::unique_ptr<PartitionCatalog> catalog(new PartitionCatalog());
+       catalog->mapping = mapping;
+       catalog->mapping_bytes = bytes;
+       std::memcpy(&catalog->header, mapping, sizeof(Header));
+
+       PartitionCatalog expected;
+       expected.init_header(n);
+       if (std::memcmp(&catalog->header, &expected.header, sizeof(Header)) != 0 ||
+           bytes != sizeof(Header) + expected.total_partitions() * sizeof(uint64_t)) {
+           return nullptr;
+       }
+
+       catalog->codes = reinterpret_cast<const uint64_t*>(static_cast<const char*>(mapping) + sizeof(Header));
+       if (!catalog->valid_codes()) {
+           std::cerr << "Warning: Partition catalog " << path << " is corrupt" << std::endl;
+           return nullptr;
+       }
+       return catalog;
+   }
+
+   /**
+   * Persists the catalog. Writes a temporary file and renames it, so concurrent
+   * processes never map a partially written catalog.
+   *
+   * @param path The catalog file
+   * @return true on success, false otherwise
+   */
+   bool save(const std::string& path) const {
+       std::string temporary_path = path + ".tmp." + std::to_string(getpid());
+       {
+           std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+           if (!file.is_open()) {
+               return false;
+           }
+           file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+           file.write(reinterpret_cast<const char*>(codes), total_partitions() * sizeof(uint64_t));
+           if (!file.good()) {
+               file.close();
+               std::remove(temporary_path.c_str());
+               return false;
+           }
+       }
+       if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+           std::remove(temporary_path.c_str());
+           return false;
+       }
+       return true;
+   }
+
+   size_t elements() const {
+       return header.elements;
+   }
+
+   size_t total_partitions() const {
+       return header.stratum_offsets[elements() + 1];
+   }
+
+   // Number of partitions with k blocks
+   size_t stratum_size(size_t k) const {
+       return k >= 1 && k <= elements() ? header.stratum_offsets[k + 1] - header.stratum_offsets[k] : 0;
+   }
+
+   // Codes of the partitions with k blocks
+   const uint64_t* stratum(size_t k) const {
+       return codes + header.stratum_offsets[k];
+   }
+
+   bool is_mapped() const {
+       return mapping != nullptr;
+   }
+
+   /**
+   * Replaces the contents of a chunk with partitions first..last-1 of stratum k.
+   * Blocks are filled in element order, so the partitions, their block sums and
+   * signatures are identical to those of PartitionGenerator.
+   *
+   * @param k Number of blocks
+   * @param first Position of the first partition in the stratum
+   * @param last Position after the last partition
+   * @param element_values Value of each element, or empty if the chunk carries no values
+   * @param chunk The chunk to fill
+   */
+   void decode(size_t k, size_t first, size_t last, const std::vector<double>& element_values,
+               PartitionChunk& chunk) const {
+       size_t n = elements();
+       chunk.clear();
+       chunk.reserve(last - first, n);
+       if (!element_values.empty()) {
+           chunk.reserve_values(last - first, n);
+       }
+
+       ElementIndex block_elements[MAX_ELEMENTS];
+       uint32_t block_ends[MAX_ELEMENTS + 1];
+       const uint64_t* stratum_codes = stratum(k);
+
+       for (size_t p = first; p < last; ++p) {
+           uint64_t code = stratum_codes[p];
+
+           // Counting sort of the elements by block, keeping element order within a block
+           std::fill(block_ends, block_ends + k + 1, 0);
+           for (size_t i = 0; i < n; ++i) {
+               block_ends[((code >> (4 * i)) & 0xF) + 1]++;
+           }
+           for (size_t b = 1; b <= k; ++b) {
+               block_ends[b] += block_ends[b - 1];
+           }
+           for (size_t i = 0; i < n; ++i) {
+               block_elements[block_ends[(code >> (4 * i)) & 0xF]++] = static_cast<ElementIndex>(i);
+           }
+
+           uint32_t block_start = 0;
+           for (size_t b = 0; b < k; ++b) {
+               const ElementIndex* block_first = block_elements + block_start;
+               const ElementIndex* block_last = block_elements + block_ends[b];
+               if (element_values.empty()) {
+                   chunk.add_block(block_first, block_last);
+               } else {
+                   double sum = 0.0;
+                   for (const ElementIndex* it = block_first; it != block_last; ++it) {
+                       sum += element_values[*it];
+                   }
+                   chunk.add_block(block_first, block_last, sum);
+               }
+               block_start = block_ends[b];
+           }
+           chunk.end_partition();
+       }
+   }
+
+private:
+   // Checks every code against its stratum, so that decode never sees a block outside 0..k-1
+   bool valid_codes() const {
+       size_t n = elements();
+       for (size_t k = 1; k <= n; ++k) {
+           const uint64_t* stratum_codes = stratum(k);
+           uint64_t previous_key = 0;
+           for (size_t p = 0; p < stratum_size(k); ++p) {
+               uint64_t code = stratum_codes[p];
+               if (n < 16 && (code >> (4 * n)) != 0) {
+                   return false;
+               }
+
+               // Each element joins an existing block or opens the next one
+               size_t blocks = 0;
+               uint64_t key = 0;
+               for (size_t i = 0; i < n; ++i) {
+                   size_t block = (code >> (4 * i)) & 0xF;
+                   if (block > blocks) {
+                       return false;
+                   }
+                   blocks = std::max(blocks, block + 1);
+                   key = (key << 4) | block;
+               }
+
+               // The key compares like the strings, element 0 first
+               if (blocks != k || (p > 0 && key <= previous_key)) {
+                   return false;
+               }
+               previous_key = key;
+           }
+       }
+       return true;
+   }
+
+   void init_header(size_t n) {
+       std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+       header.version = FORMAT_VERSION;
+       header.elements = static_cast<uint32_t>(n);
+       uint64_t offset = 0;
+       for (size_t k = 0; k <= MAX_ELEMENTS + 1; ++k) {
+           header.stratum_offsets[k] = offset;
+           if (k >= 1 && k <= n) {
+               offset += saturate_to_size(stirling_number(n, k));
+           }
+       }
+   }
+};
+
+/**
+* Process-wide store of partition catalogs. The first request for a shape builds its
+* catalog in memory; later requests share the same catalog. Persisting is opt-in:
+* with a catalog directory (set_directory) the catalog is mapped from it, or built
+* and persisted there, so that other processes reuse it. Catalogs are mapped or built outside the store's mutex, so a job
+* only waits for a build if it needs the same catalog.
+*/
+class PartitionCatalogStore {
+private:
+   std::mutex catalogs_mutex;
+   std::map<size_t, std::shared_future<std::shared_ptr<const PartitionCatalog>>> catalogs;
+   std::string directory;  // Empty keeps catalogs in memory only
+
+   PartitionCatalogStore() = default;
+
+   // Maps the catalog of n elements from the directory, or builds it and persists it there
+   static std::shared_ptr<const PartitionCatalog> load(size_t n, const std::string& catalog_directory) {
+       std::string path = catalog_directory.empty() ? "" : catalog_directory + "/partitions-" + std::to_string(n) + ".rgs";
+       std::shared_ptr<const PartitionCatalog> catalog;
+       if (!path.empty()) {
+           catalog = PartitionCatalog::open(path, n);
+       }
+
+       if (!catalog) {
+           std::unique_ptr<PartitionCatalog> built = PartitionCatalog::build(n);
+           if (!path.empty()) {
+               std::error_code error;
+               std::filesystem::create_directories(catalog_directory, error);
+               if (!error && built->save(path)) {
+                   // Map the file so that the built copy does not stay on the heap
+                   catalog = PartitionCatalog::open(path, n);
+               } else {
+                   std::cerr << "Warning: Could not persist the partition catalog to " << path << std::endl;
+               }
+           }
+           if (!catalog) {
+               catalog = std::move(built);
+           }
+       }
+
+       return catalog;
+   }
+
+public:
+   static PartitionCatalogStore& instance() {
+       static PartitionCatalogStore store;
+       return store;
+   }
+
+   // Directory catalogs are persisted in; empty to keep them in memory only
+   void set_directory(const std::string& catalog_directory) {
+       std::lock_guard<std::mutex> lock(catalogs_mutex);
+       directory = catalog_directory;
+   }
+
+   /**
+   * The catalog of all partitions of n elements.
+   *
+   * @param n Number of elements
+   * @return The catalog, or nullptr if n exceeds PartitionCatalog::MAX_ELEMENTS
+   */
+   std::shared_ptr<const PartitionCatalog> get(size_t n) {
+       if (n == 0 || n > PartitionCatalog::MAX_ELEMENTS) {
+           return nullptr;
+       }
+
+       std::promise<std::shared_ptr<const PartitionCatalog>> promise;
+       std::shared_future<std::shared_ptr<const PartitionCatalog>> pending;
+       std::string catalog_directory;
+       {
+           std::lock_guard<std::mutex> lock(catalogs_mutex);
+           auto found = catalogs.find(n);
+           if (found != catalogs.end()) {
+               pending = found->second;
+           } else {
+               catalogs[n] = promise.get_future().share();
+               catalog_directory = directory;
+           }
+       }
+
+       // Published, or being loaded by another job
+       if (pending.valid()) {
+           return pending.get();
+       }
+
+       try {
+           std::shared_ptr<const PartitionCatalog> catalog = load(n, catalog_directory);
+           promise.set_value(catalog);
+           return catalog;
+       } catch (...) {
+           // Waiting jobs see the failure, later requests try again
+           promise.set_exception(std::current_exception());
+           std::lock_guard<std::mutex> lock(catalogs_mutex);
+           catalogs.erase(n);
+           throw;
+       }
+   }
+};
+
+#endif // PARTITION_CATALOG_H
@@ -0,0 +1,203 @@
+#ifndef PARTITION_CHUNK_H
+#define PARTITION_CHUNK_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include "fixed_block_kernels.h"
+
+// Memory-efficient type definitions
+using ElementIndex = uint16_t;
+using IndexSet = std::vector<ElementIndex>;
+using IndexPartition = std::vector<IndexSet>;
+
+/**
+* Read-only view of one block (group) of a partition stored in a PartitionChunk.
+*/
+struct BlockView {
+   const ElementIndex* first;
+   const ElementIndex* last;
+
+   const ElementIndex* begin() const { return first; }
+   const ElementIndex* end() const { return last; }
+   size_t size() const { return static_cast<size_t>(last - first); }
+   ElementIndex operator[](size_t i) const { return first[i]; }
+};
+
+/**
+* Read-only view of the block sums or the signature of a partition.
+*/
+struct ValuesView {
+   const double* first;
+   const double* last;
+
+   const double* begin() const { return first; }
+   const double* end() const { return last; }
+   size_t size() const { return static_cast<size_t>(last - first); }
+   double operator[](size_t i) const { return first[i]; }
+};
+
+class PartitionChunk;
+
+/**
+* Read-only view of one partition stored in a PartitionChunk.
+* Offers the same size() and operator[] as an IndexPartition.
+*/
+struct PartitionView {
+   const PartitionChunk* chunk;
+   size_t index;
+
+   size_t size() const;
+   BlockView operator[](size_t block) const;
+
+   // Value of each block, in block order
+   ValuesView block_sums() const;
+
+   // Block values sorted in descending order
+   ValuesView signature() const;
+
+   // Copy into an IndexPartition, e.g. for formatting
+   IndexPartition to_index_partition() const;
+};
+
+/**
+* A chunk of partitions stored in compressed sparse row form:
+*
+*     elements           the elements of all blocks of all partitions, block by block
+*     block_offsets      block b holds elements[block_offsets[b] .. block_offsets[b+1])
+*     partition_offsets  partition p holds blocks partition_offsets[p] .. partition_offsets[p+1]
+*
+* Three flat arrays instead of one heap allocation per block and per partition, so
+* iterating a chunk is a linear scan and a reused chunk does not allocate at all.
+*
+* If blocks are added with their values, the chunk also keeps two arrays indexed
+* like the blocks: the value of each block and, per partition, the same values
+* sorted in descending order (the partition's signature). Both are computed once
+* when the partition is added, so a pair of partitions can be compared without
+* summing or sorting anything.
+*/
+class PartitionChunk {
+private:
+   std::vector<ElementIndex> elements;
+   std::vector<uint32_t> block_offsets{0};
+   std::vector<uint32_t> partition_offsets{0};
+   std::vector<double> block_sums;
+   std::vector<double> signatures;
+
+   friend struct PartitionView;
+
+public:
+   // Remove all partitions, keeping the capacity
+   void clear() {
+       elements.clear();
+       block_offsets.assign(1, 0);
+       partition_offsets.assign(1, 0);
+       block_sums.clear();
+       signatures.clear();
+   }
+
+   void reserve(size_t partitions, size_t elements_per_partition) {
+       elements.reserve(partitions * elements_per_partition);
+       block_offsets.reserve(partitions * elements_per_partition + 1);
+       partition_offsets.reserve(partitions + 1);
+   }
+
+   // Reserve the value arrays as well, for chunks whose blocks are added with values
+   void reserve_values(size_t partitions, size_t elements_per_partition) {
+       block_sums.reserve(partitions * elements_per_partition);
+       signatures.reserve(partitions * elements_per_partition);
+   }
+
+   size_t size() const {
+       return partition_offsets.size() - 1;
+   }
+
+   bool empty() const {
+       return size() == 0;
+   }
+
+   // Number of groups of partition p
+   size_t group_count(size_t p) const {
+       return partition_offsets[p + 1] - partition_offsets[p];
+   }
+
+   PartitionView operator[](size_t p) const {
+       return {this, p};
+   }
+
+   // Append a block to the partition under construction
+   template <typename Iterator>
+   void add_block(Iterator first, Iterator last) {
+       elements.insert(elements.end(), first, last);
+       block_offsets.push_back(static_cast<uint32_t>(elements.size()));
+   }
+
+   // Append a block and its value to the partition under construction
+   template <typename Iterator>
+   void add_block(Iterator first, Iterator last, double sum) {
+       add_block(first, last);
+       block_sums.push_back(sum);
+   }
+
+   // Close the partition under construction; computes its signature if its blocks have values
+   void end_partition() {
+       partition_offsets.push_back(static_cast<uint32_t>(block_offsets.size() - 1));
+       if (has_values()) {
+           size_t first_block = partition_offsets[partition_offsets.size() - 2];
+           signatures.insert(signatures.end(), block_sums.begin() + first_block, block_sums.end());
+           sort_descending(signatures.data() + first_block, signatures.data() + signatures.size());
+       }
+   }
+
+   // Whether every block was added with its value
+   bool has_values() const {
+       return !block_sums.empty() && block_sums.size() == block_offsets.size() - 1;
+   }
+
+   void push_back(const IndexPartition& partition) {
+       for (const auto& block : partition) {
+           add_block(block.begin(), block.end());
+       }
+       end_partition();
+   }
+
+   // Bytes occupied by the partitions in the three arrays
+   size_t memory_bytes() const {
+       return elements.size() * sizeof(ElementIndex) +
+              (block_offsets.size() + partition_offsets.size()) * sizeof(uint32_t) +
+              (block_sums.size() + signatures.size()) * sizeof(double);
+   }
+};
+
+inline size_t PartitionView::size() const {
+   return chunk->group_count(index);
+}
+
+inline BlockView PartitionView::operator[](size_t block) const {
+   size_t b = chunk->partition_offsets[index] + block;
+   const ElementIndex* data = chunk->elements.data();
+   return {data + chunk->block_offsets[b], data + chunk->block_offsets[b + 1]};
+}
+
+inline ValuesView PartitionView::block_sums() const {
+   const double* data = chunk->block_sums.data();
+   return {data + chunk->partition_offsets[index], data + chunk->partition_offsets[index + 1]};
+}
+
+inline ValuesView PartitionView::signature() const {
+   const double* data = chunk->signatures.data();
+   return {data + chunk->partition_offsets[index], data + chunk->partition_offsets[index + 1]};
+}
+
+inline IndexPartition PartitionView::to_index_partition() const {
+   IndexPartition partition(size());
+   for (size_t b = 0; b < partition.size(); ++b) {
+       BlockView block = (*this)[b];
+       partition[b].assign(block.begin(), block.end());
+   }
+   return partition;
+}
+
+#endif // PARTITION_CHUNK_H
@@ -0,0 +1,152 @@
+#ifndef PROGRESS_MODEL_H
+#define PROGRESS_MODEL_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include "bell_number.h"
+#include "run_metrics.h"
+
+/**
+* Estimates progress and remaining time of a partition analysis in units of work
+* instead of input partitions.
+*
+* The pairs of one stratum (input and output partitions with k groups) number
+* S(n,k)*S(m,k), and a pair that survives pruning costs k! permutation checks, so
+* the work per input partition varies by orders of magnitude between strata.
+* Each stratum is therefore weighted by the measured cost of one of its pairs:
+*
+*     weight(k) = pair overhead + checked fraction * k! * cost per permutation
+*
+* where all three terms are taken from the run metrics. The ETA divides the
+* remaining work by an exponentially smoothed throughput in work units per second,
+* which adapts when the thread count changes or the analysis enters a cheaper or
+* more expensive stratum.
+*/
+class ProgressModel {
+private:
+   std::vector<double> total_pairs_by_k;
+   std::vector<double> done_pairs_by_k;
+   std::vector<double> last_done_pairs_by_k;
+   std::vector<double> weight_by_k;
+   std::vector<double> permutations_by_k;
+
+   double smoothing;
+   double smoothed_rate = 0.0;    // Work units (ns of worker time) per wall-clock second
+   std::chrono::steady_clock::time_point last_update;
+
+   double work(const std::vector<double>& pairs_by_k) const {
+       double total = 0.0;
+       for (size_t k = 0; k < pairs_by_k.size(); ++k) {
+           total += pairs_by_k[k] * weight_by_k[k];
+       }
+       return total;
+   }
+
+   // Re-derive the stratum weights from the costs measured so far
+   void update_weights(const RunMetrics& metrics) {
+       double pairs = static_cast<double>(metrics.pairs_processed.load());
+       double permutations = static_cast<double>(metrics.permutations_tested.load());
+       if (pairs == 0.0 || permutations == 0.0) return;
+
+       double pair_ns = (metrics.generation_ns + metrics.pruning_ns) / pairs;
+       double permutation_ns = (metrics.permutation_ns + metrics.formatting_ns + metrics.io_wait_ns) / permutations;
+       double checked_fraction = metrics.checked_count / pairs;
+
+       for (size_t k = 0; k < weight_by_k.size(); ++k) {
+           weight_by_k[k] = pair_ns + checked_fraction * permutations_by_k[k] * permutation_ns;
+       }
+   }
+
+public:
+   /**
+   * @param num_inputs Number of input elements n
+   * @param num_outputs Number of output elements m
+   * @param smoothing_factor Weight of the newest throughput sample in the moving average
+   */
+   ProgressModel(size_t num_inputs, size_t num_outputs, double smoothing_factor = 0.3)
+       : smoothing(smoothing_factor), last_update(std::chrono::steady_clock::now()) {
+       size_t max_k = std::min(num_inputs, num_outputs);
+       auto input_stirling = stirling_table_double(num_inputs);
+       auto output_stirling = stirling_table_double(num_outputs);
+
+       total_pairs_by_k.assign(max_k + 1, 0.0);
+       done_pairs_by_k.assign(max_k + 1, 0.0);
+       last_done_pairs_by_k.assign(max_k + 1, 0.0);
+       weight_by_k.assign(max_k + 1, 0.0);
+       permutations_by_k.assign(max_k + 1, 0.0);
+
+       // Until costs are measured, assume a pair costs as much as one permutation
+       double permutations = 1.0;
+       for (size_t k = 1; k <= max_k; ++k) {
+           permutations *= k;
+           total_pairs_by_k[k] = input_stirling[num_inputs][k] * output_stirling[num_outputs][k];
+           permutations_by_k[k] = permutations;
+           weight_by_k[k] = 1.0 + permutations;
+       }
+   }
+
+   // Record finished pairs of the stratum with k groups
+   void record_pairs(size_t k, uint64_t count) {
+       if (k < done_pairs_by_k.size()) {
+           done_pairs_by_k[k] += static_cast<double>(count);
+       }
+   }
+
+   /**
+   * Completed fraction of the estimated work, in [0, 1].
+   */
+   double fraction() const {
+       double total = work(total_pairs_by_k);
+       if (total <= 0.0) return 1.0;
+       return std::min(1.0, work(done_pairs_by_k) / total);
+   }
+
+   /**
+   * Refreshes the weights and the smoothed throughput; call periodically.
+   *
+   * @param metrics Metrics of the running analysis
+   * @return Estimated seconds remaining, or -1 if no throughput is known yet
+   */
+   double update(const RunMetrics& metrics) {
+       update_weights(metrics);
+
+       auto now = std::chrono::steady_clock::now();
+       double seconds = std::chrono::duration<double>(now - last_update).count();
+       if (seconds > 0.0) {
+           // Measure the work done since the last update with the current weights
+           double delta_work = 0.0;
+           for (size_t k = 0; k < done_pairs_by_k.size(); ++k) {
+               delta_work += (done_pairs_by_k[k] - last_done_pairs_by_k[k]) * weight_by_k[k];
+           }
+           double rate = delta_work / seconds;
+           smoothed_rate = (smoothed_rate == 0.0) ? rate : smoothing * rate + (1.0 - smoothing) * smoothed_rate;
+
+           last_done_pairs_by_k = done_pairs_by_k;
+           last_update = now;
+       }
+
+       if (smoothed_rate <= 0.0) return -1.0;
+       double remaining = std::max(0.0, work(total_pairs_by_k) - work(done_pairs_by_k));
+       return remaining / smoothed_rate;
+   }
+};
+
+/**
+* Formats a duration in seconds as e.g. "2h 5m", "3m 12s" or "42s".
+*/
+std::string format_eta(double seconds) {
+   if (seconds < 0.0) return "--";
+   if (seconds > 3600) {
+       return std::to_string(static_cast<long long>(seconds / 3600)) + "h " +
+              std::to_string(static_cast<int>((static_cast<long long>(seconds) % 3600) / 60)) + "m";
+   }
+   if (seconds > 60) {
+       return std::to_string(static_cast<int>(seconds / 60)) + "m " +
+              std::to_string(static_cast<int>(static_cast<long long>(seconds) % 60)) + "s";
+   }
+   return std::to_string(static_cast<int>(seconds)) + "s";
+}
+
+#endif // PROGRESS_MODEL_H
@@ -0,0 +1,215 @@
+#ifndef RUN_METRICS_H
+#define RUN_METRICS_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sys/resource.h>
+#include <nlohmann/json.hpp>
+
+/**
+* Returns the nanoseconds elapsed since the given time point.
+*/
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+   return static_cast<uint64_t>(
+       std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+* Per-thread accumulator for phase times and counters.
+* Worker threads fill one of these without synchronization and merge it
+* into the shared RunMetrics once per batch. Pruning runs on the coordinator
+* and is added to RunMetrics directly.
+*/
+struct PhaseCounters {
+   uint64_t permutation_ns = 0;
+   uint64_t formatting_ns = 0;
+   uint64_t io_wait_ns = 0;
+   uint64_t permutations_tested = 0;
+   uint64_t bytes_written = 0;
+};
+
+// Upper bound of worker threads, see default_thread_count()
+constexpr size_t MAX_WORKER_THREADS = 16;
+
+/**
+* Metrics collected over one analysis run.
+* Phase times are summed over all threads, so with several worker threads
+* they can exceed the wall-clock time.
+*/
+struct RunMetrics {
+   // Counters shared with the progress display
+   std::atomic<size_t> valid_count{0};
+   std::atomic<size_t> pruned_count{0};
+   std::atomic<size_t> checked_count{0};
+
+   // Phase times in nanoseconds
+   std::atomic<uint64_t> generation_ns{0};
+   std::atomic<uint64_t> pruning_ns{0};
+   std::atomic<uint64_t> permutation_ns{0};
+   std::atomic<uint64_t> formatting_ns{0};
+   std::atomic<uint64_t> io_wait_ns{0};
+
+   // Work counters
+   std::atomic<uint64_t> pairs_processed{0};
+   std::atomic<uint64_t> permutations_tested{0};
+   std::atomic<uint64_t> bytes_written{0};
+
+   // Partitions generated per group count, only updated by the generating thread
+   std::vector<uint64_t> input_partitions_by_k;
+   std::vector<uint64_t> output_partitions_by_k;
+
+   // Live state read by the metrics exporter
+   std::atomic<uint64_t> queued_pairs{0};           // Pairs dispatched to workers and not yet finished
+   std::atomic<uint64_t> worker_busy_ns[MAX_WORKER_THREADS];
+   std::atomic<double> progress{0.0};
+   std::atomic<double> eta_seconds{-1.0};
+   unsigned int threads = 1;
+
+   std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+   RunMetrics() {
+       for (auto& busy_ns : worker_busy_ns) {
+           busy_ns = 0;
+       }
+   }
+
+   // Merge the counters of one worker batch
+   void add(const PhaseCounters& counters) {
+       permutation_ns.fetch_add(counters.permutation_ns, std::memory_order_relaxed);
+       formatting_ns.fetch_add(counters.formatting_ns, std::memory_order_relaxed);
+       io_wait_ns.fetch_add(counters.io_wait_ns, std::memory_order_relaxed);
+       permutations_tested.fetch_add(counters.permutations_tested, std::memory_order_relaxed);
+       bytes_written.fetch_add(counters.bytes_written, std::memory_order_relaxed);
+   }
+
+   /**
+   * Adds the counters of a finished analysis, e.g. one transaction of a block.
+   *
+   * @param other The finished analysis
+   * @param first_worker Worker slot that other's slot 0 is counted in
+   */
+   void merge(const RunMetrics& other, unsigned int first_worker = 0) {
+       valid_count.fetch_add(other.valid_count, std::memory_order_relaxed);
+       pruned_count.fetch_add(other.pruned_count, std::memory_order_relaxed);
+       checked_count.fetch_add(other.checked_count, std::memory_order_relaxed);
+       generation_ns.fetch_add(other.generation_ns, std::memory_order_relaxed);
+       pruning_ns.fetch_add(other.pruning_ns, std::memory_order_relaxed);
+       permutation_ns.fetch_add(other.permutation_ns, std::memory_order_relaxed);
+       formatting_ns.fetch_add(other.formatting_ns, std::memory_order_relaxed);
+       io_wait_ns.fetch_add(other.io_wait_ns, std::memory_order_relaxed);
+       pairs_processed.fetch_add(other.pairs_processed, std::memory_order_relaxed);
+       permutations_tested.fetch_add(other.permutations_tested, std::memory_order_relaxed);
+       bytes_written.fetch_add(other.bytes_written, std::memory_order_relaxed);
+       for (size_t i = 0; i + first_worker < MAX_WORKER_THREADS; ++i) {
+           worker_busy_ns[i + first_worker].fetch_add(other.worker_busy_ns[i], std::memory_order_relaxed);
+       }
+   }
+
+   // Record a generated partition with k groups
+   static void count_partition(std::vector<uint64_t>& by_k, size_t k) {
+       if (by_k.size() <= k) {
+           by_k.resize(k + 1, 0);
+       }
+       by_k[k]++;
+   }
+};
+
+/**
+* Returns the peak resident set size of this process in bytes.
+*/
+uint64_t peak_rss_bytes() {
+   struct rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) != 0) {
+       return 0;
+   }
+#ifdef __APPLE__
+   return static_cast<uint64_t>(usage.ru_maxrss);         // bytes on macOS
+#else
+   return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // kilobytes on Linux
+#endif
+}
+
+/**
+* Derives the metrics report filename from the results filename,
+* e.g. "valid_mappings.csv" becomes "valid_mappings.metrics.json".
+*/
+std::string metrics_report_filename(const std::string& output_filename) {
+   std::string base = output_filename;
+   size_t dot = base.find_last_of('.');
+   size_t slash = base.find_last_of('/');
+   if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+       base = base.substr(0, dot);
+   }
+   return base + ".metrics.json";
+}
+
+/**
+* Writes the metrics of a run as a JSON report next to the results file.
+*
+* @param metrics The collected metrics
+* @param analysis Name of the analysis ("subset" or "partition")
+* @param output_filename The results file the report belongs to
+* @param num_inputs Number of transaction inputs
+* @param num_outputs Number of transaction outputs
+* @param num_threads Number of worker threads used
+* @return true if the report was written, false otherwise
+*/
+bool write_metrics_report(
+   const RunMetrics& metrics,
+   const std::string& analysis,
+   const std::string& output_filename,
+   size_t num_inputs,
+   size_t num_outputs,
+   unsigned int num_threads
+) {
+   auto seconds = [](uint64_t ns) { return static_cast<double>(ns) / 1e9; };
+
+   nlohmann::ordered_json report;
+   report["analysis"] = analysis;
+   report["results_file"] = output_filename;
+   report["inputs"] = num_inputs;
+   report["outputs"] = num_outputs;
+   report["threads"] = num_threads;
+   report["wall_seconds"] = seconds(elapsed_ns(metrics.start_time));
+
+   report["phase_seconds"] = {
+       {"generation", seconds(metrics.generation_ns)},
+       {"pruning", seconds(metrics.pruning_ns)},
+       {"permutation_checking", seconds(metrics.permutation_ns)},
+       {"formatting", seconds(metrics.formatting_ns)},
+       {"io_wait", seconds(metrics.io_wait_ns)}
+   };
+
+   report["counters"] = {
+       {"pairs_processed", metrics.pairs_processed.load()},
+       {"pairs_pruned", metrics.pruned_count.load()},
+       {"pairs_checked", metrics.checked_count.load()},
+       {"permutations_tested", metrics.permutations_tested.load()},
+       {"valid_mappings", metrics.valid_count.load()},
+       {"bytes_written", metrics.bytes_written.load()}
+   };
+
+   report["partitions_generated_by_k"] = {
+       {"inputs", metrics.input_partitions_by_k},
+       {"outputs", metrics.output_partitions_by_k}
+   };
+
+   report["peak_rss_bytes"] = peak_rss_bytes();
+
+   std::string report_filename = metrics_report_filename(output_filename);
+   std::ofstream report_file(report_filename);
+   if (!report_file.is_open()) {
+       std::cerr << "Error: Could not open metrics report file " << report_filename << std::endl;
+       return false;
+   }
+
+   report_file << report.dump(2) << std::endl;
+   std::cout << "Metrics report has been written to: " << report_filename << std::endl;
+   return true;
+}
+
+#endif // RUN_METRICS_H
@@ -0,0 +1,38 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+/**
+* Monotonic arena over a fixed buffer that lives with its owner, normally on the
+* stack of the thread that uses it.
+*
+* Scratch vectors of the pair checks (block values, sorted signatures, permutation
+* indices) are allocated from it as std::pmr containers and released all at once
+* with reset(), so checking a pair does not call malloc or free and the worker
+* threads never contend on the global allocator. Only if a pair needs more than
+* the buffer, the arena falls back to the default heap resource.
+*/
+template <size_t Bytes = 4096>
+class ScratchArena {
+private:
+   alignas(std::max_align_t) std::byte buffer[Bytes];
+   std::pmr::monotonic_buffer_resource resource{buffer, Bytes};
+
+public:
+   ScratchArena() = default;
+   ScratchArena(const ScratchArena&) = delete;
+   ScratchArena& operator=(const ScratchArena&) = delete;
+
+   std::pmr::memory_resource* get() {
+       return &resource;
+   }
+
+   // Release everything allocated since the last reset
+   void reset() {
+       resource.release();
+   }
+};
+
+#endif // SCRATCH_ARENA_H
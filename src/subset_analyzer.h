@@ -5,8 +5,13 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include "transaction_data.h"
 #include "subset_generator.h"
+#include "subset_sum_table.h"
+#include "run_metrics.h"
+#include "mapping_sink.h"
+#include "worker_pool.h"
 
 /**
 * Finds valid combinations of input and output subsets and writes them to a file.
@@ -17,15 +22,19 @@
 * @param input_subsets A vector of input subset vectors
 * @param output_subsets A vector of output subset vectors
 * @param output_filename The name of the file to write results to
+* @param metrics Run metrics; every compared subset pair counts as one checked pair
+*                and one tested permutation
 * @return The number of valid combinations found
 */
 size_t find_valid_combinations(
    const TransactionData& tx_data,
    const std::vector<std::vector<std::string>>& input_subsets,
    const std::vector<std::vector<std::string>>& output_subsets,
-   const std::string& output_filename = "valid_combinations.csv"
+   const std::string& output_filename,
+   RunMetrics& metrics
 ) {
    size_t valid_count = 0;
+   PhaseCounters counters;
    
    std::cout << "Finding valid combinations of input and output subsets..." << std::endl;
    std::cout << "A combination is valid if output_value <= input_value" << std::endl;
@@ -40,10 +49,15 @@ size_t find_valid_combinations(
    }
    
    // Write CSV header
-   output_file << "Combination_ID,Input_Subset,Input_Value,Output_Subset,Output_Value,Difference\n";
+   const std::string csv_header = "Combination_ID,Input_Subset,Input_Value,Output_Subset,Output_Value,Difference\n";
+   output_file << csv_header;
+   counters.bytes_written += csv_header.size();
    
    // Iterate through all input subsets
    for (const auto& input_subset : input_subsets) {
+       auto check_start = std::chrono::steady_clock::now();
+       uint64_t formatting_and_io_before = counters.formatting_ns + counters.io_wait_ns;
+       
        // Calculate the total value of this input subset
        double input_value = calculate_subset_value(tx_data, input_subset, SubsetType::INPUTS);
        
@@ -55,6 +69,7 @@ size_t find_valid_combinations(
            // Check if this is a valid combination (output value <= input value)
            if (output_value <= input_value) {
                valid_count++;
+               auto format_start = std::chrono::steady_clock::now();
                
                // Format input subset as string
                std::string input_str = "\"";
@@ -76,22 +91,39 @@ size_t find_valid_combinations(
                }
                output_str += "\"";
                
+               std::stringstream row;
+               row << valid_count << ","
+                   << input_str << ","
+                   << input_value << ","
+                   << output_str << ","
+                   << output_value << ","
+                   << (input_value - output_value) << "\n";
+               std::string csv_row = row.str();
+               counters.formatting_ns += elapsed_ns(format_start);
+               
                // Write to CSV file
-               output_file << valid_count << ","
-                          << input_str << ","
-                          << input_value << ","
-                          << output_str << ","
-                          << output_value << ","
-                          << (input_value - output_value) << "\n";
+               auto io_start = std::chrono::steady_clock::now();
+               output_file << csv_row;
                
                // Periodically flush to ensure data is written
                if (valid_count % 1000 == 0) {
                    output_file.flush();
                }
+               counters.io_wait_ns += elapsed_ns(io_start);
+               counters.bytes_written += csv_row.size();
            }
        }
+       
+       uint64_t formatting_and_io = counters.formatting_ns + counters.io_wait_ns - formatting_and_io_before;
+       counters.permutation_ns += elapsed_ns(check_start) - formatting_and_io;
+       counters.permutations_tested += output_subsets.size();
    }
    
+   metrics.add(counters);
+   metrics.pairs_processed += input_subsets.size() * output_subsets.size();
+   metrics.checked_count += input_subsets.size() * output_subsets.size();
+   metrics.valid_count += valid_count;
+   
    // Close the file
    output_file.close();
    
@@ -99,23 +131,194 @@ size_t find_valid_combinations(
    std::cout << "Total valid combinations found: " << valid_count << std::endl;
    std::cout << "Results have been written to: " << output_filename << std::endl;
    
+   write_metrics_report(metrics, "subset", output_filename,
+                        tx_data.get_input_ids().size(), tx_data.get_output_ids().size(), 1);
+   
    return valid_count;
 }
 
 /**
-* Overloaded version that generates the subsets internally.
+* Overloaded version that collects its metrics in a fresh RunMetrics.
 * 
 * @param tx_data The transaction data containing inputs and outputs
+* @param input_subsets A vector of input subset vectors
+* @param output_subsets A vector of output subset vectors
 * @param output_filename The name of the file to write results to
 * @return The number of valid combinations found
 */
-size_t find_valid_combinations(const TransactionData& tx_data, const std::string& output_filename = "valid_combinations.csv") {
-   // Generate all non-empty subsets of inputs and outputs
-   auto input_subsets = generate_subsets(tx_data, SubsetType::INPUTS);
-   auto output_subsets = generate_subsets(tx_data, SubsetType::OUTPUTS);
+size_t find_valid_combinations(
+   const TransactionData& tx_data,
+   const std::vector<std::vector<std::string>>& input_subsets,
+   const std::vector<std::vector<std::string>>& output_subsets,
+   const std::string& output_filename = "valid_combinations.csv"
+) {
+   RunMetrics metrics;
+   return find_valid_combinations(tx_data, input_subsets, output_subsets, output_filename, metrics);
+}
+
+// Input subsets between two calls of AnalysisControl::at_chunk_boundary
+constexpr uint64_t SUBSET_CHUNK_INPUTS = 1024;
+
+/**
+* Finds valid combinations of all non-empty input and output subsets and writes them
+* to a sink. Subsets are enumerated as bit masks in the order of generate_subsets and
+* their values are taken from subset sum tables built once (build_subset_sum_table), so the loop
+* compares two array entries per pair; IDs are only looked up to format the rows
+* that are written. The results are identical to the version taking string subsets.
+* 
+* @param tx_data The transaction data containing inputs and outputs
+* @param sink Destination of the CSV rows; if it does not want mappings they are only counted
+* @param metrics Run metrics; every compared subset pair counts as one checked pair
+*                and one tested permutation
+* @param control Its callback is called after every block of input subsets, where the
+*                analysis also stops once it is cancelled
+* @param pool Workers that build large subset sum tables; without one they are built on the calling thread
+* @return The number of valid combinations found
+*/
+size_t find_valid_combinations(const TransactionData& tx_data, MappingSink& sink, RunMetrics& metrics,
+                               const AnalysisControl& control = AnalysisControl(), WorkerPool* pool = nullptr) {
+   const auto& input_ids = tx_data.get_input_ids();
+   const auto& output_ids = tx_data.get_output_ids();
+   if (input_ids.size() > SubsetSumTable::MAX_VALUES || output_ids.size() > SubsetSumTable::MAX_VALUES) {
+       std::cerr << "Error: Subset analysis supports at most " << SubsetSumTable::MAX_VALUES
+                 << " inputs and outputs" << std::endl;
+       return 0;
+   }
+   
+   bool write_mappings = sink.wants_mappings();
+   size_t valid_count = 0;
+   PhaseCounters counters;
+   
+   // Write CSV header
+   if (write_mappings) {
+       const std::string csv_header = "Combination_ID,Input_Subset,Input_Value,Output_Subset,Output_Value,Difference\n";
+       sink.write(csv_header);
+       counters.bytes_written += csv_header.size();
+   }
+   
+   // Value of every input and output subset
+   auto generation_start = std::chrono::steady_clock::now();
+   TransactionValues values(tx_data);
+   SubsetSumTable input_values = build_subset_sum_table(values.inputs(), pool, control.priority);
+   SubsetSumTable output_values = build_subset_sum_table(values.outputs(), pool, control.priority);
+   metrics.generation_ns += elapsed_ns(generation_start);
+   if (input_values.empty() || output_values.empty()) {
+       return 0;
+   }
+   
+   size_t input_subset_count = input_values.size() - 1;
+   size_t output_subset_count = output_values.size() - 1;
+   
+   // Iterate through all input subsets
+   for (uint64_t input_mask = 1; input_mask < input_values.size(); ++input_mask) {
+       auto check_start = std::chrono::steady_clock::now();
+       uint64_t formatting_and_io_before = counters.formatting_ns + counters.io_wait_ns;
+       double input_value = input_values[input_mask];
+       
+       // Iterate through all output subsets
+       for (uint64_t output_mask = 1; output_mask < output_values.size(); ++output_mask) {
+           double output_value = output_values[output_mask];
+           
+           // Check if this is a valid combination (output value <= input value)
+           if (output_value <= input_value) {
+               valid_count++;
+               if (!write_mappings) {
+                   continue;
+               }
+               auto format_start = std::chrono::steady_clock::now();
+               
+               std::stringstream row;
+               row << valid_count << ","
+                   << format_mask_ids(input_ids, input_mask) << ","
+                   << input_value << ","
+                   << format_mask_ids(output_ids, output_mask) << ","
+                   << output_value << ","
+                   << (input_value - output_value) << "\n";
+               std::string csv_row = row.str();
+               counters.formatting_ns += elapsed_ns(format_start);
+               
+               // Write to the sink
+               auto io_start = std::chrono::steady_clock::now();
+               sink.write(csv_row);
+               counters.io_wait_ns += elapsed_ns(io_start);
+               counters.bytes_written += csv_row.size();
+           }
+       }
+       
+       uint64_t formatting_and_io = counters.formatting_ns + counters.io_wait_ns - formatting_and_io_before;
+       counters.permutation_ns += elapsed_ns(check_start) - formatting_and_io;
+       counters.permutations_tested += output_subset_count;
+       
+       // A block of input subsets plays the role of a chunk for the callback
+       if (input_mask % SUBSET_CHUNK_INPUTS == 0) {
+           // Rows are buffered by the sink and written out once per block
+           auto io_start = std::chrono::steady_clock::now();
+           sink.flush();
+           counters.io_wait_ns += elapsed_ns(io_start);
+           
+           if (control.at_chunk_boundary) {
+               control.at_chunk_boundary({});  // The subset sum tables are needed to go on
+           }
+           if (control.cancelled()) {
+               input_subset_count = input_mask;
+               break;
+           }
+       }
+   }
+   sink.flush();
    
-   // Find valid combinations and write to file
-   return find_valid_combinations(tx_data, input_subsets, output_subsets, output_filename);
+   metrics.add(counters);
+   metrics.pairs_processed += input_subset_count * output_subset_count;
+   metrics.checked_count += input_subset_count * output_subset_count;
+   metrics.valid_count += valid_count;
+   
+   return valid_count;
+}
+
+/**
+* Finds valid combinations of all non-empty input and output subsets and writes them
+* to a file (see the version taking a sink).
+* 
+* @param tx_data The transaction data containing inputs and outputs
+* @param output_filename The name of the file to write results to
+* @param metrics Run metrics; every compared subset pair counts as one checked pair
+*                and one tested permutation
+* @return The number of valid combinations found
+*/
+size_t find_valid_combinations(const TransactionData& tx_data, const std::string& output_filename, RunMetrics& metrics) {
+   std::cout << "Finding valid combinations of input and output subsets..." << std::endl;
+   std::cout << "A combination is valid if output_value <= input_value" << std::endl;
+   std::cout << "Results will be written to: " << output_filename << std::endl;
+   std::cout << "-----------------------------------------------------------" << std::endl;
+   
+   // Open output file
+   FileMappingSink output_file(output_filename);
+   if (!output_file.is_open()) {
+       return 0;
+   }
+   
+   size_t valid_count = find_valid_combinations(tx_data, output_file, metrics);
+   
+   std::cout << "-----------------------------------------------------------" << std::endl;
+   std::cout << "Total valid combinations found: " << valid_count << std::endl;
+   std::cout << "Results have been written to: " << output_filename << std::endl;
+   
+   write_metrics_report(metrics, "subset", output_filename,
+                        tx_data.get_input_ids().size(), tx_data.get_output_ids().size(), 1);
+   
+   return valid_count;
+}
+
+/**
+* Overloaded version that collects its metrics in a fresh RunMetrics.
+* 
+* @param tx_data The transaction data containing inputs and outputs
+* @param output_filename The name of the file to write results to
+* @return The number of valid combinations found
+*/
+size_t find_valid_combinations(const TransactionData& tx_data, const std::string& output_filename = "valid_combinations.csv") {
+   RunMetrics metrics;
+   return find_valid_combinations(tx_data, output_filename, metrics);
 }
 
 #endif // SUBSET_ANALYZER_H
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
 #include "transaction_data.h"
 
 /**
@@ -79,6 +80,71 @@ double calculate_subset_value(const TransactionData& tx_data,
    return total;
 }
 
+/**
+* Calculates the sum of values of a subset given by element indices.
+* Values are added in the order of the indices, starting from 0.0, so the result is
+* bit-identical to the string-based version for the same elements.
+* 
+* @param values The transaction values indexed by element index
+* @param indices Indices of the elements of the subset, e.g. an IndexSet or a block of a partition
+* @param type Specifies whether the subset contains inputs or outputs
+* @return The sum of values for the given subset
+*/
+template <typename Indices>
+double calculate_subset_value(const TransactionValues& values, const Indices& indices, SubsetType type) {
+   const std::vector<double>& element_values = (type == SubsetType::INPUTS) ? values.inputs() : values.outputs();
+   double total = 0.0;
+   for (auto index : indices) {
+       total += element_values[index];
+   }
+   return total;
+}
+
+/**
+* Calculates the sum of values of a subset given as a bit mask: bit j set means the
+* element with index j belongs to the subset. Values are added in ascending index
+* order, the order in which generate_subsets lists the IDs of the same subset.
+* 
+* @param values The transaction values indexed by element index
+* @param mask Bit mask of the subset
+* @param type Specifies whether the subset contains inputs or outputs
+* @return The sum of values for the given subset
+*/
+double calculate_mask_value(const TransactionValues& values, uint64_t mask, SubsetType type) {
+   const std::vector<double>& element_values = (type == SubsetType::INPUTS) ? values.inputs() : values.outputs();
+   double total = 0.0;
+   for (size_t j = 0; mask != 0; ++j, mask >>= 1) {
+       if (mask & 1) {
+           total += element_values[j];
+       }
+   }
+   return total;
+}
+
+/**
+* Formats the IDs of a subset given as a bit mask as a quoted, comma separated list,
+* as it appears in the results CSV.
+* 
+* @param ids The input or output IDs
+* @param mask Bit mask of the subset
+* @return The quoted ID list
+*/
+std::string format_mask_ids(const std::vector<std::string>& ids, uint64_t mask) {
+   std::string result = "\"";
+   bool first = true;
+   for (size_t j = 0; j < ids.size(); ++j) {
+       if (mask & (1ULL << j)) {
+           if (!first) {
+               result += ",";
+           }
+           result += ids[j];
+           first = false;
+       }
+   }
+   result += "\"";
+   return result;
+}
+
 /**
 * Utility function to print a subset for debugging purposes.
 * 
@@ -0,0 +1,199 @@
+#ifndef SUBSET_SUM_TABLE_H
+#define SUBSET_SUM_TABLE_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include "run_metrics.h"
+#include "worker_pool.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SUBSET_SUM_TABLE_X86 1
+#endif
+
+/**
+* Sums of all subsets of n values, indexed by bit mask: entry mask is the sum of
+* value[j] over the bits j set in mask, entry 0 is the empty subset.
+*
+* The table is built in n doubling passes. After pass j the first 2^(j+1) entries
+* are final, and pass j fills the upper half from the lower half:
+*
+*     sums[2^j + i] = sums[i] + value[j]     for i < 2^j
+*
+* Every entry is therefore summed in ascending bit order starting from 0.0, exactly
+* like calculate_mask_value, so the sums are bit-identical to it. A pass is a
+* streaming add over a contiguous range: it is vectorized with AVX2 when the CPU
+* supports it, split across the workers of a WorkerPool when it is large, and uses non-temporal
+* stores when the table is too large to stay in cache anyway.
+*/
+class SubsetSumTable {
+private:
+   struct FreeDeleter {
+       void operator()(double* p) const { std::free(p); }
+   };
+
+   std::unique_ptr<double[], FreeDeleter> sums;
+   size_t count = 0;
+
+public:
+   static constexpr size_t ALIGNMENT = 64;
+   static constexpr size_t HUGE_PAGE_BYTES = size_t{2} << 20;
+   // Most values a table can hold: 2^n doubles, rounded up to a huge page, must fit in size_t
+   static constexpr size_t MAX_VALUES = std::numeric_limits<size_t>::digits - 4;
+
+   SubsetSumTable() = default;
+
+   // Allocates an uninitialized table of 2^n entries; empty if the allocation fails
+   explicit SubsetSumTable(size_t n) {
+       if (n > MAX_VALUES) {
+           return;
+       }
+       size_t entries = size_t{1} << n;
+       if (entries > std::numeric_limits<size_t>::max() / sizeof(double)) {
+           return;
+       }
+       size_t bytes = entries * sizeof(double);
+       bool huge = bytes >= HUGE_PAGE_BYTES;
+       size_t alignment = huge ? HUGE_PAGE_BYTES : ALIGNMENT;
+       bytes = (bytes + alignment - 1) / alignment * alignment;
+       sums.reset(static_cast<double*>(std::aligned_alloc(alignment, bytes)));
+       count = sums ? entries : 0;
+#ifdef MADV_HUGEPAGE
+       // Large tables are written once front to back; huge pages save most of the page faults
+       if (sums && huge) {
+           madvise(sums.get(), bytes, MADV_HUGEPAGE);
+       }
+#endif
+   }
+
+   double operator[](uint64_t mask) const { return sums[mask]; }
+   size_t size() const { return count; }
+   bool empty() const { return count == 0; }
+   double* data() { return sums.get(); }
+   const double* data() const { return sums.get(); }
+};
+
+// Adds value to count entries of src and writes them to dst
+using SubsetSumPass = void (*)(const double* src, double* dst, size_t count, double value, bool streaming);
+
+// Plain stores only; the streaming flag is for kernels with non-temporal stores
+inline void subset_sum_pass_scalar(const double* src, double* dst, size_t count, double value, bool /*streaming*/) {
+   for (size_t i = 0; i < count; ++i) {
+       dst[i] = src[i] + value;
+   }
+}
+
+#ifdef SUBSET_SUM_TABLE_X86
+
+__attribute__((target("avx2")))
+inline void subset_sum_pass_avx2(const double* src, double* dst, size_t count, double value, bool streaming) {
+   size_t i = 0;
+
+   // Scalar head until dst is aligned for the (streaming) stores
+   while (i < count && reinterpret_cast<uintptr_t>(dst + i) % 32 != 0) {
+       dst[i] = src[i] + value;
+       ++i;
+   }
+
+   __m256d addend = _mm256_set1_pd(value);
+   if (streaming) {
+       for (; i + 16 <= count; i += 16) {
+           _mm256_stream_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(src + i), addend));
+           _mm256_stream_pd(dst + i + 4, _mm256_add_pd(_mm256_loadu_pd(src + i + 4), addend));
+           _mm256_stream_pd(dst + i + 8, _mm256_add_pd(_mm256_loadu_pd(src + i + 8), addend));
+           _mm256_stream_pd(dst + i + 12, _mm256_add_pd(_mm256_loadu_pd(src + i + 12), addend));
+       }
+       // Make the non-temporal stores visible before the next pass reads them
+       _mm_sfence();
+   } else {
+       for (; i + 16 <= count; i += 16) {
+           _mm256_store_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(src + i), addend));
+           _mm256_store_pd(dst + i + 4, _mm256_add_pd(_mm256_loadu_pd(src + i + 4), addend));
+           _mm256_store_pd(dst + i + 8, _mm256_add_pd(_mm256_loadu_pd(src + i + 8), addend));
+           _mm256_store_pd(dst + i + 12, _mm256_add_pd(_mm256_loadu_pd(src + i + 12), addend));
+       }
+   }
+
+   for (; i < count; ++i) {
+       dst[i] = src[i] + value;
+   }
+}
+
+#endif
+
+/**
+* The pass kernel used for subset sum tables, chosen once from the instruction sets
+* the CPU supports.
+*/
+inline SubsetSumPass subset_sum_pass() {
+#ifdef SUBSET_SUM_TABLE_X86
+   static const SubsetSumPass pass = []() {
+       __builtin_cpu_init();
+       return __builtin_cpu_supports("avx2") ? subset_sum_pass_avx2 : subset_sum_pass_scalar;
+   }();
+   return pass;
+#else
+   return subset_sum_pass_scalar;
+#endif
+}
+
+/**
+* Builds the sums of all subsets of the given values.
+*
+* @param values The element values, at most SubsetSumTable::MAX_VALUES
+* @param pool Workers that share large passes; without one every pass runs on the calling thread
+* @param priority Priority of the pass tasks in the pool
+* @return The table, or an empty table if there are too many values or memory is short
+*/
+SubsetSumTable build_subset_sum_table(const std::vector<double>& values, WorkerPool* pool = nullptr,
+                                      unsigned priority = 0) {
+   // Passes below this many entries are not worth splitting, tables above this many bytes do not stay in cache
+   constexpr size_t PARALLEL_PASS_ENTRIES = size_t{1} << 16;
+   constexpr size_t STREAMING_TABLE_BYTES = size_t{32} << 20;
+
+   if (values.size() > SubsetSumTable::MAX_VALUES) {
+       std::cerr << "Error: Subset sum tables support at most " << SubsetSumTable::MAX_VALUES << " values" << std::endl;
+       return {};
+   }
+
+   SubsetSumTable table(values.size());
+   if (table.empty()) {
+       std::cerr << "Error: Could not allocate a subset sum table for " << values.size() << " values" << std::endl;
+       return {};
+   }
+
+   unsigned threads = pool ? pool->size() : 0;
+   SubsetSumPass pass = subset_sum_pass();
+   bool streaming = table.size() * sizeof(double) > STREAMING_TABLE_BYTES;
+   double* sums = table.data();
+   sums[0] = 0.0;
+
+   for (size_t j = 0; j < values.size(); ++j) {
+       size_t half = size_t{1} << j;
+       if (threads <= 1 || half < PARALLEL_PASS_ENTRIES) {
+           pass(sums, sums + half, half, values[j], streaming);
+           continue;
+       }
+
+       // Split the pass into contiguous ranges, aligned to cache lines
+       size_t per_task = (half / threads + 7) / 8 * 8;
+       unsigned tasks = static_cast<unsigned>((half + per_task - 1) / per_task);
+       pool->run(tasks, [&](unsigned task) {
+           size_t first = task * per_task;
+           pass(sums + first, sums + half + first, std::min(per_task, half - first), values[j], streaming);
+       }, priority);
+   }
+
+   return table;
+}
+
+#endif // SUBSET_SUM_TABLE_H
@@ -0,0 +1,224 @@
+#ifndef TRACE_EVENTS_H
+#define TRACE_EVENTS_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+/**
+* A completed scoped event on one thread.
+* Names must be string literals (or otherwise outlive the recorder).
+*/
+struct TraceEvent {
+   const char* name;
+   uint64_t start_ns;
+   uint64_t duration_ns;
+};
+
+/**
+* Fixed-capacity ring buffer of trace events owned by a single thread.
+* When full, the oldest events are overwritten so long runs keep their tail.
+*/
+struct TraceBuffer {
+   uint32_t thread_id;
+   std::string thread_name;
+   std::vector<TraceEvent> events;
+   size_t capacity;
+   size_t next = 0;         // Slot the next event is written to once the buffer is full
+   uint64_t dropped = 0;    // Number of overwritten events
+
+   TraceBuffer(uint32_t id, size_t cap) : thread_id(id), capacity(cap) {}
+
+   void record(const TraceEvent& event) {
+       if (events.size() < capacity) {
+           events.push_back(event);
+           return;
+       }
+       events[next] = event;
+       next = (next + 1) % capacity;
+       dropped++;
+   }
+};
+
+/**
+* Process-wide recorder for scoped trace events.
+* Recording is disabled by default; while disabled a TraceScope costs a single
+* relaxed atomic load. Each thread writes into its own buffer without locking,
+* the registry lock is only taken the first time a thread records an event and
+* when it exits.
+*
+* The buffer of a thread that exits keeps its events and is handed to the next
+* thread that starts recording, which continues on the same timeline row, so
+* short-lived threads (block workers, daemon connections) do not each leave a
+* buffer behind: there are only as many buffers as threads recorded at once.
+*/
+class TraceRecorder {
+private:
+   std::atomic<bool> enabled{false};
+   size_t capacity_per_thread = 1 << 16;
+   std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+   std::mutex buffers_mutex;
+   std::vector<std::unique_ptr<TraceBuffer>> buffers;
+   std::vector<TraceBuffer*> free_buffers;     // Buffers of threads that have exited
+
+   // Returns the buffer of the calling thread to the recorder when the thread exits
+   struct ThreadBufferHandle {
+       TraceBuffer* buffer = nullptr;
+
+       ~ThreadBufferHandle() {
+           if (buffer) {
+               TraceRecorder::instance().release_buffer(buffer);
+           }
+       }
+   };
+
+   void release_buffer(TraceBuffer* buffer) {
+       std::lock_guard<std::mutex> lock(buffers_mutex);
+       free_buffers.push_back(buffer);
+   }
+
+   TraceRecorder() = default;
+
+public:
+   static TraceRecorder& instance() {
+       static TraceRecorder recorder;
+       return recorder;
+   }
+
+   // Start recording; capacity is the number of events kept per thread
+   void enable(size_t events_per_thread = 1 << 16) {
+       capacity_per_thread = events_per_thread;
+       origin = std::chrono::steady_clock::now();
+       enabled.store(true, std::memory_order_relaxed);
+   }
+
+   void disable() {
+       enabled.store(false, std::memory_order_relaxed);
+   }
+
+   bool is_enabled() const {
+       return enabled.load(std::memory_order_relaxed);
+   }
+
+   uint64_t now_ns() const {
+       return static_cast<uint64_t>(
+           std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+   }
+
+   // Buffer of the calling thread, taken over from an exited thread or registered on first use
+   TraceBuffer& thread_buffer() {
+       thread_local ThreadBufferHandle handle;
+       if (handle.buffer == nullptr) {
+           std::lock_guard<std::mutex> lock(buffers_mutex);
+           if (!free_buffers.empty()) {
+               handle.buffer = free_buffers.back();
+               free_buffers.pop_back();
+           } else {
+               uint32_t id = static_cast<uint32_t>(buffers.size()) + 1;
+               buffers.push_back(std::make_unique<TraceBuffer>(id, capacity_per_thread));
+               handle.buffer = buffers.back().get();
+           }
+           handle.buffer->thread_name = "worker-" + std::to_string(handle.buffer->thread_id);
+       }
+       return *handle.buffer;
+   }
+
+   // Name the calling thread in the exported timeline
+   void set_thread_name(const std::string& name) {
+       if (is_enabled()) {
+           thread_buffer().thread_name = name;
+       }
+   }
+
+   /**
+   * Writes all recorded events as Chrome trace-event JSON, which can be opened
+   * in Perfetto (ui.perfetto.dev) or chrome://tracing.
+   * Must only be called while no other thread is recording.
+   *
+   * @param filename The trace file to write
+   * @return true if the file was written, false otherwise
+   */
+   bool write_chrome_trace(const std::string& filename) {
+       std::lock_guard<std::mutex> lock(buffers_mutex);
+
+       nlohmann::json trace_events = nlohmann::json::array();
+       uint64_t total_dropped = 0;
+
+       for (const auto& buffer : buffers) {
+           trace_events.push_back({
+               {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", buffer->thread_id},
+               {"args", {{"name", buffer->thread_name}}}
+           });
+
+           for (const auto& event : buffer->events) {
+               // Trace-event timestamps are in microseconds
+               trace_events.push_back({
+                   {"name", event.name}, {"cat", "btc_mapper"}, {"ph", "X"},
+                   {"ts", event.start_ns / 1000.0}, {"dur", event.duration_ns / 1000.0},
+                   {"pid", 1}, {"tid", buffer->thread_id}
+               });
+           }
+           total_dropped += buffer->dropped;
+       }
+
+       std::ofstream trace_file(filename);
+       if (!trace_file.is_open()) {
+           std::cerr << "Error: Could not open trace file " << filename << std::endl;
+           return false;
+       }
+
+       nlohmann::json trace = {
+           {"traceEvents", std::move(trace_events)},
+           {"displayTimeUnit", "ns"},
+           {"otherData", {{"dropped_events", total_dropped}}}
+       };
+       trace_file << trace.dump() << std::endl;
+
+       std::cout << "Trace has been written to: " << filename;
+       if (total_dropped > 0) {
+           std::cout << " (" << total_dropped << " oldest events dropped)";
+       }
+       std::cout << std::endl;
+       return true;
+   }
+};
+
+/**
+* Records the lifetime of a scope as one trace event, e.g.
+*     TraceScope trace("prune");
+* Does nothing if tracing was disabled when the scope was entered.
+*/
+class TraceScope {
+private:
+   const char* name;
+   uint64_t start_ns;
+   bool active;
+
+public:
+   explicit TraceScope(const char* event_name)
+       : name(event_name), start_ns(0), active(TraceRecorder::instance().is_enabled()) {
+       if (active) {
+           start_ns = TraceRecorder::instance().now_ns();
+       }
+   }
+
+   ~TraceScope() {
+       if (active) {
+           TraceRecorder& recorder = TraceRecorder::instance();
+           uint64_t end_ns = recorder.now_ns();
+           recorder.thread_buffer().record({name, start_ns, end_ns - start_ns});
+       }
+   }
+
+   TraceScope(const TraceScope&) = delete;
+   TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#endif // TRACE_EVENTS_H
@@ -101,4 +101,48 @@ public:
    }
 };
 
+/**
+* Input and output values of a transaction as arrays indexed by position in
+* get_input_ids() and get_output_ids(), i.e. by the element indices the analyzers
+* work with. Built once per analysis, so the hot paths read values from an array
+* instead of hashing string IDs; IDs are only needed to format results.
+*/
+class TransactionValues {
+private:
+   std::vector<double> input_values;
+   std::vector<double> output_values;
+
+public:
+   explicit TransactionValues(const TransactionData& tx_data) {
+       input_values.reserve(tx_data.get_input_ids().size());
+       for (const auto& id : tx_data.get_input_ids()) {
+           input_values.push_back(tx_data.get_input_value(id));
+       }
+       output_values.reserve(tx_data.get_output_ids().size());
+       for (const auto& id : tx_data.get_output_ids()) {
+           output_values.push_back(tx_data.get_output_value(id));
+       }
+   }
+   
+   // Value of the input at the given index
+   double input(size_t index) const {
+       return input_values[index];
+   }
+   
+   // Value of the output at the given index
+   double output(size_t index) const {
+       return output_values[index];
+   }
+   
+   // All input values in order of addition
+   const std::vector<double>& inputs() const {
+       return input_values;
+   }
+   
+   // All output values in order of addition
+   const std::vector<double>& outputs() const {
+       return output_values;
+   }
+};
+
 #endif // TRANSACTION_DATA_H
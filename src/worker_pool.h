@@ -0,0 +1,147 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+/**
+* A fixed set of worker threads that stay alive between analyses.
+*
+* run() hands a batch of tasks to the workers and blocks until all of them have
+* finished, like launching and joining one std::async per task, but without
+* creating threads. Several threads may call run() at the same time; their tasks
+* share the workers, tasks of a higher priority first and otherwise in the order
+* they were submitted.
+*/
+class WorkerPool {
+private:
+   struct Batch {
+       std::function<void(unsigned)> task;
+       unsigned remaining;
+       std::condition_variable done;
+   };
+
+   struct Item {
+       std::shared_ptr<Batch> batch;
+       unsigned index;
+   };
+
+   std::vector<std::thread> workers;
+   std::map<unsigned, std::deque<Item>, std::greater<unsigned>> queues;  // By priority, highest first
+   std::mutex queue_mutex;
+   std::condition_variable queue_ready;
+   bool stopping = false;
+
+   void work() {
+       while (true) {
+           Item item;
+           {
+               std::unique_lock<std::mutex> lock(queue_mutex);
+               queue_ready.wait(lock, [this]() { return stopping || !queues.empty(); });
+               if (queues.empty()) {
+                   return;
+               }
+               auto highest = queues.begin();
+               item = std::move(highest->second.front());
+               highest->second.pop_front();
+               if (highest->second.empty()) {
+                   queues.erase(highest);
+               }
+           }
+
+           item.batch->task(item.index);
+
+           std::lock_guard<std::mutex> lock(queue_mutex);
+           if (--item.batch->remaining == 0) {
+               item.batch->done.notify_all();
+           }
+       }
+   }
+
+public:
+   explicit WorkerPool(unsigned threads) {
+       workers.reserve(threads);
+       for (unsigned i = 0; i < threads; ++i) {
+           workers.emplace_back(&WorkerPool::work, this);
+       }
+   }
+
+   WorkerPool(const WorkerPool&) = delete;
+   WorkerPool& operator=(const WorkerPool&) = delete;
+
+   ~WorkerPool() {
+       {
+           std::lock_guard<std::mutex> lock(queue_mutex);
+           stopping = true;
+       }
+       queue_ready.notify_all();
+       for (auto& worker : workers) {
+           worker.join();
+       }
+   }
+
+   unsigned size() const {
+       return static_cast<unsigned>(workers.size());
+   }
+
+   /**
+   * Runs task(0) .. task(tasks-1) on the workers and waits for all of them. Without
+   * workers the tasks run on the calling thread.
+   *
+   * @param tasks Number of tasks
+   * @param task Called with the index of each task
+   * @param priority Tasks of higher priority are started before queued tasks of lower priority
+   */
+   void run(unsigned tasks, std::function<void(unsigned)> task, unsigned priority = 0) {
+       if (tasks == 0) {
+           return;
+       }
+       if (workers.empty()) {
+           for (unsigned i = 0; i < tasks; ++i) {
+               task(i);
+           }
+           return;
+       }
+
+       auto batch = std::make_shared<Batch>();
+       batch->task = std::move(task);
+       batch->remaining = tasks;
+
+       std::unique_lock<std::mutex> lock(queue_mutex);
+       std::deque<Item>& queue = queues[priority];
+       for (unsigned i = 0; i < tasks; ++i) {
+           queue.push_back({batch, i});
+       }
+       queue_ready.notify_all();
+       batch->done.wait(lock, [&batch]() { return batch->remaining == 0; });
+   }
+};
+
+/**
+* How one analysis cooperates with the other analyses of a process: the priority
+* of its tasks in the WorkerPool, and a callback at the points between chunks
+* where it may be paused, e.g. by a scheduler that lets cheaper jobs run first.
+* The callback gets a function that frees the scratch memory the analysis can
+* rebuild, or an empty one; a callback that blocks calls it first, so a paused
+* analysis does not hold its working memory while others run. Once the cancel flag
+* is set the analysis stops at its next chunk boundary with the results so far.
+*/
+struct AnalysisControl {
+   unsigned priority = 0;
+   std::function<void(const std::function<void()>& release_memory)> at_chunk_boundary;  // May be empty
+   bool export_metrics = true;  // false if the caller exports an aggregate of many analyses instead
+   const std::atomic<bool>* cancel = nullptr;  // May be null
+
+   bool cancelled() const {
+       return cancel && cancel->load();
+   }
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,367 @@
+#ifndef WORKLOAD_GENERATOR_H
+#define WORKLOAD_GENERATOR_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include <fstream>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include "transaction_data.h"
+
+/**
+* Named shapes of synthetic transactions. The shape determines the value
+* distribution of inputs and outputs, which in turn determines how many
+* partition pairs survive pruning.
+*/
+enum class WorkloadShape {
+   PAYMENT_WITH_CHANGE,   // One or more payments plus a single change output
+   BATCHED_PAYOUT,        // Few inputs paying many recipients, plus change
+   CONSOLIDATION,         // Many small inputs merged into few outputs
+   COINJOIN,              // Equal-value outputs plus change outputs
+   HEAVY_TAILED           // Pareto-distributed input and output amounts
+};
+
+const std::vector<WorkloadShape> ALL_WORKLOAD_SHAPES = {
+   WorkloadShape::PAYMENT_WITH_CHANGE,
+   WorkloadShape::BATCHED_PAYOUT,
+   WorkloadShape::CONSOLIDATION,
+   WorkloadShape::COINJOIN,
+   WorkloadShape::HEAVY_TAILED
+};
+
+/**
+* Returns the name of a workload shape as used on the command line and in corpus files.
+*/
+std::string workload_shape_name(WorkloadShape shape) {
+   switch (shape) {
+       case WorkloadShape::PAYMENT_WITH_CHANGE: return "payment_with_change";
+       case WorkloadShape::BATCHED_PAYOUT:      return "batched_payout";
+       case WorkloadShape::CONSOLIDATION:       return "consolidation";
+       case WorkloadShape::COINJOIN:            return "coinjoin";
+       case WorkloadShape::HEAVY_TAILED:        return "heavy_tailed";
+   }
+   return "unknown";
+}
+
+/**
+* Parses a workload shape name.
+*
+* @param name The shape name, e.g. "coinjoin"
+* @param shape Receives the parsed shape
+* @return true if the name is a known shape, false otherwise
+*/
+bool parse_workload_shape(const std::string& name, WorkloadShape& shape) {
+   for (WorkloadShape candidate : ALL_WORKLOAD_SHAPES) {
+       if (workload_shape_name(candidate) == name) {
+           shape = candidate;
+           return true;
+       }
+   }
+   return false;
+}
+
+/**
+* Rounds a BTC amount down to whole satoshis.
+*/
+double round_to_satoshis(double value) {
+   return std::floor(value * 1e8) / 1e8;
+}
+
+/**
+* Splits an amount into parts at uniformly random points.
+*
+* @param amount The amount to split
+* @param parts Number of parts
+* @param rng The random number generator
+* @return The parts, each rounded to satoshis; their sum never exceeds amount
+*/
+std::vector<double> split_amount(double amount, size_t parts, std::mt19937_64& rng) {
+   std::uniform_real_distribution<double> weight_dist(0.05, 1.0);
+
+   std::vector<double> weights(parts);
+   double total_weight = 0.0;
+   for (auto& weight : weights) {
+       weight = weight_dist(rng);
+       total_weight += weight;
+   }
+
+   std::vector<double> result(parts);
+   for (size_t i = 0; i < parts; ++i) {
+       result[i] = round_to_satoshis(amount * weights[i] / total_weight);
+   }
+   return result;
+}
+
+/**
+* Draws a "round" payment amount of the kind humans choose, e.g. 0.05 or 0.0125 BTC,
+* that does not exceed the given maximum.
+*/
+double draw_round_amount(double max_amount, std::mt19937_64& rng) {
+   std::uniform_real_distribution<double> fraction_dist(0.2, 0.9);
+   double amount = max_amount * fraction_dist(rng);
+
+   // Keep two significant digits
+   double magnitude = std::pow(10.0, std::floor(std::log10(amount)) - 1.0);
+   double rounded = std::floor(amount / magnitude) * magnitude;
+   return round_to_satoshis(rounded > 0.0 ? rounded : amount);
+}
+
+/**
+* Draws a log-normally distributed UTXO amount with the given median in BTC.
+*/
+double draw_utxo_amount(double median, double sigma, std::mt19937_64& rng) {
+   std::lognormal_distribution<double> amount_dist(std::log(median), sigma);
+   return std::max(round_to_satoshis(amount_dist(rng)), 0.00001);
+}
+
+/**
+* Draws a Pareto-distributed amount with the given scale (minimum) and tail index.
+*/
+double draw_pareto_amount(double scale, double alpha, std::mt19937_64& rng) {
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+   double u = 1.0 - uniform(rng);  // (0, 1]
+   return std::max(round_to_satoshis(scale / std::pow(u, 1.0 / alpha)), 0.00001);
+}
+
+/**
+* Generates a synthetic transaction of the given shape.
+* The same shape, size and seed always produce the same transaction.
+* The total output value never exceeds the total input value; the difference is the fee.
+*
+* @param shape The workload shape
+* @param num_inputs Number of inputs (at least 1)
+* @param num_outputs Number of outputs (at least 1)
+* @param seed Seed for the random number generator
+* @return The generated transaction
+*/
+TransactionData generate_workload_transaction(WorkloadShape shape, size_t num_inputs, size_t num_outputs, uint64_t seed) {
+   std::mt19937_64 rng(seed);
+   std::uniform_real_distribution<double> fee_dist(0.00001, 0.0005);
+
+   num_inputs = std::max<size_t>(num_inputs, 1);
+   num_outputs = std::max<size_t>(num_outputs, 1);
+
+   std::vector<double> input_values(num_inputs);
+   std::vector<double> output_values;
+   output_values.reserve(num_outputs);
+
+   switch (shape) {
+       case WorkloadShape::PAYMENT_WITH_CHANGE: {
+           for (auto& value : input_values) {
+               value = draw_utxo_amount(0.05, 1.5, rng);
+           }
+           double total = 0.0;
+           for (double value : input_values) total += value;
+           double spendable = std::max(total - fee_dist(rng), 0.0);
+
+           // Payments take a round share of the spendable amount, the rest is change
+           size_t num_payments = num_outputs > 1 ? num_outputs - 1 : 1;
+           double payment_budget = num_outputs > 1 ? draw_round_amount(spendable, rng) : spendable;
+           for (double payment : split_amount(payment_budget, num_payments, rng)) {
+               output_values.push_back(num_payments > 1 ? draw_round_amount(payment, rng) : payment);
+           }
+           if (num_outputs > 1) {
+               double paid = 0.0;
+               for (double value : output_values) paid += value;
+               output_values.push_back(round_to_satoshis(spendable - paid));
+           }
+           break;
+       }
+
+       case WorkloadShape::BATCHED_PAYOUT: {
+           // Large exchange-style UTXOs funding many small round payouts
+           for (auto& value : input_values) {
+               value = draw_utxo_amount(1.0, 0.8, rng);
+           }
+           double total = 0.0;
+           for (double value : input_values) total += value;
+           double spendable = std::max(total - fee_dist(rng), 0.0);
+
+           size_t num_payouts = num_outputs > 1 ? num_outputs - 1 : 1;
+           double payout_cap = spendable / num_payouts;
+           double paid = 0.0;
+           for (size_t i = 0; i < num_payouts; ++i) {
+               double payout = draw_round_amount(payout_cap, rng);
+               output_values.push_back(payout);
+               paid += payout;
+           }
+           if (num_outputs > 1) {
+               output_values.push_back(round_to_satoshis(spendable - paid));
+           }
+           break;
+       }
+
+       case WorkloadShape::CONSOLIDATION: {
+           // Many small, similar UTXOs swept into few outputs
+           for (auto& value : input_values) {
+               value = draw_utxo_amount(0.002, 1.0, rng);
+           }
+           double total = 0.0;
+           for (double value : input_values) total += value;
+           double spendable = std::max(total - fee_dist(rng), 0.0);
+           output_values = split_amount(spendable, num_outputs, rng);
+           break;
+       }
+
+       case WorkloadShape::COINJOIN: {
+           // Half the outputs (rounded up) carry the same denomination, the rest are change
+           size_t num_equal = (num_outputs + 1) / 2;
+           size_t num_change = num_outputs - num_equal;
+           const double denomination = 0.1;
+
+           // Each input covers an equal share of the mixed amount plus some surplus
+           std::uniform_real_distribution<double> surplus_dist(0.0, 0.05);
+           double share = denomination * num_equal / num_inputs;
+           double total = 0.0;
+           for (auto& value : input_values) {
+               value = round_to_satoshis(share + surplus_dist(rng) + 0.0005);
+               total += value;
+           }
+
+           for (size_t i = 0; i < num_equal; ++i) {
+               output_values.push_back(denomination);
+           }
+           double surplus = std::max(total - denomination * num_equal - fee_dist(rng), 0.0);
+           if (num_change > 0) {
+               for (double change : split_amount(surplus, num_change, rng)) {
+                   output_values.push_back(change);
+               }
+           }
+           break;
+       }
+
+       case WorkloadShape::HEAVY_TAILED: {
+           for (auto& value : input_values) {
+               value = draw_pareto_amount(0.001, 1.16, rng);
+           }
+           double total = 0.0;
+           for (double value : input_values) total += value;
+           double spendable = std::max(total - fee_dist(rng), 0.0);
+
+           std::vector<double> weights(num_outputs);
+           double total_weight = 0.0;
+           for (auto& weight : weights) {
+               weight = draw_pareto_amount(1.0, 1.16, rng);
+               total_weight += weight;
+           }
+           for (double weight : weights) {
+               output_values.push_back(round_to_satoshis(spendable * weight / total_weight));
+           }
+           break;
+       }
+   }
+
+   // Present outputs in random order, as wallets usually shuffle them
+   std::shuffle(output_values.begin(), output_values.end(), rng);
+
+   TransactionData tx_data;
+   for (size_t i = 0; i < input_values.size(); ++i) {
+       tx_data.add_input("input_" + std::to_string(i), input_values[i]);
+   }
+   for (size_t i = 0; i < output_values.size(); ++i) {
+       tx_data.add_output("output_" + std::to_string(i), output_values[i]);
+   }
+
+   return tx_data;
+}
+
+/**
+* One transaction in a transaction corpus file.
+*/
+struct CorpusEntry {
+   std::string name;
+   std::string shape;
+   uint64_t seed = 0;
+   TransactionData tx_data;
+};
+
+/**
+* Writes transactions to a corpus file, one JSON object per line:
+* {"name": ..., "shape": ..., "seed": ..., "inputs": [...], "outputs": [...]}
+*
+* @param filename The corpus file to write
+* @param entries The transactions to write
+* @return true if the file was written, false otherwise
+*/
+bool write_transaction_corpus(const std::string& filename, const std::vector<CorpusEntry>& entries) {
+   std::ofstream corpus_file(filename);
+   if (!corpus_file.is_open()) {
+       std::cerr << "Error: Could not open corpus file " << filename << std::endl;
+       return false;
+   }
+
+   for (const auto& entry : entries) {
+       nlohmann::ordered_json line;
+       line["name"] = entry.name;
+       line["shape"] = entry.shape;
+       line["seed"] = entry.seed;
+
+       line["inputs"] = nlohmann::ordered_json::array();
+       for (const auto& id : entry.tx_data.get_input_ids()) {
+           line["inputs"].push_back(entry.tx_data.get_input_value(id));
+       }
+
+       line["outputs"] = nlohmann::ordered_json::array();
+       for (const auto& id : entry.tx_data.get_output_ids()) {
+           line["outputs"].push_back(entry.tx_data.get_output_value(id));
+       }
+
+       corpus_file << line.dump() << "\n";
+   }
+
+   return true;
+}
+
+/**
+* Reads all transactions from a corpus file written by write_transaction_corpus.
+* Malformed lines are reported and skipped.
+*
+* @param filename The corpus file to read
+* @return The transactions in file order
+*/
+std::vector<CorpusEntry> read_transaction_corpus(const std::string& filename) {
+   std::vector<CorpusEntry> entries;
+
+   std::ifstream corpus_file(filename);
+   if (!corpus_file.is_open()) {
+       std::cerr << "Error: Could not open corpus file " << filename << std::endl;
+       return entries;
+   }
+
+   std::string line;
+   size_t line_number = 0;
+   while (std::getline(corpus_file, line)) {
+       ++line_number;
+       if (line.empty()) continue;
+
+       try {
+           nlohmann::json json_line = nlohmann::json::parse(line);
+
+           CorpusEntry entry;
+           entry.name = json_line.value("name", "tx_" + std::to_string(line_number));
+           entry.shape = json_line.value("shape", "");
+           entry.seed = json_line.value("seed", 0ULL);
+
+           const auto& inputs = json_line.at("inputs");
+           for (size_t i = 0; i < inputs.size(); ++i) {
+               entry.tx_data.add_input("input_" + std::to_string(i), inputs[i].get<double>());
+           }
+
+           const auto& outputs = json_line.at("outputs");
+           for (size_t i = 0; i < outputs.size(); ++i) {
+               entry.tx_data.add_output("output_" + std::to_string(i), outputs[i].get<double>());
+           }
+
+           entries.push_back(std::move(entry));
+       } catch (const nlohmann::json::exception& e) {
+           std::cerr << "Warning: Skipping malformed corpus line " << line_number << ": " << e.what() << std::endl;
+       }
+   }
+
+   return entries;
+}
+
+#endif // WORKLOAD_GENERATOR_H
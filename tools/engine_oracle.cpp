@@ -0,0 +1,248 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <nlohmann/json.hpp>
+#include "../src/transaction_data.h"
+#include "../src/workload_generator.h"
+#include "../src/engine_oracle.h"
+
+/**
+* Options of the differential test run.
+*/
+struct OracleOptions {
+   size_t count = 1000;                 // Random transactions per engine
+   size_t max_inputs = 5;
+   size_t max_outputs = 5;
+   uint64_t seed = 1;
+   std::vector<std::string> engines;    // Empty means all engines
+   std::string results_filename = "/tmp/btc_mapper_oracle.csv";
+   std::string report_filename;         // Empty means no JSON report
+   std::string failures_filename = "oracle_failures.jsonl";
+};
+
+/**
+* Totals of one engine over all transactions.
+*/
+struct EngineTotals {
+   size_t transactions = 0;
+   size_t failures = 0;
+   size_t count_mismatches = 0;
+   size_t set_mismatches = 0;
+   size_t valid_mappings = 0;
+   double reference_seconds = 0.0;
+   double engine_seconds = 0.0;
+   nlohmann::ordered_json first_failure;
+};
+
+std::vector<std::string> split_list(const std::string& text) {
+   std::vector<std::string> values;
+   std::stringstream stream(text);
+   std::string value;
+   while (std::getline(stream, value, ',')) {
+       values.push_back(value);
+   }
+   return values;
+}
+
+void print_usage(const char* program) {
+   std::cerr << "Usage: " << program << " [--count N] [--max-inputs N] [--max-outputs M] [--seed SEED]"
+             << " [--engine NAME[,NAME...]] [--output REPORT.json] [--failures FILE]" << std::endl;
+   std::cerr << "Engines:";
+   for (const auto& engine : oracle_engines()) {
+       std::cerr << " " << engine.name;
+   }
+   std::cerr << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+   OracleOptions options;
+
+   for (int i = 1; i < argc; ++i) {
+       std::string arg = argv[i];
+       if (i + 1 >= argc) {
+           print_usage(argv[0]);
+           return EXIT_FAILURE;
+       }
+
+       std::string value = argv[++i];
+       if (arg == "--count") {
+           options.count = std::stoul(value);
+       } else if (arg == "--max-inputs") {
+           options.max_inputs = std::stoul(value);
+       } else if (arg == "--max-outputs") {
+           options.max_outputs = std::stoul(value);
+       } else if (arg == "--seed") {
+           options.seed = std::stoull(value);
+       } else if (arg == "--engine") {
+           options.engines = split_list(value);
+       } else if (arg == "--output") {
+           options.report_filename = value;
+       } else if (arg == "--failures") {
+           options.failures_filename = value;
+       } else {
+           print_usage(argv[0]);
+           return EXIT_FAILURE;
+       }
+   }
+
+   std::vector<OracleEngine> engines;
+   for (const auto& engine : oracle_engines()) {
+       if (options.engines.empty() ||
+           std::find(options.engines.begin(), options.engines.end(), engine.name) != options.engines.end()) {
+           engines.push_back(engine);
+       }
+   }
+   if (engines.empty() || options.max_inputs == 0 || options.max_outputs == 0) {
+       print_usage(argv[0]);
+       return EXIT_FAILURE;
+   }
+
+   std::vector<EngineTotals> totals(engines.size());
+   std::vector<CorpusEntry> failed_transactions;
+   std::mt19937_64 rng(options.seed);
+
+   std::cout << "Comparing " << engines.size() << " engines with the reference on " << options.count
+             << " random transactions (up to " << options.max_inputs << " inputs, "
+             << options.max_outputs << " outputs)..." << std::endl;
+
+   for (size_t t = 0; t < options.count; ++t) {
+       // Draw a random small transaction
+       WorkloadShape shape = ALL_WORKLOAD_SHAPES[rng() % ALL_WORKLOAD_SHAPES.size()];
+       size_t num_inputs = 1 + rng() % options.max_inputs;
+       size_t num_outputs = 1 + rng() % options.max_outputs;
+       uint64_t tx_seed = rng();
+       TransactionData tx_data = generate_workload_transaction(shape, num_inputs, num_outputs, tx_seed);
+       std::string tx_name = workload_shape_name(shape) + "_" + std::to_string(num_inputs) + "x" +
+                             std::to_string(num_outputs) + "_" + std::to_string(tx_seed);
+
+       // Reference results are computed once per analysis type
+       std::vector<std::string> reference[2];
+       double reference_seconds[2] = {0.0, 0.0};
+       for (OracleAnalysis analysis : {OracleAnalysis::SUBSET, OracleAnalysis::PARTITION}) {
+           size_t slot = static_cast<size_t>(analysis);
+           auto reference_start = std::chrono::steady_clock::now();
+           reference[slot] = (analysis == OracleAnalysis::SUBSET) ? reference_subset_combinations(tx_data)
+                                                                   : reference_partition_mappings(tx_data);
+           reference_seconds[slot] = elapsed_ns(reference_start) / 1e9;
+       }
+
+       bool transaction_failed = false;
+       for (size_t e = 0; e < engines.size(); ++e) {
+           const OracleEngine& engine = engines[e];
+           size_t slot = static_cast<size_t>(engine.analysis);
+
+           size_t engine_count;
+           auto engine_start = std::chrono::steady_clock::now();
+           {
+               SilencedOutput silenced;
+               engine_count = engine.run(tx_data, options.results_filename);
+           }
+           double engine_seconds = elapsed_ns(engine_start) / 1e9;
+
+           std::vector<std::string> engine_results;
+           if (engine.writes_results) {
+               engine_results = (engine.analysis == OracleAnalysis::SUBSET)
+                              ? canonicalize_subset_csv(options.results_filename)
+                              : canonicalize_partition_csv(options.results_filename);
+           }
+           std::remove(options.results_filename.c_str());
+           std::remove(metrics_report_filename(options.results_filename).c_str());
+
+           OracleComparison comparison = compare_results(reference[slot], engine_count,
+                                                         engine.writes_results ? &engine_results : nullptr);
+
+           EngineTotals& total = totals[e];
+           total.transactions++;
+           total.valid_mappings += engine_count;
+           total.reference_seconds += reference_seconds[slot];
+           total.engine_seconds += engine_seconds;
+           if (!comparison.counts_match) total.count_mismatches++;
+           if (!comparison.sets_match) total.set_mismatches++;
+
+           if (!comparison.passed()) {
+               total.failures++;
+               transaction_failed = true;
+               if (total.first_failure.empty()) {
+                   total.first_failure = {
+                       {"transaction", tx_name},
+                       {"reference_count", comparison.reference_count},
+                       {"engine_count", comparison.engine_count},
+                       {"missing", comparison.missing},
+                       {"unexpected", comparison.unexpected}
+                   };
+               }
+           }
+       }
+
+       if (transaction_failed) {
+           CorpusEntry entry;
+           entry.name = tx_name;
+           entry.shape = workload_shape_name(shape);
+           entry.seed = tx_seed;
+           entry.tx_data = tx_data;
+           failed_transactions.push_back(entry);
+       }
+   }
+
+   // Report
+   nlohmann::ordered_json report;
+   report["transactions"] = options.count;
+   report["max_inputs"] = options.max_inputs;
+   report["max_outputs"] = options.max_outputs;
+   report["seed"] = options.seed;
+   report["engines"] = nlohmann::json::array();
+
+   bool all_passed = true;
+   int name_width = 0;
+   for (const auto& engine : engines) {
+       name_width = std::max(name_width, static_cast<int>(engine.name.size()));
+   }
+   std::cout << std::endl;
+   for (size_t e = 0; e < engines.size(); ++e) {
+       const EngineTotals& total = totals[e];
+       double throughput_ratio = total.engine_seconds > 0.0 ? total.reference_seconds / total.engine_seconds : 0.0;
+       all_passed = all_passed && total.failures == 0;
+
+       std::printf("%-*s %s  %zu/%zu transactions match  %zu valid mappings  %.2fx reference throughput\n",
+                   name_width, engines[e].name.c_str(), total.failures ? "FAIL" : "ok  ",
+                   total.transactions - total.failures, total.transactions, total.valid_mappings, throughput_ratio);
+       if (total.failures) {
+           std::cout << "  first failure: " << total.first_failure.dump() << std::endl;
+       }
+
+       report["engines"].push_back({
+           {"name", engines[e].name},
+           {"analysis", engines[e].analysis == OracleAnalysis::SUBSET ? "subset" : "partition"},
+           {"compares_results", engines[e].writes_results},
+           {"transactions", total.transactions},
+           {"failures", total.failures},
+           {"count_mismatches", total.count_mismatches},
+           {"set_mismatches", total.set_mismatches},
+           {"valid_mappings", total.valid_mappings},
+           {"reference_seconds", total.reference_seconds},
+           {"engine_seconds", total.engine_seconds},
+           {"throughput_ratio", throughput_ratio},
+           {"first_failure", total.first_failure}
+       });
+   }
+
+   if (!failed_transactions.empty() && write_transaction_corpus(options.failures_filename, failed_transactions)) {
+       std::cout << "Failing transactions have been written to: " << options.failures_filename << std::endl;
+   }
+
+   if (!options.report_filename.empty()) {
+       std::ofstream report_file(options.report_filename);
+       if (!report_file.is_open()) {
+           std::cerr << "Error: Could not open report file " << options.report_filename << std::endl;
+           return EXIT_FAILURE;
+       }
+       report_file << report.dump(2) << std::endl;
+       std::cout << "Report has been written to: " << options.report_filename << std::endl;
+   }
+
+   return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "../src/transaction_data.h"
+#include "../src/workload_generator.h"
+
+void print_usage(const char* program) {
+   std::cerr << "Usage: " << program << " [--shape NAME|all] [--inputs N] [--outputs M] [--count C] [--seed SEED] [--output FILE]" << std::endl;
+   std::cerr << "Shapes:";
+   for (WorkloadShape shape : ALL_WORKLOAD_SHAPES) {
+       std::cerr << " " << workload_shape_name(shape);
+   }
+   std::cerr << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+   std::string shape_name = "all";
+   size_t num_inputs = 4;
+   size_t num_outputs = 4;
+   size_t count = 10;
+   uint64_t seed = 42;
+   std::string output_filename = "transaction_corpus.jsonl";
+
+   for (int i = 1; i < argc; ++i) {
+       std::string arg = argv[i];
+       if (i + 1 >= argc) {
+           print_usage(argv[0]);
+           return EXIT_FAILURE;
+       }
+
+       std::string value = argv[++i];
+       if (arg == "--shape") {
+           shape_name = value;
+       } else if (arg == "--inputs") {
+           num_inputs = std::stoul(value);
+       } else if (arg == "--outputs") {
+           num_outputs = std::stoul(value);
+       } else if (arg == "--count") {
+           count = std::stoul(value);
+       } else if (arg == "--seed") {
+           seed = std::stoull(value);
+       } else if (arg == "--output") {
+           output_filename = value;
+       } else {
+           print_usage(argv[0]);
+           return EXIT_FAILURE;
+       }
+   }
+
+   std::vector<WorkloadShape> shapes;
+   if (shape_name == "all") {
+       shapes = ALL_WORKLOAD_SHAPES;
+   } else {
+       WorkloadShape shape;
+       if (!parse_workload_shape(shape_name, shape)) {
+           std::cerr << "Error: Unknown shape " << shape_name << std::endl;
+           print_usage(argv[0]);
+           return EXIT_FAILURE;
+       }
+       shapes.push_back(shape);
+   }
+
+   // Each transaction gets its own seed so single entries can be regenerated
+   std::vector<CorpusEntry> entries;
+   for (WorkloadShape shape : shapes) {
+       for (size_t i = 0; i < count; ++i) {
+           CorpusEntry entry;
+           entry.shape = workload_shape_name(shape);
+           entry.seed = seed + i;
+           entry.name = entry.shape + "_" + std::to_string(num_inputs) + "x" + std::to_string(num_outputs)
+                      + "_" + std::to_string(entry.seed);
+           entry.tx_data = generate_workload_transaction(shape, num_inputs, num_outputs, entry.seed);
+           entries.push_back(std::move(entry));
+       }
+   }
+
+   if (!write_transaction_corpus(output_filename, entries)) {
+       return EXIT_FAILURE;
+   }
+
+   std::cout << "Wrote " << entries.size() << " transactions to: " << output_filename << std::endl;
+   return EXIT_SUCCESS;
+}